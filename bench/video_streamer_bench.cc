@@ -0,0 +1,791 @@
+// video_streamer_bench.cc
+// 离线性能测试: 合成画面和本地生成的 H.264/HEVC 文件经过 FFmpegCapture/FFmpegPusher 写到 null 或文件,
+// 每个用例输出一行 JSON(帧率、单帧延迟分位数、CPU时间、峰值内存), 便于在不同提交之间对比
+//
+//   video_streamer_bench [--frames=N] [--filter=子串] [--work_dir=目录] [--label=标签] [--baseline=旧结果] [--list]
+//   video_streamer_bench --label=$(git rev-parse --short HEAD) > new.jsonl
+//   video_streamer_bench --baseline=old.jsonl > new.jsonl
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/log.h>
+#include <libavutil/opt.h>
+}
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ffmpeg_capture.hh"
+#include "ffmpeg_pusher.hh"
+#include "metrics.hh"
+
+using Clock = std::chrono::steady_clock;
+
+enum class BenchKind
+{
+    Encode,      // 合成画面 -> 编码 -> 输出
+    Transcode,   // 文件 -> 解码 -> 编码 -> 输出
+    Passthrough, // 文件 -> 转封装 -> 输出
+};
+
+static const char *kindName(BenchKind kind)
+{
+    switch (kind)
+    {
+    case BenchKind::Encode:
+        return "encode";
+    case BenchKind::Transcode:
+        return "transcode";
+    case BenchKind::Passthrough:
+        return "passthrough";
+    }
+    return "unknown";
+}
+
+// 本地生成的输入文件
+struct BenchSource
+{
+    std::string name; // 如 1080p_h264
+    int width;
+    int height;
+    AVCodecID codecId;
+};
+
+struct BenchCase
+{
+    std::string name;
+    BenchKind kind;
+    int width = 0;
+    int height = 0;
+    std::string source;          // 转码/直通的输入文件名, 见 BenchSource
+    std::string profile = "balanced";
+    std::string preset;          // 为空时使用档位的 preset
+    int encoderThreads = 0;      // 0 表示自动
+    int decoderThreads = 0;
+    std::string output = "null"; // null/file
+};
+
+struct BenchOptions
+{
+    int frames = 150;
+    int frameRate = 30;
+    std::string filter;
+    std::string workDir = "bench_media";
+    std::string label;
+    std::string baseline;
+    bool list = false;
+};
+
+static std::string resolutionName(int height)
+{
+    return height >= 2160 ? "2160p" : std::to_string(height) + "p";
+}
+
+static std::vector<BenchSource> benchSources()
+{
+    return {
+        {"720p_h264", 1280, 720, AV_CODEC_ID_H264},
+        {"1080p_h264", 1920, 1080, AV_CODEC_ID_H264},
+        {"1080p_hevc", 1920, 1080, AV_CODEC_ID_HEVC},
+        {"2160p_h264", 3840, 2160, AV_CODEC_ID_H264},
+        {"2160p_hevc", 3840, 2160, AV_CODEC_ID_HEVC},
+    };
+}
+
+static std::vector<BenchCase> benchCases()
+{
+    std::vector<BenchCase> cases;
+    const int sizes[][2] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+
+    // 编码: 分辨率 x 档位 x 线程数
+    for (const auto &size : sizes)
+    {
+        for (const char *profile : {"ultra-low-latency", "balanced"})
+        {
+            for (int threads : {1, 0})
+            {
+                BenchCase c;
+                c.kind = BenchKind::Encode;
+                c.width = size[0];
+                c.height = size[1];
+                c.profile = profile;
+                c.encoderThreads = threads;
+                c.name = std::string("encode_") + resolutionName(size[1]) + "_" + profile +
+                         (threads ? "_t" + std::to_string(threads) : "_tauto");
+                cases.push_back(c);
+            }
+        }
+    }
+    // 编码: 1080p 不同 preset
+    for (const char *preset : {"ultrafast", "veryfast", "medium", "slow"})
+    {
+        BenchCase c;
+        c.kind = BenchKind::Encode;
+        c.width = 1920;
+        c.height = 1080;
+        c.preset = preset;
+        c.name = std::string("encode_1080p_preset_") + preset;
+        cases.push_back(c);
+    }
+    // 转码: 输入编码 x 解码线程数, 编码使用低延迟档位
+    for (const char *source : {"1080p_h264", "1080p_hevc", "2160p_h264", "2160p_hevc"})
+    {
+        for (int threads : {1, 0})
+        {
+            BenchCase c;
+            c.kind = BenchKind::Transcode;
+            c.source = source;
+            c.profile = "ultra-low-latency";
+            c.decoderThreads = threads;
+            c.name = std::string("transcode_") + source + (threads ? "_dt" + std::to_string(threads) : "_dtauto");
+            cases.push_back(c);
+        }
+    }
+    // 直通: 输入编码 x 输出类型
+    for (const char *source : {"1080p_h264", "1080p_hevc", "2160p_hevc"})
+    {
+        for (const char *output : {"null", "file"})
+        {
+            BenchCase c;
+            c.kind = BenchKind::Passthrough;
+            c.source = source;
+            c.output = output;
+            c.name = std::string("passthrough_") + source + "_" + output;
+            cases.push_back(c);
+        }
+    }
+    return cases;
+}
+
+// 合成画面: 带纹理的大画布, 每帧取一个移动的窗口(平移运动), 帧数据引用画布, 不逐帧绘制
+class PatternSource
+{
+public:
+    PatternSource(int w, int h) : width(w), height(h)
+    {
+        canvasWidth = w + Margin;
+        canvasHeight = h + Margin;
+        size_t lumaSize = static_cast<size_t>(canvasWidth) * canvasHeight;
+        size_t chromaSize = lumaSize / 4;
+        buffer = av_buffer_alloc(static_cast<int>(lumaSize + chromaSize * 2));
+        if (!buffer)
+            return;
+
+        uint8_t *luma = buffer->data;
+        uint8_t *cb = luma + lumaSize;
+        uint8_t *cr = cb + chromaSize;
+        for (int y = 0; y < canvasHeight; y++)
+        {
+            for (int x = 0; x < canvasWidth; x++)
+            {
+                // 低频渐变 + 8x8 块纹理, 接近摄像头画面的可压缩性
+                unsigned hash = (static_cast<unsigned>(x / 8) * 73856093u) ^ (static_cast<unsigned>(y / 8) * 19349663u);
+                int value = 128 + static_cast<int>(60 * std::sin(x / 37.0) * std::cos(y / 23.0)) +
+                            static_cast<int>(hash % 64) - 32;
+                luma[static_cast<size_t>(y) * canvasWidth + x] = static_cast<uint8_t>(std::min(255, std::max(0, value)));
+            }
+        }
+        for (int y = 0; y < canvasHeight / 2; y++)
+        {
+            for (int x = 0; x < canvasWidth / 2; x++)
+            {
+                size_t i = static_cast<size_t>(y) * (canvasWidth / 2) + x;
+                cb[i] = static_cast<uint8_t>(64 + (x * 128) / (canvasWidth / 2));
+                cr[i] = static_cast<uint8_t>(64 + (y * 128) / (canvasHeight / 2));
+            }
+        }
+    }
+
+    ~PatternSource() { av_buffer_unref(&buffer); }
+
+    bool valid() const { return buffer != nullptr; }
+
+    // 第 index 帧, frame 引用画布数据
+    bool frameAt(int64_t index, AVFrame *frame)
+    {
+        av_frame_unref(frame);
+        frame->buf[0] = av_buffer_ref(buffer);
+        if (!frame->buf[0])
+            return false;
+
+        // 沿对角线往返移动, 偏移保持偶数以对齐色度
+        int period = Margin / Step;
+        int phase = static_cast<int>(index % (2 * period));
+        int offset = (phase < period ? phase : 2 * period - phase) * Step;
+        int chromaWidth = canvasWidth / 2;
+        uint8_t *luma = buffer->data;
+        uint8_t *cb = luma + static_cast<size_t>(canvasWidth) * canvasHeight;
+        uint8_t *cr = cb + static_cast<size_t>(chromaWidth) * (canvasHeight / 2);
+
+        frame->format = AV_PIX_FMT_YUV420P;
+        frame->width = width;
+        frame->height = height;
+        frame->data[0] = luma + static_cast<size_t>(offset) * canvasWidth + offset;
+        frame->data[1] = cb + static_cast<size_t>(offset / 2) * chromaWidth + offset / 2;
+        frame->data[2] = cr + static_cast<size_t>(offset / 2) * chromaWidth + offset / 2;
+        frame->linesize[0] = canvasWidth;
+        frame->linesize[1] = chromaWidth;
+        frame->linesize[2] = chromaWidth;
+        frame->pts = index;
+        return true;
+    }
+
+private:
+    static const int Margin = 256;
+    static const int Step = 4;
+    int width, height;
+    int canvasWidth, canvasHeight;
+    AVBufferRef *buffer = nullptr;
+};
+
+static bool fileExists(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 && st.st_size > 0;
+}
+
+static std::string sourcePath(const BenchOptions &opts, const std::string &name)
+{
+    return opts.workDir + "/" + name + ".mkv";
+}
+
+// 用合成画面生成输入文件(无 B 帧, GOP 2 秒, 接近摄像头码流); 已存在时复用, 保证多次运行输入一致
+static bool generateSource(const BenchOptions &opts, const BenchSource &src)
+{
+    std::string path = sourcePath(opts, src.name);
+    if (fileExists(path))
+        return true;
+
+    const AVCodec *codec = avcodec_find_encoder(src.codecId);
+    if (!codec)
+    {
+        std::cerr << "未找到编码器: " << avcodec_get_name(src.codecId) << ", 跳过 " << src.name << std::endl;
+        return false;
+    }
+    std::cerr << "生成测试文件: " << path << std::endl;
+
+    AVCodecContext *enc = avcodec_alloc_context3(codec);
+    AVFormatContext *fmt = nullptr;
+    AVFrame *frame = av_frame_alloc();
+    AVPacket *pkt = av_packet_alloc();
+    PatternSource pattern(src.width, src.height);
+    bool ok = enc && frame && pkt && pattern.valid() &&
+              avformat_alloc_output_context2(&fmt, nullptr, "matroska", path.c_str()) >= 0;
+    AVStream *stream = nullptr;
+    if (ok)
+    {
+        enc->width = src.width;
+        enc->height = src.height;
+        enc->pix_fmt = AV_PIX_FMT_YUV420P;
+        enc->time_base = {1, opts.frameRate};
+        enc->framerate = {opts.frameRate, 1};
+        enc->gop_size = opts.frameRate * 2;
+        enc->max_b_frames = 0;
+        enc->bit_rate = static_cast<int64_t>(src.width) * src.height * 2; // 1080p 约 4 Mbps
+        if (fmt->oformat->flags & AVFMT_GLOBALHEADER)
+            enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        av_opt_set(enc->priv_data, "preset", "veryfast", 0);
+        ok = avcodec_open2(enc, codec, nullptr) >= 0 && (stream = avformat_new_stream(fmt, nullptr)) &&
+             avcodec_parameters_from_context(stream->codecpar, enc) >= 0;
+    }
+    if (ok)
+    {
+        stream->time_base = enc->time_base;
+        ok = avio_open2(&fmt->pb, path.c_str(), AVIO_FLAG_WRITE, nullptr, nullptr) >= 0 &&
+             avformat_write_header(fmt, nullptr) >= 0;
+    }
+
+    // 编码所有帧后送入空帧排空编码器
+    for (int64_t i = 0; ok && i <= opts.frames; i++)
+    {
+        bool flush = i == opts.frames;
+        if (!flush && !pattern.frameAt(i, frame))
+            ok = false;
+        if (ok && avcodec_send_frame(enc, flush ? nullptr : frame) < 0)
+            ok = false;
+        while (ok && avcodec_receive_packet(enc, pkt) >= 0)
+        {
+            av_packet_rescale_ts(pkt, enc->time_base, stream->time_base);
+            pkt->stream_index = stream->index;
+            if (av_interleaved_write_frame(fmt, pkt) < 0)
+                ok = false;
+        }
+    }
+    if (ok)
+        ok = av_write_trailer(fmt) >= 0;
+
+    if (fmt)
+    {
+        if (fmt->pb)
+            avio_closep(&fmt->pb);
+        avformat_free_context(fmt);
+    }
+    av_packet_free(&pkt);
+    av_frame_free(&frame);
+    avcodec_free_context(&enc);
+    if (!ok)
+    {
+        std::cerr << "生成测试文件失败: " << path << std::endl;
+        std::remove(path.c_str());
+    }
+    return ok;
+}
+
+// 一个用例的测量结果, 在子进程中得出
+struct BenchResult
+{
+    uint64_t frames = 0;
+    double seconds = 0;
+    std::vector<double> latencyMs; // 帧进入处理到编码包(或转发包)交给输出的时间
+    OutputStats output;
+    std::array<double, static_cast<size_t>(Stage::Count)> stageSeconds{};
+};
+
+static double percentile(std::vector<double> &values, double p)
+{
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+    return values[std::min(values.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static double elapsedMs(Clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+}
+
+// 编码器按输入顺序输出包, 按先进先出匹配即可得到含编码器缓存的延迟; 一帧可能对应零个或多个包
+static void collectPackets(FFmpegPusher &pusher, std::vector<PacketPtr> &packets,
+                           std::deque<Clock::time_point> &pending, BenchResult &result)
+{
+    for (size_t i = 0; i < packets.size(); i++)
+    {
+        if (!pending.empty())
+        {
+            result.latencyMs.push_back(elapsedMs(pending.front()));
+            pending.pop_front();
+        }
+        result.frames++;
+    }
+    if (!packets.empty())
+        pusher.writePackets(packets);
+}
+
+static bool runEncode(const BenchCase &c, const BenchOptions &opts, FFmpegPusher &pusher, BenchResult &result)
+{
+    PatternSource pattern(c.width, c.height);
+    AVFrame *frame = av_frame_alloc();
+    if (!pattern.valid() || !frame)
+        return false;
+
+    std::deque<Clock::time_point> pending;
+    std::vector<PacketPtr> packets;
+    bool ok = true;
+    for (int64_t i = 0; ok && i < opts.frames; i++)
+    {
+        ok = pattern.frameAt(i, frame);
+        pending.push_back(Clock::now());
+        if (ok && (ok = pusher.encodeFrame(frame, packets)))
+            collectPackets(pusher, packets, pending, result);
+    }
+    // 编码器缓存的最后几帧在这里取出计入, close 时不再有剩余
+    if (ok && (ok = pusher.finishEncoding(packets)))
+        collectPackets(pusher, packets, pending, result);
+    av_frame_free(&frame);
+    return ok;
+}
+
+static bool runTranscode(FFmpegCapture &capture, FFmpegPusher &pusher, BenchResult &result)
+{
+    AVPacket *input = av_packet_alloc();
+    AVFrame *frame = av_frame_alloc();
+    if (!input || !frame)
+        return false;
+
+    std::deque<Clock::time_point> pending;
+    std::vector<PacketPtr> packets;
+    bool ok = true;
+    bool eof = false;
+    while (ok && !eof)
+    {
+        // 输入读完后送入结束标志, 取出解码器缓存的剩余帧
+        eof = !capture.readPacket(input);
+        if (!eof)
+            pending.push_back(Clock::now());
+        ok = capture.sendPacket(eof ? nullptr : input);
+        av_packet_unref(input);
+
+        bool gotFrame = false;
+        while (ok && capture.receiveFrame(frame, gotFrame) && gotFrame)
+        {
+            if ((ok = pusher.encodeFrame(frame, packets)))
+                collectPackets(pusher, packets, pending, result);
+            av_frame_unref(frame);
+        }
+    }
+    if (ok && (ok = pusher.finishEncoding(packets)))
+        collectPackets(pusher, packets, pending, result);
+    av_frame_free(&frame);
+    av_packet_free(&input);
+    return ok;
+}
+
+static bool runPassthrough(FFmpegCapture &capture, FFmpegPusher &pusher, BenchResult &result)
+{
+    AVPacket *pkt = av_packet_alloc();
+    if (!pkt)
+        return false;
+
+    bool ok = true;
+    while (ok)
+    {
+        // 直通的延迟为读包(解封装)到交给输出的时间
+        Clock::time_point start = Clock::now();
+        if (!capture.readPacket(pkt))
+            break;
+        ok = pusher.pushPacket(pkt);
+        av_packet_unref(pkt);
+        result.latencyMs.push_back(elapsedMs(start));
+        result.frames++;
+    }
+    av_packet_free(&pkt);
+    return ok;
+}
+
+// 在子进程中执行一个用例
+static bool runCase(const BenchCase &c, const BenchOptions &opts, BenchResult &result)
+{
+    StreamMetrics metrics(c.name);
+    EncoderProfile profile;
+    if (!encoderProfileByName(c.profile, profile))
+        return false;
+    if (!c.preset.empty())
+        profile.preset = c.preset;
+
+    std::string outputUrl = c.output == "file" ? opts.workDir + "/out_" + c.name + ".mkv" : "-";
+    std::unique_ptr<FFmpegCapture> capture;
+    std::unique_ptr<FFmpegPusher> pusher;
+    int width = c.width, height = c.height;
+    int frameRate = opts.frameRate;
+
+    if (c.kind != BenchKind::Encode)
+    {
+        CaptureOptions captureOptions;
+        captureOptions.decoderThreads = c.decoderThreads;
+        capture.reset(new FFmpegCapture(sourcePath(opts, c.source), captureOptions));
+        capture->setMetrics(&metrics);
+        if (!capture->open())
+            return false;
+        width = capture->getWidth();
+        height = capture->getHeight();
+        AVRational rate = capture->getFrameRate();
+        if (rate.num > 0 && rate.den > 0)
+            frameRate = std::max(1, static_cast<int>(std::lround(av_q2d(rate))));
+    }
+
+    pusher.reset(new FFmpegPusher(outputUrl, width, height, frameRate, c.output));
+    pusher->setEncoderThreads(c.encoderThreads);
+    pusher->setEncoderProfile(profile);
+    pusher->setMetrics(&metrics);
+    if (capture)
+        pusher->setInputTimeBase(capture->getTimeBase());
+    bool ready = c.kind == BenchKind::Passthrough
+                     ? pusher->initPassthrough(capture->getCodecParameters(), capture->getTimeBase())
+                     : pusher->init();
+    if (!ready)
+        return false;
+
+    Clock::time_point start = Clock::now();
+    bool ok = false;
+    switch (c.kind)
+    {
+    case BenchKind::Encode:
+        ok = runEncode(c, opts, *pusher, result);
+        break;
+    case BenchKind::Transcode:
+        ok = runTranscode(*capture, *pusher, result);
+        break;
+    case BenchKind::Passthrough:
+        ok = runPassthrough(*capture, *pusher, result);
+        break;
+    }
+    // 计入输出队列写完的时间
+    pusher->close();
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.output = pusher->getOutputStats();
+    for (size_t s = 0; s < result.stageSeconds.size(); s++)
+        result.stageSeconds[s] = metrics.stages[s].snapshot().sumSeconds;
+    if (capture)
+        capture->close();
+    if (c.output == "file")
+        std::remove(outputUrl.c_str());
+    return ok;
+}
+
+// 子进程输出的 JSON 片段(不含 CPU 和内存, 由父进程按子进程的资源统计补充)
+static std::string resultJson(BenchResult &r)
+{
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "\"frames\":" << r.frames << ",\"seconds\":" << r.seconds
+        << ",\"fps\":" << (r.seconds > 0 ? r.frames / r.seconds : 0)
+        << ",\"latency_p50_ms\":" << percentile(r.latencyMs, 0.5)
+        << ",\"latency_p90_ms\":" << percentile(r.latencyMs, 0.9)
+        << ",\"latency_p99_ms\":" << percentile(r.latencyMs, 0.99)
+        << ",\"latency_max_ms\":" << percentile(r.latencyMs, 1.0)
+        << ",\"output_bytes\":" << r.output.writtenBytes
+        << ",\"dropped_packets\":" << r.output.droppedPackets
+        << ",\"stage_seconds\":{";
+    for (size_t s = 0; s < r.stageSeconds.size(); s++)
+        out << (s ? "," : "") << "\"" << stageName(static_cast<Stage>(s)) << "\":" << r.stageSeconds[s];
+    out << "}";
+    return out.str();
+}
+
+// 在子进程中执行用例, 每个用例的 CPU 时间和峰值内存互不影响
+static bool runIsolated(const BenchCase &c, const BenchOptions &opts, std::string &json)
+{
+    int fds[2];
+    if (pipe(fds) < 0)
+        return false;
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+    }
+    if (pid == 0)
+    {
+        // 子进程: 各模块的日志改到标准错误, 标准输出只留给结果
+        ::close(fds[0]);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        av_log_set_level(AV_LOG_ERROR);
+        BenchResult result;
+        bool ok = runCase(c, opts, result);
+        std::string body = ok ? resultJson(result) : "";
+        ssize_t written = write(fds[1], body.data(), body.size());
+        ::close(fds[1]);
+        std::cout.flush();
+        _exit(ok && written == static_cast<ssize_t>(body.size()) ? 0 : 1);
+    }
+
+    ::close(fds[1]);
+    std::string body;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+        body.append(buf, static_cast<size_t>(n));
+    ::close(fds[0]);
+
+    int status = 0;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || body.empty())
+        return false;
+
+    double cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{";
+    if (!opts.label.empty())
+        out << "\"label\":\"" << opts.label << "\",";
+    out << "\"case\":\"" << c.name << "\",\"kind\":\"" << kindName(c.kind) << "\"";
+    if (!c.source.empty())
+        out << ",\"source\":\"" << c.source << "\"";
+    else
+        out << ",\"width\":" << c.width << ",\"height\":" << c.height;
+    if (c.kind != BenchKind::Passthrough)
+        out << ",\"profile\":\"" << c.profile << "\",\"preset\":\"" << c.preset << "\",\"encoder_threads\":" << c.encoderThreads;
+    if (c.kind != BenchKind::Encode)
+        out << ",\"decoder_threads\":" << c.decoderThreads;
+    out << ",\"output\":\"" << c.output << "\"," << body
+        << ",\"cpu_seconds\":" << cpuSeconds
+        << ",\"peak_rss_kb\":" << usage.ru_maxrss << "}";
+    json = out.str();
+    return true;
+}
+
+// 从一行结果中取数值字段, 结果格式固定, 不需要完整的 JSON 解析
+static bool jsonNumber(const std::string &line, const std::string &key, double &value)
+{
+    size_t pos = line.find("\"" + key + "\":");
+    if (pos == std::string::npos)
+        return false;
+    value = std::strtod(line.c_str() + pos + key.size() + 3, nullptr);
+    return true;
+}
+
+static std::string jsonString(const std::string &line, const std::string &key)
+{
+    std::string prefix = "\"" + key + "\":\"";
+    size_t pos = line.find(prefix);
+    if (pos == std::string::npos)
+        return "";
+    pos += prefix.size();
+    size_t end = line.find('"', pos);
+    return end == std::string::npos ? "" : line.substr(pos, end - pos);
+}
+
+static std::map<std::string, std::string> loadBaseline(const std::string &path)
+{
+    std::map<std::string, std::string> lines;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::string name = jsonString(line, "case");
+        if (!name.empty())
+            lines[name] = line;
+    }
+    if (!in.eof())
+        std::cerr << "无法读取基准结果: " << path << std::endl;
+    return lines;
+}
+
+static std::string change(double before, double after)
+{
+    if (before <= 0)
+        return "";
+    std::ostringstream out;
+    out << std::showpos << std::fixed << std::setprecision(1) << (after - before) / before * 100 << "%";
+    return out.str();
+}
+
+static void printSummary(const std::string &json, const std::map<std::string, std::string> &baseline)
+{
+    std::string name = jsonString(json, "case");
+    double fps = 0, p99 = 0, cpu = 0, rss = 0;
+    jsonNumber(json, "fps", fps);
+    jsonNumber(json, "latency_p99_ms", p99);
+    jsonNumber(json, "cpu_seconds", cpu);
+    jsonNumber(json, "peak_rss_kb", rss);
+
+    std::cerr << std::left << std::setw(44) << name << std::right << std::fixed << std::setprecision(1)
+              << " fps=" << std::setw(8) << fps << " p99=" << std::setw(7) << p99 << "ms"
+              << " cpu=" << std::setw(6) << cpu << "s rss=" << std::setw(6) << rss / 1024 << "MB";
+
+    auto old = baseline.find(name);
+    double oldFps = 0, oldP99 = 0;
+    if (old != baseline.end() && jsonNumber(old->second, "fps", oldFps) && jsonNumber(old->second, "latency_p99_ms", oldP99))
+        std::cerr << "  fps " << change(oldFps, fps) << ", p99 " << change(oldP99, p99);
+    std::cerr << std::endl;
+}
+
+static bool parseArgs(int argc, char *argv[], BenchOptions &opts)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--list")
+        {
+            opts.list = true;
+            continue;
+        }
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+            return false;
+        std::string key = arg.substr(2, eq - 2);
+        std::string value = arg.substr(eq + 1);
+        try
+        {
+            if (key == "frames")
+                opts.frames = std::max(1, std::stoi(value));
+            else if (key == "filter")
+                opts.filter = value;
+            else if (key == "work_dir")
+                opts.workDir = value;
+            else if (key == "label")
+                opts.label = value;
+            else if (key == "baseline")
+                opts.baseline = value;
+            else
+                return false;
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    BenchOptions opts;
+    if (!parseArgs(argc, argv, opts))
+    {
+        std::cerr << "用法: " << argv[0]
+                  << " [--frames=N] [--filter=子串] [--work_dir=目录] [--label=标签] [--baseline=旧结果.jsonl] [--list]"
+                  << std::endl;
+        return -1;
+    }
+
+    std::vector<BenchCase> cases;
+    for (const auto &c : benchCases())
+    {
+        if (opts.filter.empty() || c.name.find(opts.filter) != std::string::npos)
+            cases.push_back(c);
+    }
+    if (opts.list)
+    {
+        for (const auto &c : cases)
+            std::cout << c.name << std::endl;
+        return 0;
+    }
+
+    // 只生成选中的用例用到的输入文件
+    mkdir(opts.workDir.c_str(), 0755);
+    av_log_set_level(AV_LOG_ERROR);
+    std::map<std::string, bool> sourceReady;
+    for (const auto &src : benchSources())
+    {
+        bool used = std::any_of(cases.begin(), cases.end(), [&src](const BenchCase &c)
+                                { return c.source == src.name; });
+        if (used)
+            sourceReady[src.name] = generateSource(opts, src);
+    }
+
+    std::map<std::string, std::string> baseline;
+    if (!opts.baseline.empty())
+        baseline = loadBaseline(opts.baseline);
+
+    int failures = 0;
+    for (const auto &c : cases)
+    {
+        if (!c.source.empty() && !sourceReady[c.source])
+        {
+            std::cerr << std::left << std::setw(44) << c.name << " 跳过(没有输入文件)" << std::endl;
+            continue;
+        }
+        std::string json;
+        if (!runIsolated(c, opts, json))
+        {
+            std::cerr << std::left << std::setw(44) << c.name << " 失败" << std::endl;
+            failures++;
+            continue;
+        }
+        std::cout << json << std::endl;
+        printSummary(json, baseline);
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+// shm_frame_consumer.cc
+// 共享内存帧环的示例读者: 零拷贝读取最新帧, 计算第一个平面(YUV 的亮度)的平均值
+// 用法: ./shm_frame_consumer /video_streamer.cam01
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "shm_frame_ring.hh"
+
+static std::atomic<bool> running{true};
+
+static void signalHandler(int)
+{
+    running = false;
+}
+
+// 直接在共享内存上计算, 不拷贝图像
+static double meanOfFirstPlane(const ShmFrameView &view)
+{
+    if (!view.data[0] || view.width <= 0 || view.height <= 0)
+        return 0;
+    uint64_t sum = 0;
+    for (int y = 0; y < view.height; y++)
+    {
+        const uint8_t *row = view.data[0] + static_cast<size_t>(y) * view.linesize[0];
+        for (int x = 0; x < view.width; x++)
+            sum += row[x];
+    }
+    return static_cast<double>(sum) / (static_cast<uint64_t>(view.width) * view.height);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        std::cerr << "用法: " << argv[0] << " <共享内存名>" << std::endl;
+        return -1;
+    }
+    std::signal(SIGINT, signalHandler);
+    std::signal(SIGTERM, signalHandler);
+
+    ShmFrameReader reader;
+    uint64_t last = 0, received = 0, skipped = 0, torn = 0;
+    double mean = 0;
+    auto lastFrame = std::chrono::steady_clock::now();
+    auto lastReport = lastFrame;
+    ShmFrameView view;
+
+    while (running)
+    {
+        auto now = std::chrono::steady_clock::now();
+        // 发布方重启或分辨率变大时会重新创建共享内存段, 长时间没有新帧就重新打开
+        if (!reader.isOpen() || now - lastFrame > std::chrono::seconds(3))
+        {
+            if (!reader.open(argv[1]))
+            {
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                continue;
+            }
+            std::cout << "已打开共享内存: " << argv[1] << std::endl;
+            last = 0;
+            lastFrame = now;
+        }
+
+        if (!reader.latest(view, last))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        double value = meanOfFirstPlane(view);
+        // 处理期间槽被覆盖, 结果作废
+        if (!reader.valid(view))
+        {
+            torn++;
+            continue;
+        }
+        if (last && view.frameNumber > last + 1)
+            skipped += view.frameNumber - last - 1;
+        last = view.frameNumber;
+        lastFrame = now;
+        received++;
+        mean = value;
+
+        if (now - lastReport >= std::chrono::seconds(1))
+        {
+            lastReport = now;
+            std::cout << "帧号=" << view.frameNumber << ", " << view.width << "x" << view.height
+                      << ", 格式=" << view.format << ", pts=" << view.pts << ", 平均亮度=" << mean
+                      << ", 已读=" << received << ", 跳过=" << skipped << ", 被覆盖=" << torn << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,53 @@
+// bitrate_controller.hh
+#ifndef BITRATE_CONTROLLER_H
+#define BITRATE_CONTROLLER_H
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ffmpeg_encoder.hh"
+#include "ffmpeg_output.hh"
+
+struct AdaptiveBitrateOptions
+{
+    bool enabled = false;
+    int64_t minBitRate = 256000; // 码率下限, 到达下限仍拥塞时才降帧率
+    double stepDown = 0.7;       // 拥塞时码率乘以该系数(不高于实测吞吐)
+    double stepUp = 1.1;         // 探测回升时码率乘以该系数
+    double maxQueueSeconds = 0.5; // 队列积压超过该时长视为拥塞, 决定了拥塞时延迟的上限
+    double busyThreshold = 0.8;  // 写出调用阻塞时间占窗口的比例超过该值视为链路饱和
+    int intervalMs = 1000;       // 统计窗口
+    int probeIntervals = 5;      // 连续多少个窗口无拥塞后尝试回升
+    bool reduceFrameRate = true; // 码率已到下限时降帧率
+    int maxFrameDecimation = 4;  // 最多降到 1/N 帧率
+};
+
+// 推流端自适应码率: 按窗口统计各网络输出的写出阻塞时间、积压字节和丢包,
+// 拥塞时降低编码器的 VBV 码率上限, 持续通畅后逐步回升
+// 所有输出共用一个编码器, 按最差的网络输出调整; 本地录制不参与判断
+class BitrateController
+{
+private:
+    FFmpegEncoder &encoder;
+    AdaptiveBitrateOptions options;
+    int64_t ceiling = 0;
+    int64_t rate = 0;
+    int decimation = 1;
+
+    std::chrono::steady_clock::time_point windowStart;
+    std::vector<OutputStats> lastStats;
+    int clearWindows = 0;
+    int holdWindows = 0;
+
+public:
+    BitrateController(FFmpegEncoder &enc, const AdaptiveBitrateOptions &opts);
+
+    // 编码器初始化之后调用; 编码器未开启 VBV 时返回 false
+    bool start();
+    // 每写出一个包调用一次, 窗口结束时评估并调整
+    void update(const std::vector<std::unique_ptr<FFmpegOutput>> &outputs);
+};
+
+#endif // BITRATE_CONTROLLER_H
@@ -0,0 +1,132 @@
+// channel_config.hh
+#ifndef CHANNEL_CONFIG_H
+#define CHANNEL_CONFIG_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bitrate_controller.hh"
+#include "ffmpeg_capture.hh"
+#include "ffmpeg_encoder.hh"
+#include "io_deadline.hh"
+#include "metrics_exporter.hh"
+#include "reconnect_backoff.hh"
+#include "simulcast_ladder.hh"
+
+// 单路摄像头的配置
+struct ChannelConfig
+{
+    std::string name;
+    std::string input;
+    std::vector<std::pair<std::string, std::string>> outputs; // <协议, 地址>
+    std::string mode = "auto";                                // auto/copy/transcode
+    int frameRate = 0;                                        // 0 表示取输入流的帧率
+    bool pace = false;                                        // 文件输入按时间戳节奏读取
+    int latencyBudgetMs = 0;                                  // 单路模式的延迟预算, 0 表示不限制
+    double cpuBudget = 0;   // 允许占用的CPU核数, 0 表示不限制
+    int encoderThreads = 1; // 多路模式下默认单线程编码, 由共享线程池提供并行度
+    CaptureOptions capture; // 解码选项
+    EncoderProfile encoder; // 编码档位
+    AdaptiveBitrateOptions adaptiveBitrate;
+    ReconnectOptions reconnect; // 输入和网络输出断线重连的退避策略
+    IoTimeouts io;              // 输入和网络输出的阻塞 I/O 时限
+    OutputQueueLimits outputQueue; // 每个输出写出队列的上限
+    RecordOptions record;          // record 输出的切片录制选项
+    std::vector<std::string> processors; // 解码与编码之间的处理器, 按顺序执行
+    int processThreads = 2;              // 单路模式处理链的工作线程数, 0 表示在编码线程中处理
+    size_t gopCacheBytes = 8 * 1024 * 1024; // GOP 缓存上限, 0 表示关闭
+    int keyframeMinIntervalMs = 1000;       // 强制关键帧的最小间隔
+    std::vector<RenditionConfig> renditions; // 分级输出, 编码档位由 resolveRenditions 按通道档位补全
+
+    ChannelConfig() { capture.decoderThreads = 1; }
+};
+
+// 多路进程的配置
+struct ProcessConfig
+{
+    int workers = 0; // 共享工作线程数, 0 表示CPU核数
+    MetricsOptions metrics;
+    std::string controlSocket; // 控制接口的 Unix 域套接字路径, 为空表示不开启
+    std::vector<ChannelConfig> channels;
+};
+
+// 读取配置文件, 格式:
+//   workers = 8
+//   metrics_port = 9464            # Prometheus: http://127.0.0.1:9464/metrics
+//   metrics_socket = /run/video_streamer.sock
+//   metrics_json = metrics.jsonl   # 周期性 JSON 行, "-" 为标准输出
+//   metrics_interval = 10
+//   control_socket = /run/video_streamer.ctl  # 控制接口, 如 echo "keyframe cam01" | socat - UNIX-CONNECT:...
+//   [cam01]
+//   input = rtsp://...
+//   output = rtmp rtmp://127.0.0.1:1935/live/cam01
+//   output = file /data/cam01.mkv
+//   output = record /data/record/cam01  # 按时长切片录制, 见 record_* 选项
+//   mode = auto
+//   cpu_budget = 0.5
+//   frame_rate = 0                 # 编码帧率, 0 表示取输入流的帧率
+//   pace = false                   # 文件输入按时间戳节奏读取(类似 ffmpeg -re)
+//   latency_budget_ms = 200        # 单路模式: 超出预算的旧帧丢弃, 解码落后时跳帧
+//   decoder_threads = 0            # 0 表示自动
+//   decoder_thread_type = frame    # auto/frame/slice
+//   low_delay = true
+//   skip_loop_filter = nonref      # none/default/nonref/bidir/nonkey/all
+//   decoder = h264_cuvid
+//   probe_size = 500000            # 探测流信息最多读取的字节数, 0 表示 FFmpeg 默认值
+//   analyze_duration_ms = 500      # 探测流信息最多分析的时长, 0 表示 FFmpeg 默认值
+//   param_cache_dir = /var/cache/video_streamer  # 缓存探测到的流参数, 下次打开跳过探测
+//   shm_name = /video_streamer.cam01  # 解码后的帧发布到共享内存帧环, 供本地分析进程读取(需要解码, auto 模式改为转码)
+//   shm_slots = 4                  # 帧环的槽数, 读者处理一帧的时间需短于 (槽数-1) 帧
+//   encoder = libx265,libx264,h264  # 按顺序尝试的编码器(libx264/libx265/libopenh264/libsvtav1/mpeg4 或 h264/hevc/av1)
+//   encoder_threads = 1            # 编码线程数, 0 表示自动; libx265/libsvtav1 为其线程池大小
+//   encoder_profile = ultra-low-latency  # ultra-low-latency/balanced/archival, 需写在其他编码选项之前
+//   bitrate = 2000000
+//   max_bitrate = 3000000
+//   vbv_seconds = 0.5
+//   gop_seconds = 1
+//   bframes = 0
+//   lookahead = 0
+//   crf = -1                       # 负数表示按码率编码
+//   preset = veryfast
+//   tune = zerolatency
+//   sliced_threads = true          # 片级线程(x264 sliced-threads), 不增加延迟; libx265 改为一个帧级线程
+//   intra_refresh = false
+//   adaptive_bitrate = true        # 按网络输出拥塞情况调整码率, 需要 max_bitrate
+//   min_bitrate = 300000
+//   abr_max_queue_seconds = 0.5
+//   abr_reduce_frame_rate = true
+//   reconnect_delay_ms = 500       # 断线后第一次重试前的等待, 之后每次翻倍(带随机抖动)
+//   reconnect_max_delay_ms = 30000
+//   reconnect_attempts = 0         # 连续失败多少次后放弃, 0 表示一直重试
+//   io_open_timeout_ms = 10000     # 打开输入(含探测)、连接输出(含写头)的时限, 0 表示不限时
+//   io_read_timeout_ms = 5000      # 单次读包的时限, 超时按断线处理并重连
+//   io_write_timeout_ms = 5000     # 网络输出单次写包的时限, 超时按断线处理并重连
+//   output_queue_max_bytes = 8388608  # 每个输出最多积压的字节数, 超出时按 GOP 丢弃, 0 表示不限制
+//   output_queue_max_seconds = 2   # 每个输出最多积压的时长, 0 表示不限制
+//   gop_cache_bytes = 8388608      # 缓存最近一个 GOP, 新接入或重连的输出立即起播; 0 表示关闭
+//   keyframe_min_interval_ms = 1000  # 按请求(输出重连、丢包、控制接口)强制关键帧的最小间隔
+//   process = timestamp            # 处理器, 可写多行按顺序执行: timestamp / mask x,y,w,h / blur x,y,w,h
+//   process_threads = 2            # 单路模式处理链的工作线程数; 多路模式在共享线程池的解码任务中处理
+//   record_format = fmp4           # record 输出的切片格式: fmp4/hls
+//   record_segment_seconds = 60    # 切片时长, 在达到后的下一个关键帧处切换
+//   record_retention_hours = 72    # 切片保留时长, 0 表示不删除
+//   record_buffer_kb = 1024        # 录制写缓冲
+//   rendition = 1280x720 1500000 rtmp rtmp://127.0.0.1:1935/live/cam01_720  # 分级输出: 尺寸 码率 协议 地址,
+//   rendition = 640x360 500000 rtmp rtmp://127.0.0.1:1935/live/cam01_360    # 可写多行, 需要解码(auto 模式改为转码)
+// '#' 或 ';' 开头的行为注释
+bool loadProcessConfig(const std::string &path, ProcessConfig &config);
+
+// 设置单个通道配置项(配置文件与命令行 --key=value 共用), 未知的项或无效的值返回 false
+bool applyChannelOption(ChannelConfig &ch, const std::string &key, const std::string &value);
+
+// 设置进程级配置项(配置文件中第一个 [通道] 之前的项, 或单路模式的 --key=value), 未知的项返回 false
+bool applyProcessOption(ProcessConfig &config, const std::string &key, const std::string &value);
+
+// 编码帧率: 配置优先, 其次输入流的帧率, 都没有时为 25
+int resolveFrameRate(const ChannelConfig &ch, AVRational inputRate);
+
+// 分级输出的编码档位: 沿用通道档位, 码率换成该级的码率, 最大码率按同样比例缩放
+std::vector<RenditionConfig> resolveRenditions(const ChannelConfig &ch);
+
+#endif // CHANNEL_CONFIG_H
@@ -0,0 +1,48 @@
+// control_server.hh
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// 本机控制接口: Unix 域套接字, 每行一条命令, 每条命令回复一行
+//   keyframe          所有流立即编出关键帧(受最小间隔限制)
+//   keyframe <流名>   指定的流编出关键帧
+//   streams           列出流名
+//   add_output <流名> <协议> <地址>   运行中给指定的流接入一个输出, 从 GOP 缓存的最近关键帧起播
+class ControlServer
+{
+private:
+    std::string socketPath;
+    int fd = -1;
+    std::thread serverThread;
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::map<std::string, std::function<void()>> keyframeHandlers;
+    std::map<std::string, std::function<bool(const std::string &, const std::string &)>> outputHandlers;
+
+    bool listenUnix();
+    void serveLoop();
+    void serveClient(int client);
+    std::string handle(const std::string &line);
+
+public:
+    explicit ControlServer(const std::string &path);
+    ~ControlServer();
+    ControlServer(const ControlServer &) = delete;
+    ControlServer &operator=(const ControlServer &) = delete;
+
+    // 注册一路流的关键帧请求和接入输出(参数为协议、地址, 可为空); 回调在控制线程中调用, 流停止之前需 removeStream
+    void addStream(const std::string &name, std::function<void()> requestKeyframe,
+                   std::function<bool(const std::string &, const std::string &)> attachOutput = nullptr);
+    void removeStream(const std::string &name);
+
+    bool start();
+    void stop();
+};
+
+#endif // CONTROL_SERVER_H
@@ -10,11 +10,61 @@ extern "C"
 #include <libavutil/error.h> //av_err2str
 #include <libswscale/swscale.h>
 }
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <iostream>
 
 #include <opencv2/opencv.hpp>
 
+#include "frame_pool.hh"
+#include "io_deadline.hh"
+#include "metrics.hh"
+#include "reconnect_backoff.hh"
+#include "shm_frame_publisher.hh"
+#include "stream_param_cache.hh"
+#include "video_frame.hh"
+
+// 解码线程类型
+//   Frame: 帧级并行, 吞吐随线程数提升, 但每多一个线程增加一帧解码延迟
+//   Slice: 片级并行, 不增加延迟, 但只有码流按多 slice 编码时才有效
+//   Auto : 由解码器选择(优先帧级)
+enum class DecodeThreadType
+{
+    Auto,
+    Frame,
+    Slice,
+};
+
+// 解码选项, 需在 open 之前设置
+// 延迟优先: threadType=Slice 或 decoderThreads=1, lowDelay=true
+// 吞吐优先(4K HEVC 等): threadType=Frame, decoderThreads=0(自动), 可再开启 skipLoopFilter
+struct CaptureOptions
+{
+    int decoderThreads = -1;                             // 0 表示按CPU核数自动, 负数表示使用 FFmpeg 默认值(单线程)
+    DecodeThreadType threadType = DecodeThreadType::Auto;
+    bool lowDelay = false;                               // AV_CODEC_FLAG_LOW_DELAY, 不等待重排序直接输出(会关闭帧级线程)
+    AVDiscard skipLoopFilter = AVDISCARD_DEFAULT;        // 跳过环路滤波, 以画质换速度(如 AVDISCARD_NONREF/AVDISCARD_ALL)
+    std::string decoderName;                             // 指定解码器实现(如 h264_cuvid/libdav1d), 为空使用默认解码器
+    int64_t probeSize = 0;                               // 探测流信息最多读取的字节数, 0 表示 FFmpeg 默认值(5MB)
+    int64_t analyzeDurationMs = 0;                       // 探测流信息最多分析的时长, 0 表示 FFmpeg 默认值(5s)
+    std::string paramCacheDir;                           // 流参数缓存目录, 非空时按地址保存探测结果, 下次打开跳过探测
+    std::string shmName;                                 // 非空时把解码后的帧发布到该名字的共享内存帧环, 供本地分析进程读取
+    int shmSlots = 4;                                    // 共享内存帧环的槽数
+};
+
+// 解码统计, 用于对比不同解码选项的延迟和吞吐
+struct DecodeStats
+{
+    uint64_t packets = 0;      // 送入解码器的包数
+    uint64_t frames = 0;       // 解码输出的帧数
+    double decodeSeconds = 0;  // 解码调用累计耗时
+    uint64_t maxDepth = 0;     // 解码器内部最多积压的帧数(帧级线程带来的延迟)
+    uint64_t skipped = 0;      // skip_frame 生效期间解码器丢弃的帧数(按 送入包数-输出帧数 估算)
+};
+
 class FFmpegCapture
 {
 private:
@@ -23,21 +73,86 @@ private:
     AVStream *videoStream = nullptr;
     AVFrame *frame = nullptr;
     AVPacket *packet = nullptr;
-    SwsContext *swsContext = nullptr;
     int videoStreamIndex = -1;
     std::string rtspUrl;
     bool isOpened = false;
     int width, height;
+    AVRational frameRate = {0, 1};
+    bool live = true;
+    FrameConverter rgbConverter;
+    CaptureOptions options;
+
+    std::atomic<uint64_t> statPackets{0};
+    std::atomic<uint64_t> statFrames{0};
+    std::atomic<uint64_t> statDecodeNs{0};
+    std::atomic<uint64_t> statMaxDepth{0};
+    std::atomic<uint64_t> statSkipped{0};
+    AVDiscard skipFrame = AVDISCARD_DEFAULT;
+    StreamMetrics *metrics = nullptr;
+    ReconnectBackoff backoff;
+    std::atomic<bool> reconnecting{false};
+    IoDeadline deadline;
+    IoTimeouts timeouts;
+    bool paramsFromCache = false; // 本次打开使用了缓存的流参数, 第一帧解码后核对
+    bool paramsStale = false;     // 缓存的参数与码流不符, 需重新打开
+    std::unique_ptr<ShmFramePublisher> shmPublisher;
+
+    bool decodeFrame();
+    bool openDecoder();
+    int readInputPacket(AVPacket *pkt);
+    bool applyCachedParams(const StreamParamCache &cache);
+    bool checkCachedParams(const AVFrame *decoded);
+    void countPacket(int64_t elapsedNs);
+    void countFrame(int64_t elapsedNs);
+    void publishFrame(const AVFrame *decoded);
 
 public:
-    FFmpegCapture(const std::string &url);
+    FFmpegCapture(const std::string &url, const CaptureOptions &opts = CaptureOptions());
     ~FFmpegCapture();
 
     bool open();
     bool readFrame(cv::Mat &outFrame);
+    // 读取一帧 RGB24 图像到池化缓冲区, 可用 FramePool::toMat 零拷贝访问
+    bool readFrame(AVFrame *outFrame);
+    // 读取一帧解码器原生格式(通常为 YUV420P/NV12)的帧, 不做任何转换
+    bool readNativeFrame(AVFrame *outFrame);
+    // 读取一个未解码的视频包(用于直通转封装)，调用者负责 av_packet_unref
+    bool readPacket(AVPacket *outPacket);
+    // 分开读包和解码时使用: 读包线程调用 readPacket, 解码线程调用 sendPacket/receiveFrame
+    // 输入结束时送入 nullptr, 之后 receiveFrame 取出解码器缓存的剩余帧
+    bool sendPacket(const AVPacket *inPacket);
+    // 取出一个解码器原生格式的帧, 没有可用帧时 gotFrame 为 false
+    bool receiveFrame(AVFrame *outFrame, bool &gotFrame);
     void close();
+    // 断线后按退避策略反复重新打开, 直到成功、达到最大重试次数或 cancel 置位
+    // 解码在其他线程进行时传入解码锁, 只在关闭和重新打开时持有
+    bool reconnect(const std::atomic<bool> &cancel, std::mutex *decodeLock = nullptr);
+    bool isReconnecting() const { return reconnecting; }
+    void setReconnectOptions(const ReconnectOptions &opts) { backoff.setOptions(opts); }
+    // 打开和读包的时限, 需在 open 之前设置
+    void setIoTimeouts(const IoTimeouts &t) { timeouts = t; }
+    // 中断阻塞中的读取, 之后的打开和读取都立即失败; 停止时在其他线程中调用
+    void cancelIo() { deadline.cancel(); }
+    // 解码选项, 需在 open 之前设置
+    void setOptions(const CaptureOptions &opts) { options = opts; }
+    // 各阶段计时写入的指标, 为空时不计时; 需在开始读取之前设置
+    void setMetrics(StreamMetrics *m) { metrics = m; }
+    const CaptureOptions &getOptions() const { return options; }
+    DecodeStats getDecodeStats() const;
+    // 解码器跳帧(AVDISCARD_NONREF 只解参考帧, AVDISCARD_NONKEY 只解关键帧), 过载时降低解码量
+    // 需在解码线程中调用, 从下一个包开始生效
+    void setSkipFrame(AVDiscard discard);
+    AVDiscard getSkipFrame() const { return skipFrame; }
     int getWidth() const { return width; }
     int getHeight() const { return height; }
+    const AVCodecParameters *getCodecParameters() const { return videoStream ? videoStream->codecpar : nullptr; }
+    AVPixelFormat getPixelFormat() const { return codecContext ? codecContext->pix_fmt : AV_PIX_FMT_NONE; }
+    FramePoolStats getFramePoolStats() const { return rgbConverter.stats(); }
+    AVRational getTimeBase() const { return videoStream ? videoStream->time_base : AVRational{0, 1}; }
+    // 输入流的帧率(avg_frame_rate, 其次 r_frame_rate), 未知时为 {0, 1}
+    AVRational getFrameRate() const { return frameRate; }
+    // 实时输入(网络流、设备)不可定位, 本地文件可定位; 只有文件输入需要按时间戳节奏读取
+    bool isLive() const { return live; }
 };
 
 #endif // FFMPEG_CAPTURE_H
@@ -0,0 +1,154 @@
+// ffmpeg_encoder.hh
+#ifndef FFMPEG_ENCODER_H
+#define FFMPEG_ENCODER_H
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+#include <libavutil/opt.h>
+}
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_pool.hh"
+#include "metrics.hh"
+#include "video_frame.hh"
+
+// 编码档位, 对应 libx264 的 preset/tune/B帧/lookahead/线程方式/VBV/帧内刷新等选项
+// 延迟主要来自 B 帧重排序、lookahead 和帧级线程, 三者在 ultra-low-latency 中都关闭
+struct EncoderProfile
+{
+    std::string name = "balanced";
+    std::vector<std::string> encoders; // 按顺序尝试的编码器名或编码格式名, 为空时为 libx264, h264
+    std::string preset = "medium";
+    std::string tune;            // 空表示不设置
+    int maxBFrames = 1;
+    int lookahead = -1;          // rc-lookahead 帧数, 负数表示使用编码器默认值
+    bool slicedThreads = false;  // 片级线程: 不增加延迟; 帧级线程: 吞吐更高但每个线程多延迟一帧
+    int crf = 23;                // 负数表示不使用 CRF, 按 bitRate 编码
+    int64_t bitRate = 1024000;   // 目标码率, 0 表示不设置
+    int64_t maxRate = 2048000;   // VBV 最大码率, 0 表示不限制
+    double vbvSeconds = 2.0;     // VBV 缓冲区时长(按 maxRate 计算), 0 表示一帧时长
+    double gopSeconds = 2.0;     // 关键帧间隔
+    bool intraRefresh = false;   // 周期性帧内刷新代替关键帧, 码率更平稳;
+                                 // 但输出和队列按关键帧起播/丢包, 开启后新接入的观众要等完整刷新周期
+};
+
+// 按名称取预设档位: ultra-low-latency / balanced / archival; profile 中的编码器列表保留
+bool encoderProfileByName(const std::string &name, EncoderProfile &profile);
+
+// 视频编码器: 帧进, 包出; 输出包可被多个 FFmpegOutput 以引用方式共享
+class FFmpegEncoder
+{
+private:
+    AVCodecContext *codecContext = nullptr;
+    const AVCodec *codec = nullptr;
+    AVFrame *frame = nullptr;
+    AVFrame *matFrame = nullptr;
+    FrameConverter converter;
+    bool initialized = false;
+    int64_t frameCount = 0;
+    int width, height, frameRate;
+    int threadCount = -1;
+    EncoderProfile profile;
+    bool fixedGop = false;
+
+    // 输入帧时间戳的时间基, 未设置时按帧序号和帧率生成时间戳
+    AVRational inputTimeBase = {0, 1};
+    int64_t firstPts = AV_NOPTS_VALUE;
+    int64_t lastPts = AV_NOPTS_VALUE;
+    int64_t ptsOffset = 0;
+
+    // 运行时码率调整: 其他线程提交, 编码线程在下一帧之前生效
+    std::atomic<int64_t> pendingRateLimit{0};
+    std::atomic<int64_t> rateLimit{0};
+    std::atomic<int> frameDecimation{1}; // 每 N 帧编码一帧
+    std::atomic<bool> keyframeRequested{false};
+    int keyframeMinIntervalMs = 1000;                       // 强制关键帧的最小间隔
+    std::chrono::steady_clock::time_point lastKeyframeTime; // 最近一次输出关键帧(含自然产生的)
+    std::atomic<uint64_t> framesIn{0};   // 送入编码器的帧数
+    std::atomic<uint64_t> packetsOut{0}; // 取出的包数
+    bool draining = false;               // 已送入结束标志, 需 reopen 后才能继续送帧
+    StreamMetrics *metrics = nullptr;
+    int64_t decimationCount = 0;
+
+    bool open(const AVCodec *candidate); // 失败时释放上下文, 可以换下一个编码器再试
+    void logConfig(AVDictionary *unused) const;
+    void applyRateLimit(int64_t maxRate);
+    int64_t nextPts(const AVFrame *inFrame);
+    bool keyframeAllowed() const;
+    bool sendFrame(const AVFrame *inFrame, bool mustKey, bool requested);
+
+public:
+    FFmpegEncoder(int w, int h, int fr);
+    ~FFmpegEncoder();
+
+    // 编码线程数, 需在 init 之前设置; 0 表示自动, 负数表示使用 FFmpeg 默认值
+    void setThreadCount(int threads) { threadCount = threads; }
+    // 输入帧 pts 的时间基(通常为输入流的时间基), 需在 init 之前设置
+    // 设置后编码器沿用该时间基, 源时间戳原样带到输出, 可变帧率输入不会漂移
+    void setInputTimeBase(AVRational timeBase) { inputTimeBase = timeBase; }
+    // 各阶段计时写入的指标, 为空时不计时
+    void setMetrics(StreamMetrics *m) { metrics = m; }
+    // 编码档位, 需在 init 之前设置
+    void setProfile(const EncoderProfile &p) { profile = p; }
+    const EncoderProfile &getProfile() const { return profile; }
+    // 固定 GOP: 关闭场景切换检测和帧内刷新, 关键帧只出现在 GOP 边界和请求处; 需在 init 之前设置
+    // 多路编码同一个源时, 各编码器按同样的帧请求关键帧即可对齐
+    void setFixedGop(bool on) { fixedGop = on; }
+
+    // 运行时调整码率上限(VBV 最大码率, 目标码率和缓冲区按比例调整), 可在任意线程调用
+    // libx264 在下一帧重新配置; 初始化时未开启 VBV 的编码器无法在运行时开启
+    void requestRateLimit(int64_t maxRate) { pendingRateLimit = maxRate; }
+    int64_t getRateLimit() const { return rateLimit; }
+    // 码率上限的初始值, 即自适应码率可回升到的最高值; 0 表示未开启 VBV
+    int64_t getRateCeiling() const { return profile.maxRate > 0 ? profile.maxRate : 0; }
+    // 下一个编码的帧强制为关键帧(IDR), 可在任意线程调用
+    // 距上一个关键帧不足最小间隔时推迟到间隔满后的第一帧, 期间的多次请求合并为一次
+    void requestKeyframe() { keyframeRequested = true; }
+    // 强制关键帧的最小间隔, 0 表示不限制; 需在 init 之前设置
+    void setKeyframeMinInterval(int ms) { keyframeMinIntervalMs = ms > 0 ? ms : 0; }
+    // 降帧率: 每 n 帧只编码一帧, 跳过的帧保留时间戳间隔; 1 表示不降帧
+    void setFrameDecimation(int n) { frameDecimation = n > 1 ? n : 1; }
+    int getFrameDecimation() const { return frameDecimation; }
+    bool init();
+    // 送入一帧; 编码器按 B 帧和 lookahead 缓存若干帧, 之后用 receivePacket 取出所有已完成的包
+    bool sendFrame(cv::Mat &inFrame);
+    // 送入 AVFrame: 编码器格式(YUV420P)直接送入编码器, 其他格式(RGB24/NV12 等)先转换
+    bool sendFrame(const AVFrame *inFrame);
+    // 送入一帧并编为关键帧: 不受降帧率和关键帧最小间隔影响, 用于分级输出统一安排的关键帧
+    // requested 表示该关键帧来自请求(计入强制关键帧数), 固定 GOP 的关键帧不计入
+    bool sendKeyframe(const AVFrame *inFrame, bool requested);
+    // 取出一个已完成的包, 没有可取的包时 gotPacket 为 false; 一帧可能对应零个或多个包, 需循环取到没有为止
+    bool receivePacket(AVPacket *outPacket, bool &gotPacket);
+    // 送入结束标志, 之后 receivePacket 取出编码器缓存的全部剩余包
+    bool sendFlush();
+    // 排空之后恢复为可编码状态(编码参数变化前先排空, 再调用), 时间戳接续
+    bool reopen();
+    void close();
+
+    bool isInitialized() const { return initialized; }
+    // 实际选中的编码器名, 以及线程方式: slice/frame/internal(编码器自己的线程池)/single
+    std::string getCodecName() const { return codec ? codec->name : ""; }
+    std::string threadLayout() const;
+    const AVCodecContext *getCodecContext() const { return codecContext; }
+    AVRational getTimeBase() const { return codecContext ? codecContext->time_base : AVRational{0, 1}; }
+    FramePoolStats getFramePoolStats() const { return converter.stats(); }
+    uint64_t getFramesIn() const { return framesIn; }
+    uint64_t getPacketsOut() const { return packetsOut; }
+    // 已送入但尚未输出的帧数, 即编码器内部缓存带来的延迟; 排空后应为 0
+    uint64_t getPendingFrames() const
+    {
+        uint64_t in = framesIn, out = packetsOut;
+        return in > out ? in - out : 0;
+    }
+};
+
+#endif // FFMPEG_ENCODER_H
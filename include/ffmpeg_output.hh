@@ -0,0 +1,132 @@
+// ffmpeg_output.hh
+#ifndef FFMPEG_OUTPUT_H
+#define FFMPEG_OUTPUT_H
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include "io_deadline.hh"
+#include "metrics.hh"
+#include "reconnect_backoff.hh"
+#include "ring_queue.hh"
+#include "segment_writer.hh"
+
+struct AVPacketDeleter
+{
+    void operator()(AVPacket *p) const { av_packet_free(&p); }
+};
+using PacketPtr = std::unique_ptr<AVPacket, AVPacketDeleter>;
+
+// 写出统计, 均为累计值; 码率控制按时间窗口取差值
+struct OutputStats
+{
+    uint64_t writtenPackets = 0;
+    uint64_t writtenBytes = 0;
+    uint64_t droppedPackets = 0;
+    size_t queuedPackets = 0;
+    size_t queuedBytes = 0;   // 队列中等待写出的字节数
+    double writeSeconds = 0;  // 阻塞在写出调用中的累计时间, 网络拥塞时接近墙钟时间
+};
+
+// 写出队列除包数(256)以外的上限, 任一超出即按溢出处理: 不被参考的帧只丢自身, 其他帧丢到下一个关键帧,
+// 关键帧到来时清空队列从它重新开始(整组丢弃); 0 表示不限制
+struct OutputQueueLimits
+{
+    size_t maxBytes = 8 * 1024 * 1024; // 积压的字节数
+    double maxSeconds = 2.0;           // 队首与新包的时间戳之差
+};
+
+// 单个推流/录制目标: 独立的封装上下文和写出线程
+// 包以引用方式入队, 写出失败只影响本目标, 不会阻塞编码或其他目标
+// 网络目标写出失败后在写出线程中按退避策略重连, 重连成功后重新写头并从关键帧开始
+// record 目标按时长在关键帧处切换切片文件, 写盘出错时结束当前切片, 从下一个关键帧开始新切片
+class FFmpegOutput
+{
+private:
+    AVFormatContext *formatContext = nullptr;
+    AVStream *stream = nullptr;
+    AVCodecParameters *codecParams = nullptr;
+    std::string url;
+    std::string protocol;
+    AVRational srcTimeBase = {0, 1};
+
+    RingQueue<PacketPtr> queue;
+    std::thread writerThread;
+    bool opened = false;
+    std::atomic<bool> waitKey{true};
+    std::atomic<bool> failed{false};
+    std::atomic<bool> reconnecting{false};
+    std::atomic<bool> closing{false};
+    std::atomic<bool> needPrime{true}; // 新打开或重连后, 等待用 GOP 缓存起播
+    ReconnectBackoff backoff;
+    IoDeadline deadline;
+    IoTimeouts timeouts;
+    OutputQueueLimits queueLimits;
+    RecordOptions recordOptions;
+    std::unique_ptr<SegmentWriter> segments; // 仅 record 目标
+    int64_t segmentStart = AV_NOPTS_VALUE;   // 当前切片第一个包的时间戳(输入时间基)
+    int64_t segmentEnd = AV_NOPTS_VALUE;     // 当前切片最后一个包的结束时间
+    std::atomic<uint64_t> writtenPackets{0};
+    std::atomic<uint64_t> writtenBytes{0};
+    std::atomic<int64_t> writeNs{0};
+    StreamMetrics *metrics = nullptr;
+
+    void writeLoop();
+    bool openContext();
+    void closeContext(bool writeTrailer);
+    bool reconnect();
+    bool rotateSegment(const AVPacket *pkt);
+
+public:
+    FFmpegOutput(const std::string &outUrl, const std::string &prot, size_t queueSize = 256);
+    ~FFmpegOutput();
+
+    // 按给定的编码参数创建输出流并写入头信息; timeBase 为之后送入的包的时间基
+    bool open(const AVCodecParameters *codecpar, AVRational timeBase);
+    // 以引用方式把包放入写出队列, 不阻塞; 目标未打开或已失败时返回 false
+    bool send(const AVPacket *pkt);
+    // 新打开或重连后尚未起播, 分发线程应先调用 prime
+    bool needsPrime() const { return needPrime; }
+    // 在分发线程中, 发送下一个包之前调用: 以引用方式写入从关键帧开始的缓存内容, 之后的包接着写
+    // packets 为空时(无缓存或下一个包本身是关键帧)只清除标记, 照常等待关键帧
+    void prime(const std::vector<PacketPtr> &packets);
+    // 写出计时和字节数写入的指标, 需在 open 之前设置
+    void setMetrics(StreamMetrics *m) { metrics = m; }
+    // 重连策略, 需在 open 之前设置
+    void setReconnectOptions(const ReconnectOptions &opts) { backoff.setOptions(opts); }
+    // 写出队列的字节和时长上限, 需在 open 之前设置
+    void setQueueLimits(const OutputQueueLimits &limits) { queueLimits = limits; }
+    // 连接、写头和写包的时限, 需在 open 之前设置; 本地文件不限时
+    void setIoTimeouts(const IoTimeouts &t) { timeouts = t; }
+    // 切片录制选项, 仅对 record 目标有效, 需在 open 之前设置
+    void setRecordOptions(const RecordOptions &opts) { recordOptions = opts; }
+    // 写完队列中剩余的包和文件尾, 释放资源; 每次写出仍受时限约束, 卡死的对端不会拖住关闭
+    void close();
+
+    bool isOpened() const { return opened; }
+    bool isFailed() const { return failed; }
+    bool isReconnecting() const { return reconnecting; }
+    const std::string &getUrl() const { return url; }
+    const std::string &getProtocol() const { return protocol; }
+    // 本地输出(文件、录制、null): 不经过网络, 不参与拥塞判断和重连
+    bool isLocal() const { return protocol == "file" || protocol == "record" || protocol == "null"; }
+    uint64_t getWrittenPackets() const { return writtenPackets; }
+    uint64_t getDroppedPackets() const { return queue.dropped(); }
+    OutputStats getStats() const;
+
+    // 协议对应的封装格式名, "file" 返回 nullptr 表示按文件扩展名推断, "null" 丢弃所有包
+    // "record" 返回 mp4(hls 切片的 mpegts 支持的编码与之相同), 用于判断能否直通
+    static const char *formatNameFor(const std::string &prot);
+};
+
+#endif // FFMPEG_OUTPUT_H
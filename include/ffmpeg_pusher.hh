@@ -10,34 +10,202 @@ extern "C"
 #include <libavutil/imgutils.h>
 #include <libswscale/swscale.h>
 }
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <iostream>
 
 #include <opencv2/opencv.hpp>
 
+#include "bitrate_controller.hh"
+#include "ffmpeg_encoder.hh"
+#include "ffmpeg_output.hh"
+#include "frame_pool.hh"
+#include "gop_cache.hh"
+#include "reconnect_backoff.hh"
+#include "simulcast_ladder.hh"
+
+// 推流器: 一个编码器(直通模式下没有), 编码结果以引用方式分发给任意多个输出
 class FFmpegPusher
 {
 private:
-    AVFormatContext *formatContext = nullptr;
-    AVCodecContext *codecContext = nullptr;
-    AVStream *stream = nullptr;
-    const AVCodec *codec;
-    AVFrame *frame = nullptr;
+    FFmpegEncoder encoder;
+    std::vector<std::unique_ptr<FFmpegOutput>> outputs; // 只在分发线程中增加, 其他线程读取时持有 outputsMutex
+    // 运行中接入的输出: 在调用线程中打开, 由分发线程在下一个包之前并入 outputs, 并从 GOP 缓存起播
+    mutable std::mutex outputsMutex;
+    std::vector<std::unique_ptr<FFmpegOutput>> attachedOutputs;
+    bool acceptingOutputs = false;
+    AVCodecParameters *outputParams = nullptr; // 输出流的编码参数和时间基, 运行中接入的输出沿用
+    AVRational outputTimeBase = {0, 1};
     AVPacket *packet = nullptr;
-    SwsContext *swsContext = nullptr;
-    std::string rtmpUrl;
     bool initialized = false;
-    int64_t frameCount = 0;
     int width, height, frameRate;
-    std::string protocol;
+
+    AdaptiveBitrateOptions bitrateOptions;
+    std::unique_ptr<BitrateController> bitrateController;
+    StreamMetrics *metrics = nullptr;
+    ReconnectOptions reconnectOptions;
+    IoTimeouts ioTimeouts;
+    OutputQueueLimits queueLimits;
+    RecordOptions recordOptions;
+    GopCache gopCache;
+    size_t gopCacheBytes = 8 * 1024 * 1024;
+    int encoderThreads = -1;
+    int keyframeMinIntervalMs = 1000;
+
+    // 分级输出: 源尺寸由本推流器编码, 更小的各级由分级中的推流器编码
+    std::unique_ptr<SimulcastLadder> ladder;
+    std::function<void()> keyframeHandler; // 设置后关键帧请求交给它(本推流器是分级中的一级)
+    bool forceNextKeyframe = false;        // 编码器重新打开后下一帧为关键帧, 各级同时
+
+    // 直通(转封装)模式: 不解码不编码, 直接转发输入流的包
+    bool passthrough = false;
+    AVRational srcTimeBase = {0, 1};
+    int64_t startTs = AV_NOPTS_VALUE;
+    int64_t lastDts = AV_NOPTS_VALUE; // 已转发的最后一个 dts(输入时间基, 以 startTs 为零点)
+    int64_t tsOffset = 0;             // 输入时间戳回退或跳变后的接续偏移
+    int64_t lastInputTs = AV_NOPTS_VALUE; // 已转发的最后一个包的原始 dts(输入时间基)
+    bool waitKeyframe = false;        // 输入恢复后从关键帧开始转发
+
+    // 输入断线期间的补帧, 保持下游会话: 转码重复最后一帧, 直通每秒重复最后一个关键帧
+    // 补帧线程只生成帧或包, 交给调用者送入正常的编码/写出路径, 与真实的包同一顺序写出
+    std::mutex streamMutex; // 保护编码器和直通时间戳, 补帧线程与正常路径共用
+    AVRational inputTimeBase = {0, 1};
+    AVFrame *lastFrame = nullptr;
+    AVPacket *lastKeyPacket = nullptr; // 输入时间基, 未经偏移
+    std::thread fillerThread;
+    std::mutex fillerMutex;
+    std::condition_variable fillerCv;
+    bool fillerStop = false;
+    int64_t fillerTs = AV_NOPTS_VALUE; // 下一个补帧的时间戳(输入时间基)
+    std::function<void(FramePtr)> fillerFrameSink;
+    std::function<void(PacketPtr)> fillerPacketSink;
+
+    bool openOutputs(const AVCodecParameters *codecpar, AVRational timeBase);
+    bool dispatch(const AVPacket *pkt);
+    bool receivePackets(std::vector<PacketPtr> &packets); // 调用者持有 streamMutex
+    bool sendFrame(const AVFrame *frame, bool keyframe, std::vector<PacketPtr> &packets); // 调用者持有 streamMutex
+    std::unique_ptr<FFmpegPusher> createRenditionPusher(const RenditionConfig &rendition);
+    bool drainEncoder(bool reopen);
+    void reportFirstOutput(); // 打开输入后第一帧写出时记录启动耗时
+    void fillerLoop();
+    bool makeFiller();
 
 public:
     FFmpegPusher(const std::string &url, int w, int h, int fr, const std::string &prot = "rtmp");
     ~FFmpegPusher();
 
+    // 增加一个输出目标, 需在 init/initPassthrough 之前调用
+    void addOutput(const std::string &url, const std::string &prot);
+    // 运行中接入一个输出目标, 可在任意线程调用: 在调用线程中连接并写头, 之后从 GOP 缓存的最近关键帧起播
+    // 未初始化、已关闭或打开失败时返回 false
+    bool attachOutput(const std::string &url, const std::string &prot);
+    // 编码线程数, 需在 init 之前调用
+    void setEncoderThreads(int threads)
+    {
+        encoderThreads = threads;
+        encoder.setThreadCount(threads);
+    }
+    // 输入帧 pts 的时间基, 需在 init 之前调用; 设置后源时间戳经换算带到输出
+    void setInputTimeBase(AVRational timeBase)
+    {
+        inputTimeBase = timeBase;
+        encoder.setInputTimeBase(timeBase);
+    }
+    // 编码档位, 需在 init 之前调用; 所有输出共用一个编码器, 因此档位按推流器(通道)选择
+    void setEncoderProfile(const EncoderProfile &profile) { encoder.setProfile(profile); }
+    // 按网络输出的拥塞情况自动调整编码码率, 需在 init 之前调用
+    void setAdaptiveBitrate(const AdaptiveBitrateOptions &options) { bitrateOptions = options; }
+    // 网络输出断线后的重连策略, 需在 init 之前调用
+    void setReconnectOptions(const ReconnectOptions &options);
+    // 各输出的连接和写出时限, 需在 init 之前设置
+    void setIoTimeouts(const IoTimeouts &timeouts);
+    // 各输出写出队列的字节和时长上限, 需在 init 之前设置
+    void setOutputQueueLimits(const OutputQueueLimits &limits);
+    // record 输出的切片时长、保留期和格式, 需在 init 之前设置
+    void setRecordOptions(const RecordOptions &options);
+    // GOP 缓存的字节上限, 0 表示关闭; 新接入或重连的输出从缓存的最近关键帧起播
+    void setGopCacheBytes(size_t maxBytes)
+    {
+        gopCacheBytes = maxBytes;
+        gopCache.setMaxBytes(maxBytes);
+    }
+    GopCacheStats getGopCacheStats() const { return gopCache.stats(); }
+
+    // 增加一级分级输出(更小的尺寸, 各自的码率和输出), 需在 init 之前调用; 直通模式下忽略
+    // 各级的输出选项与本推流器相同, 编码线程数按每级设置
+    void addRendition(const RenditionConfig &rendition);
+    size_t getRenditionCount() const { return ladder ? ladder->size() : 0; }
+
     bool init();
+    // 以直通模式初始化: 输出流参数直接复制自输入流
+    bool initPassthrough(const AVCodecParameters *codecpar, AVRational timeBase);
     bool pushFrame(cv::Mat &inFrame);
+    // 编码与写出分离, 供多线程流水线在不同线程中调用
+    // 送入一帧并取出编码器此时已完成的所有包, 追加到 packets; 有 B 帧和 lookahead 时一帧可能对应零个或多个包
+    bool encodeFrame(cv::Mat &inFrame, std::vector<PacketPtr> &packets);
+    // 编码 AVFrame: 编码器格式(YUV420P)直接送入编码器, 其他格式(RGB24/NV12 等)先转换
+    bool encodeFrame(const AVFrame *inFrame, std::vector<PacketPtr> &packets);
+    // 同上, keyframe 为 true 时该帧编为关键帧, 不受最小间隔限制(分级输出按帧对齐关键帧)
+    bool encodeFrame(const AVFrame *inFrame, bool keyframe, std::vector<PacketPtr> &packets);
+    // 把一个编码后的包(编码器时间基)分发给所有输出, 之后 inPacket 被清空
+    bool writePacket(AVPacket *inPacket);
+    // 按顺序分发一批编码后的包, 之后 packets 被清空
+    bool writePackets(std::vector<PacketPtr> &packets);
+    // 排空编码器: 取出并写出缓存中剩余的包, 再恢复为可编码状态; 编码参数变化前调用, close 时自动排空
+    bool flushEncoder();
+    // 输入结束时调用: 取出编码器缓存的全部剩余包交给调用者(不写出), 之后不能再送入帧
+    bool finishEncoding(std::vector<PacketPtr> &packets);
+    // 已送入编码器但尚未输出的帧数, 排空后为 0
+    uint64_t getEncoderPending() const { return encoder.getPendingFrames(); }
+    // 直通模式下推送一个输入包, 时间戳从输入时间基转换到输出时间基
+    bool pushPacket(const AVPacket *inPacket);
     void close();
+    // 输入断线重连期间调用 startFiller, 补帧线程按帧率生成补帧交给回调: 转码模式为重复的最后一帧(交给 frameSink,
+    // 调用者像普通帧一样送入 encodeFrame), 直通模式为重复的最后一个关键帧(交给 packetSink, 调用者送入 pushPacket)
+    // 补帧与真实的帧走同一个队列和线程, 写出顺序和时间戳不会交错; 回调在补帧线程中调用
+    // 输入恢复后调用 stopFiller, 转码模式下一帧编为关键帧, 直通模式从输入的下一个关键帧开始转发
+    void startFiller(std::function<void(FramePtr)> frameSink, std::function<void(PacketPtr)> packetSink);
+    void stopFiller();
+    // 下一个编码的帧强制为关键帧(IDR), 可在任意线程调用; 直通模式下无效
+    // 距上一个关键帧不足最小间隔时推迟, 期间的多次请求合并为一次
+    // 有分级输出时所有级别在同一帧编为关键帧
+    void requestKeyframe();
+    // 强制关键帧的最小间隔, 0 表示不限制; 需在 init 之前调用
+    void setKeyframeMinInterval(int ms)
+    {
+        keyframeMinIntervalMs = ms;
+        encoder.setKeyframeMinInterval(ms);
+    }
+    // 关键帧请求改为调用 handler, 需在 init 之前调用; 分级输出的各级由分级统一安排关键帧
+    void setKeyframeHandler(std::function<void()> handler) { keyframeHandler = std::move(handler); }
+    // 所有输出队列累计丢弃的包数
+    uint64_t getDroppedPackets() const;
+    // 所有输出的统计之和
+    OutputStats getOutputStats() const;
+    // 编码器当前的码率上限(自适应码率调整后的值)
+    int64_t getRateLimit() const { return encoder.getRateLimit(); }
+    // 编码和写出的计时写入的指标, 需在 init 之前调用
+    void setMetrics(StreamMetrics *m);
+    FramePoolStats getFramePoolStats() const { return encoder.getFramePoolStats(); }
+    size_t getOutputCount() const
+    {
+        std::lock_guard<std::mutex> lock(outputsMutex);
+        return outputs.size();
+    }
+    // 实际选中的编码器名, 直通模式下为空
+    std::string getEncoderName() const { return encoder.getCodecName(); }
+
+    // 判断输入编码能否不经转码直接封装进目标协议(file 协议按 url 扩展名判断)
+    static bool supportsPassthrough(AVCodecID codecId, const std::string &prot, const std::string &url = "");
+    // 按处理模式(auto/copy/transcode)决定是否使用直通模式, auto 要求所有输出都支持
+    static bool selectPassthrough(const std::string &mode, AVCodecID codecId,
+                                  const std::vector<std::pair<std::string, std::string>> &outputs);
 };
 
 #endif // FFMPEG_PUSHER_H
@@ -0,0 +1,70 @@
+// frame_pool.hh
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+extern "C"
+{
+#include <libavutil/buffer.h>
+#include <libavutil/frame.h>
+#include <libavutil/imgutils.h>
+}
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <opencv2/opencv.hpp>
+
+struct AVFrameDeleter
+{
+    void operator()(AVFrame *f) const { av_frame_free(&f); }
+};
+using FramePtr = std::unique_ptr<AVFrame, AVFrameDeleter>;
+
+struct FramePoolStats
+{
+    uint64_t acquires = 0;    // 获取次数
+    uint64_t allocations = 0; // 真正分配内存的次数
+    uint64_t reuses = 0;      // 复用池中缓冲区的次数
+    uint64_t outstanding = 0; // 当前借出的缓冲区数
+    uint64_t highWater = 0;   // 借出数量的峰值
+};
+
+// 引用计数的帧缓冲池(基于 AVBufferPool), 缓冲区 32 字节对齐
+// 池中帧可通过 toMat 零拷贝地作为 cv::Mat 使用, 也可直接交给编码器
+class FramePool
+{
+private:
+    struct Counters
+    {
+        std::atomic<uint64_t> acquires{0};
+        std::atomic<uint64_t> allocations{0};
+        std::atomic<uint64_t> outstanding{0};
+        std::atomic<uint64_t> highWater{0};
+    };
+
+    AVBufferPool *pool = nullptr;
+    int poolSize = 0;
+    std::mutex mutex;
+    std::shared_ptr<Counters> counters;
+
+    static AVBufferRef *allocBuffer(void *opaque, size_t size);
+    static void releaseBuffer(void *opaque, uint8_t *data);
+
+public:
+    FramePool();
+    ~FramePool();
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+    // 为 frame 分配 format/width/height 的池化缓冲区, frame 原有引用会被释放
+    bool acquire(AVFrame *frame, AVPixelFormat format, int width, int height);
+    FramePoolStats stats() const;
+
+    // 将帧包装成 cv::Mat 视图, 不拷贝数据; 支持 RGB24/BGR24/GRAY8,
+    // 以及平面连续存放的 I420/NV12(高度为 1.5 倍的单通道 Mat), 不支持时返回空 Mat
+    // 视图仅在 frame 持有缓冲区引用期间有效
+    static cv::Mat toMat(const AVFrame *frame);
+};
+
+#endif // FRAME_POOL_H
@@ -0,0 +1,145 @@
+// frame_processor.hh
+#ifndef FRAME_PROCESSOR_H
+#define FRAME_PROCESSOR_H
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/rational.h>
+}
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "metrics.hh"
+#include "video_frame.hh"
+
+// 处理器对输入帧的要求, 未指定的项沿用上游
+struct ProcessorRequirements
+{
+    AVPixelFormat format = AV_PIX_FMT_NONE;
+    int width = 0;
+    int height = 0;
+};
+
+// 交给处理器的一帧
+struct ProcessorFrame
+{
+    AVFrame *frame = nullptr; // 已按处理链的要求转换, 可原地修改
+    cv::Mat image;            // frame 的零拷贝视图, 打包格式(BGR24/RGB24/GRAY8 等)时有效
+    uint64_t index = 0;       // 进入处理链的序号
+    int64_t pts = AV_NOPTS_VALUE;
+    AVRational timeBase = {0, 1};
+};
+
+// 帧处理器: 叠加、遮挡、模糊等; 多个工作线程会并行调用同一个处理器的 process, 实现需可重入
+class FrameProcessor
+{
+public:
+    virtual ~FrameProcessor() = default;
+    virtual std::string name() const = 0;
+    virtual ProcessorRequirements requirements() const { return ProcessorRequirements(); }
+    // 处理一帧, 返回 false 表示丢弃该帧
+    virtual bool process(ProcessorFrame &frame) = 0;
+};
+
+// 按配置创建内置处理器, 格式为 "<名字> [参数]":
+//   timestamp               左上角叠加当前时间
+//   mask x,y,w,h            区域填充为黑色
+//   blur x,y,w,h            区域高斯模糊
+// 未知的名字或参数无效时返回空
+std::unique_ptr<FrameProcessor> createFrameProcessor(const std::string &spec);
+
+// 单个处理器的统计
+struct ProcessorStats
+{
+    std::string name;
+    uint64_t frames = 0;  // 处理的帧数
+    uint64_t dropped = 0; // 处理器丢弃的帧数
+    double seconds = 0;   // 累计耗时
+};
+
+// 处理链: 处理器按顺序执行, 格式转换和缩放在进入处理链时最多做一次
+// threads > 0 时各帧在工作线程中并行处理, 按进入顺序输出; threads == 0 时在调用者线程中处理
+class ProcessingChain
+{
+private:
+    struct Counters
+    {
+        std::atomic<uint64_t> frames{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<int64_t> ns{0};
+    };
+
+    std::vector<std::unique_ptr<FrameProcessor>> processors;
+    std::vector<std::unique_ptr<Counters>> counters;
+    int threadCount;
+    AVPixelFormat workFormat = AV_PIX_FMT_NONE;
+    int workWidth = 0;
+    int workHeight = 0;
+    AVRational timeBase = {0, 1};
+    StreamMetrics *metrics = nullptr;
+    FrameConverter inlineConverter;
+
+    // 并行处理: 在途帧数有上限, 结果按序号重新排列
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable inputCv;
+    std::condition_variable outputCv;
+    std::condition_variable spaceCv;
+    std::deque<std::pair<uint64_t, VideoFrame>> input;
+    std::map<uint64_t, VideoFrame> done; // 丢弃的帧以空帧占位
+    uint64_t nextIn = 0;
+    uint64_t nextOut = 0;
+    size_t maxInFlight = 0;
+    bool closed = false;
+
+    bool apply(VideoFrame &frame, uint64_t index, FrameConverter &converter);
+    void workerLoop();
+
+public:
+    explicit ProcessingChain(int threads = 0);
+    ~ProcessingChain();
+    ProcessingChain(const ProcessingChain &) = delete;
+    ProcessingChain &operator=(const ProcessingChain &) = delete;
+
+    // 追加处理器, 需在 plan 之前调用
+    void add(std::unique_ptr<FrameProcessor> processor);
+    // 按配置追加内置处理器, 格式同 createFrameProcessor; 无效时返回 false
+    bool add(const std::string &spec);
+    bool empty() const { return processors.empty(); }
+    // 有工作线程时用 submit/next, 否则用 processInline
+    bool parallel() const { return threadCount > 0; }
+    // 按输入格式和各处理器的要求确定处理格式和尺寸; 要求的格式互相冲突时返回 false
+    // 要求的尺寸不同时取最小的, 只缩放一次
+    bool plan(AVPixelFormat srcFormat, int srcWidth, int srcHeight, AVRational srcTimeBase);
+    // 处理后的尺寸, 编码器按此尺寸创建
+    int outputWidth() const { return workWidth; }
+    int outputHeight() const { return workHeight; }
+    // 处理耗时写入指标, 并按处理器导出平均耗时; 需在 add 之后、start 之前调用
+    void setMetrics(StreamMetrics *m);
+
+    // 启动工作线程(threads > 0 时)
+    void start();
+    // 送入一帧; 在途帧数达到上限时等待, 关闭后返回 false
+    bool submit(VideoFrame frame);
+    // 按送入顺序取出下一帧, 处理器丢弃的帧跳过; 关闭且全部取完后返回 false
+    bool next(VideoFrame &frame);
+    // 不会再送入新帧, 已送入的帧处理完后 next 返回 false
+    void close();
+    // 在调用者线程中处理一帧(threads == 0 时使用), 返回 false 表示帧被丢弃
+    bool processInline(VideoFrame &frame);
+
+    std::vector<ProcessorStats> stats() const;
+};
+
+#endif // FRAME_PROCESSOR_H
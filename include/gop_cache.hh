@@ -0,0 +1,52 @@
+// gop_cache.hh
+#ifndef GOP_CACHE_H
+#define GOP_CACHE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "ffmpeg_output.hh"
+
+// GOP 缓存统计
+struct GopCacheStats
+{
+    size_t packets = 0;  // 当前缓存的包数
+    size_t bytes = 0;    // 当前缓存的字节数
+    uint64_t hits = 0;   // 新接入或重连的输出从缓存起播的次数
+    uint64_t misses = 0; // 缓存为空(或超出上限被清空)只能等待关键帧的次数
+
+    double hitRatio() const { return hits + misses ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+};
+
+// 缓存最近一个关键帧起的所有编码包(只持有引用, 不拷贝数据)
+// 新接入或重连的输出先写入缓存的内容, 立即从关键帧起播, 不必等到下一个 GOP
+class GopCache
+{
+private:
+    std::vector<PacketPtr> packets;
+    size_t bytes = 0;
+    size_t maxBytes;
+    bool overflowed = false; // 本 GOP 超出上限, 等下一个关键帧重新开始
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    mutable std::mutex mutex;
+
+public:
+    // maxBytes 为每路缓存的字节上限, 0 表示关闭缓存
+    explicit GopCache(size_t maxBytes = 8 * 1024 * 1024) : maxBytes(maxBytes) {}
+
+    void setMaxBytes(size_t limit);
+    bool enabled() const { return maxBytes > 0; }
+
+    // 记录一个已分发的包; 关键帧清空旧内容重新开始
+    void add(const AVPacket *pkt);
+    // 取出缓存内容的引用(从关键帧开始), 缓存为空时返回 false; 同时计入命中率
+    bool snapshot(std::vector<PacketPtr> &out);
+    void clear();
+    GopCacheStats stats() const;
+};
+
+#endif // GOP_CACHE_H
@@ -0,0 +1,26 @@
+// input_pacer.hh
+#ifndef INPUT_PACER_H
+#define INPUT_PACER_H
+
+extern "C"
+{
+#include <libavutil/avutil.h>
+}
+#include <chrono>
+#include <cstdint>
+
+// 按源时间戳的节奏读取文件输入(类似 ffmpeg -re), 实时输入本身就按节奏到达, 不应使用
+class InputPacer
+{
+private:
+    AVRational timeBase = {0, 1};
+    int64_t startTs = AV_NOPTS_VALUE;
+    std::chrono::steady_clock::time_point startTime;
+
+public:
+    void reset(AVRational tb);
+    // 等到时间戳 ts 对应的墙钟时间; 时间戳回退或大幅跳变(如循环播放、重连)时重新对齐
+    void wait(int64_t ts);
+};
+
+#endif // INPUT_PACER_H
@@ -0,0 +1,64 @@
+// io_deadline.hh
+#ifndef IO_DEADLINE_H
+#define IO_DEADLINE_H
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+#include <atomic>
+#include <cstdint>
+
+// 各类阻塞 I/O 的时限, 单位毫秒, 0 表示不限时
+struct IoTimeouts
+{
+    int openMs = 10000; // 打开输入(含探测)或输出(含连接和写头)
+    int readMs = 5000;  // 单次读包, 超过即认为输入卡死
+    int writeMs = 5000; // 单次写包, 超过即认为对端卡死
+};
+
+// 基于 AVIOInterruptCB 的 I/O 截止时间
+// FFmpeg 在阻塞的网络 I/O 中反复调用回调, 超时、取消或进程退出时返回 1, 阻塞的调用以 AVERROR_EXIT 返回
+class IoDeadline
+{
+private:
+    std::atomic<int64_t> deadlineNs{0}; // steady_clock, 0 表示不限时
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> expired{false};
+    static std::atomic<bool> shutdownFlag;
+
+    static int interrupt(void *opaque);
+
+public:
+    // 填入 AVFormatContext::interrupt_callback 或 avio_open2 的回调
+    AVIOInterruptCB callback() { return AVIOInterruptCB{&IoDeadline::interrupt, this}; }
+
+    // 开始一次限时操作, timeoutMs <= 0 表示不限时
+    void arm(int timeoutMs);
+    void disarm() { deadlineNs = 0; }
+    // 上一次操作是否因超时而中断
+    bool timedOut() const { return expired; }
+
+    // 中断当前阻塞的 I/O, 之后本对象的 I/O 都立即失败; 可在任意线程中调用
+    void cancel() { cancelled = true; }
+    bool isCancelled() const { return cancelled; }
+
+    // 中断所有对象的 I/O, 只写一个无锁原子量, 可在信号处理函数中调用
+    static void shutdown() { shutdownFlag = true; }
+    static bool isShutdown() { return shutdownFlag; }
+};
+
+// 作用域内的 I/O 限时
+class IoDeadlineScope
+{
+public:
+    IoDeadlineScope(IoDeadline &d, int timeoutMs) : deadline(d) { deadline.arm(timeoutMs); }
+    ~IoDeadlineScope() { deadline.disarm(); }
+    IoDeadlineScope(const IoDeadlineScope &) = delete;
+    IoDeadlineScope &operator=(const IoDeadlineScope &) = delete;
+
+private:
+    IoDeadline &deadline;
+};
+
+#endif // IO_DEADLINE_H
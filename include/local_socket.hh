@@ -0,0 +1,17 @@
+// local_socket.hh
+#ifndef LOCAL_SOCKET_H
+#define LOCAL_SOCKET_H
+
+#include <string>
+
+// 控制接口和指标导出共用的本地套接字操作
+namespace LocalSocket
+{
+    // 在 path 上创建并监听 Unix 域套接字, 先清理上次异常退出留下的套接字文件
+    // 失败时打印 "<label>套接字..." 并返回 -1
+    int listenUnix(const std::string &path, const std::string &label);
+    // 写出全部数据, 对端关闭或出错时放弃; 不产生 SIGPIPE
+    void writeAll(int fd, const std::string &data);
+}
+
+#endif // LOCAL_SOCKET_H
@@ -0,0 +1,156 @@
+// metrics.hh
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// 流水线中计时的阶段
+enum class Stage
+{
+    Read,           // av_read_frame
+    DecodeSend,     // avcodec_send_packet
+    DecodeReceive,  // avcodec_receive_frame
+    CaptureScale,   // 拉流端 sws_scale
+    ShmPublish,     // 解码帧拷贝到共享内存帧环
+    Process,        // 处理链(含进入处理链时的转换)
+    PushScale,      // 推流端 sws_scale
+    RenditionScale, // 分级输出逐级缩小
+    EncodeSend,     // avcodec_send_frame
+    EncodeReceive,  // avcodec_receive_packet
+    Write,          // av_interleaved_write_frame
+    Count,
+};
+
+const char *stageName(Stage stage);
+
+// 无锁耗时直方图: 记录只做几次原子加法, 可常开
+class LatencyHistogram
+{
+public:
+    static const size_t BucketCount = 14;
+    static const double Bounds[BucketCount]; // 各桶上界(秒), 最后还有一个 +Inf 桶
+
+    void record(int64_t ns);
+
+    struct Snapshot
+    {
+        std::array<uint64_t, BucketCount + 1> buckets{}; // 非累计
+        uint64_t count = 0;
+        double sumSeconds = 0;
+    };
+    Snapshot snapshot() const;
+
+private:
+    std::array<std::atomic<uint64_t>, BucketCount + 1> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sumNs{0};
+};
+
+// 一路流的指标; 计时和计数由各模块直接写入, 队列深度等状态在导出时通过回调读取
+class StreamMetrics
+{
+public:
+    explicit StreamMetrics(const std::string &streamName) : name(streamName) {}
+
+    const std::string name;
+    std::array<LatencyHistogram, static_cast<size_t>(Stage::Count)> stages;
+    std::atomic<uint64_t> framesDecoded{0};
+    std::atomic<uint64_t> framesOut{0}; // 转码为编码输出的帧数, 直通为转发的包数
+    std::atomic<uint64_t> bytesWritten{0};
+    std::atomic<uint64_t> reconnects{0};       // 输入重连次数
+    std::atomic<uint64_t> outputReconnects{0}; // 输出重连次数
+    std::atomic<uint64_t> forcedKeyframes{0};  // 按请求强制编出的关键帧数
+    std::atomic<int64_t> timeToFirstFrameNs{-1}; // 最近一次打开输入到第一帧写出的耗时, -1 表示尚未写出
+
+    void record(Stage stage, int64_t ns) { stages[static_cast<size_t>(stage)].record(ns); }
+
+    // 打开输入(含重连)时调用, 开始计时到第一帧写出
+    void beginStartup();
+    // 每次写出真实帧时调用, 开始计时后的第一次返回耗时(秒), 其余返回负数
+    double markFirstOutput();
+
+    // 注册导出时读取的数值(队列深度、丢弃数、码率等), 回调在导出线程中调用
+    void addGauge(const std::string &metric, std::function<double()> read);
+    std::vector<std::pair<std::string, double>> readGauges() const;
+    // 注销所有回调, 回调引用的对象销毁之前调用
+    void clearGauges();
+
+private:
+    mutable std::mutex gaugeMutex;
+    std::vector<std::pair<std::string, std::function<double()>>> gauges;
+    std::atomic<int64_t> startupBeginNs{0};
+    std::atomic<bool> awaitingFirstOutput{false};
+};
+
+// 作用域计时, 离开作用域时记录到指定阶段; metrics 为空时不计时
+class StageTimer
+{
+public:
+    StageTimer(StreamMetrics *m, Stage s)
+        : metrics(m), stage(s), start(m ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+    {
+    }
+    ~StageTimer()
+    {
+        if (metrics)
+            metrics->record(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count());
+    }
+    StageTimer(const StageTimer &) = delete;
+    StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+    StreamMetrics *metrics;
+    Stage stage;
+    std::chrono::steady_clock::time_point start;
+};
+
+// 进程内所有流的指标
+class MetricsRegistry
+{
+public:
+    std::shared_ptr<StreamMetrics> add(const std::string &name);
+    void remove(const std::string &name);
+
+    // Prometheus 文本格式
+    std::string renderPrometheus();
+    // 一行 JSON
+    std::string renderJson();
+
+private:
+    struct StageSample
+    {
+        std::array<double, static_cast<size_t>(Stage::Count)> busySeconds{};
+        uint64_t framesOut = 0;
+        uint64_t bytesWritten = 0;
+        std::chrono::steady_clock::time_point time;
+    };
+
+    // 相对上次导出的速率; 两种导出格式各自保存上次的样本, 互不影响
+    struct Rates
+    {
+        double fps = 0;
+        double bitrate = 0;
+        std::array<double, static_cast<size_t>(Stage::Count)> busy{}; // 各阶段的忙碌比例
+        Stage limiting = Stage::Count;                                // 限制吞吐的阶段
+    };
+    Rates computeRates(const StreamMetrics &m, std::map<std::string, StageSample> &samples);
+
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<StreamMetrics>> streams;
+    std::map<std::string, StageSample> promSamples;
+    std::map<std::string, StageSample> jsonSamples;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,53 @@
+// metrics_exporter.hh
+#ifndef METRICS_EXPORTER_H
+#define METRICS_EXPORTER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "metrics.hh"
+
+struct MetricsOptions
+{
+    int httpPort = 0;             // 在 127.0.0.1 上提供 GET /metrics (Prometheus 文本格式), 0 表示不开启
+    std::string unixSocket;       // Unix 域套接字路径, 连接后返回 Prometheus 文本并关闭
+    std::string jsonPath;         // 周期性追加 JSON 行的文件, "-" 表示标准输出
+    int jsonIntervalSeconds = 10;
+
+    bool enabled() const { return httpPort > 0 || !unixSocket.empty() || !jsonPath.empty(); }
+};
+
+// 指标导出: 只在导出线程中读取指标, 不影响流水线线程
+class MetricsExporter
+{
+private:
+    MetricsRegistry &registry;
+    MetricsOptions options;
+    int httpFd = -1;
+    int unixFd = -1;
+    std::thread serverThread;
+    std::thread jsonThread;
+    std::atomic<bool> stopping{false};
+    std::mutex mutex;
+    std::condition_variable wakeup;
+
+    bool listenHttp();
+    bool listenUnix();
+    void serveLoop();
+    void serveHttp(int client);
+    void jsonLoop();
+
+public:
+    MetricsExporter(MetricsRegistry &reg, const MetricsOptions &opts);
+    ~MetricsExporter();
+    MetricsExporter(const MetricsExporter &) = delete;
+    MetricsExporter &operator=(const MetricsExporter &) = delete;
+
+    bool start();
+    void stop();
+};
+
+#endif // METRICS_EXPORTER_H
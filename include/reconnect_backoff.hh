@@ -0,0 +1,42 @@
+// reconnect_backoff.hh
+#ifndef RECONNECT_BACKOFF_H
+#define RECONNECT_BACKOFF_H
+
+#include <atomic>
+#include <chrono>
+#include <random>
+
+// 断线重连的等待策略, 输入和输出共用
+struct ReconnectOptions
+{
+    int initialDelayMs = 500; // 第一次重试前的等待
+    int maxDelayMs = 30000;   // 等待时间的上限
+    int maxAttempts = 0;      // 连续失败多少次后放弃, 0 表示一直重试
+};
+
+// 指数退避: 每次失败等待时间翻倍直到上限, 并加 ±25% 的随机抖动, 多路同时断线时错开重连
+class ReconnectBackoff
+{
+private:
+    ReconnectOptions options;
+    int attempt = 0;
+    std::mt19937 rng;
+
+public:
+    explicit ReconnectBackoff(const ReconnectOptions &opts = ReconnectOptions());
+
+    void setOptions(const ReconnectOptions &opts) { options = opts; }
+    const ReconnectOptions &getOptions() const { return options; }
+
+    // 下一次重试前的等待时间, 同时计一次尝试
+    std::chrono::milliseconds nextDelay();
+    // 等待到下一次重试; cancel 置位时提前返回 false
+    bool wait(const std::atomic<bool> &cancel);
+    // 已达到最大重试次数
+    bool exhausted() const { return options.maxAttempts > 0 && attempt >= options.maxAttempts; }
+    int attempts() const { return attempt; }
+    // 连接成功后调用, 下次断线重新从初始等待时间开始
+    void reset() { attempt = 0; }
+};
+
+#endif // RECONNECT_BACKOFF_H
@@ -0,0 +1,289 @@
+// ring_queue.hh
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+// 队列满时的处理策略
+enum class OverflowPolicy
+{
+    Block,      // 阻塞生产者直到有空位
+    DropOldest, // 丢弃队首最旧的元素
+    DropNonKey, // 丢弃非关键元素, 且丢弃后直到下一个关键元素之前的元素都丢弃(保证码流可解)
+                // 可丢弃元素(不被引用的帧)只丢弃自身; 关键元素到来时清空队列, 即整组丢弃
+};
+
+// 有界队列: 环形缓冲区, 由一个互斥锁和两个条件变量保护, 多个生产者和消费者都可以使用(不是无锁结构)
+// 元素为可移动的引用计数对象(cv::Mat, PacketPtr 等); 支持溢出策略、大小/跨度上限、可单独丢弃和豁免的元素
+template <typename T>
+class RingQueue
+{
+public:
+    using KeyPredicate = std::function<bool(const T &)>;
+    // 元素大小(如包的字节数), 用于统计队列中积压的总量
+    using Weigher = std::function<size_t(const T &)>;
+    // 队首与新元素之间的跨度(如时长)是否超出上限
+    using SpanCheck = std::function<bool(const T &oldest, const T &incoming)>;
+
+    RingQueue(size_t capacity, OverflowPolicy policy, KeyPredicate isKey = nullptr, Weigher weigh = nullptr)
+        : slots(capacity ? capacity : 1), limit(slots.size()), policy(policy), isKey(std::move(isKey)), weigh(std::move(weigh))
+    {
+    }
+
+    // 除元素个数外的上限, 需在开始使用之前设置; 任一超出即按溢出策略处理
+    // maxWeight 为 0 表示不限制总大小, spanExceeds 为空表示不限制跨度
+    void setLimits(size_t maxWeight, SpanCheck spanExceeds)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        weightLimit = maxWeight;
+        exceedsSpan = std::move(spanExceeds);
+    }
+
+    // DropNonKey 策略下溢出时可单独丢弃的元素(如不被参考的帧), 丢弃后不必等待关键元素
+    void setDisposable(KeyPredicate disposable)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        isDisposable = std::move(disposable);
+    }
+
+    // 放入一个元素; 队列关闭返回 false, 被策略丢弃时仍返回 true
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (policy == OverflowPolicy::DropNonKey && waitKey)
+        {
+            if (!keyOf(item))
+            {
+                droppedCount++;
+                return !closed;
+            }
+            waitKey = false;
+        }
+
+        if (fullFor(item))
+        {
+            switch (policy)
+            {
+            case OverflowPolicy::Block:
+                notFull.wait(lock, [this, &item]
+                             { return !fullFor(item) || closed; });
+                break;
+            case OverflowPolicy::DropOldest:
+                while (fullFor(item))
+                {
+                    popLocked();
+                    droppedCount++;
+                }
+                break;
+            case OverflowPolicy::DropNonKey:
+                if (isDisposable && !keyOf(item) && isDisposable(item))
+                {
+                    // 没有其他元素引用它, 只丢弃自身
+                    droppedCount++;
+                    return !closed;
+                }
+                if (!keyOf(item))
+                {
+                    // 丢弃当前包, 之后的非关键包引用了它, 也一并丢弃
+                    droppedCount++;
+                    waitKey = true;
+                    return !closed;
+                }
+                // 关键包到来时清空整个队列(队首的豁免元素除外), 从新的关键包重新开始
+                droppedCount += count - exemptCount;
+                while (count > exemptCount)
+                    popBackLocked();
+                break;
+            }
+        }
+
+        if (closed)
+            return false;
+
+        totalWeight += weightOf(item);
+        slots[(head + count) % slots.size()] = std::move(item);
+        count++;
+        if (count > highWater)
+            highWater = count;
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // 放入一个不受上限(个数、大小、跨度)约束的元素, 如起播时补发的 GOP 缓存; DropNonKey 策略下不会被丢弃
+    // 只在队列为空或只有这类元素时调用, 它们排在队首; 之后的元素照常按上限计算, 不计入这些元素
+    bool pushExempt(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (count != exemptCount)
+        {
+            // 队首已有普通元素, 不能再插到它们前面, 按普通元素处理
+            lock.unlock();
+            return push(std::move(item));
+        }
+        if (closed)
+            return false;
+        if (exemptCount + 1 + limit > slots.size())
+            grow(exemptCount + 1 + limit);
+        size_t w = weightOf(item);
+        totalWeight += w;
+        exemptWeight += w;
+        slots[(head + count) % slots.size()] = std::move(item);
+        count++;
+        exemptCount++;
+        if (count > highWater)
+            highWater = count;
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // 取出一个元素, 队列为空时阻塞; 队列关闭且为空时返回 false
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this]
+                      { return count > 0 || closed; });
+        if (count == 0)
+            return false;
+        item = popLocked();
+        notFull.notify_one();
+        return true;
+    }
+
+    bool tryPop(T &item)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count == 0)
+            return false;
+        item = popLocked();
+        notFull.notify_one();
+        return true;
+    }
+
+    // 关闭队列, 唤醒所有等待者; 剩余元素仍可被取出
+    void close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    // 丢弃所有剩余元素并重新打开
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (count)
+            popLocked();
+        head = 0;
+        closed = false;
+        waitKey = false;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return count;
+    }
+
+    size_t capacity() const { return limit; }
+
+    // 队列中元素的总大小, 未设置 Weigher 时为 0
+    size_t weight() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return totalWeight;
+    }
+
+    uint64_t dropped() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return droppedCount;
+    }
+
+    size_t highWaterMark() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return highWater;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t limit; // 普通元素的个数上限; 豁免元素另外占用 slots
+    size_t head = 0;
+    size_t exemptCount = 0; // 队首豁免元素的个数和总大小
+    size_t exemptWeight = 0;
+    size_t count = 0;
+    size_t highWater = 0;
+    size_t totalWeight = 0;
+    size_t weightLimit = 0;
+    uint64_t droppedCount = 0;
+    bool closed = false;
+    bool waitKey = false;
+    OverflowPolicy policy;
+    KeyPredicate isKey;
+    KeyPredicate isDisposable;
+    Weigher weigh;
+    SpanCheck exceedsSpan;
+    mutable std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+
+    bool keyOf(const T &item) const { return !isKey || isKey(item); }
+    size_t weightOf(const T &item) const { return weigh ? weigh(item) : 0; }
+
+    // 放入 item 后是否超出上限(不计队首的豁免元素); 没有普通元素时总能放入一个
+    bool fullFor(const T &item) const
+    {
+        size_t limited = count - exemptCount;
+        if (limited >= limit)
+            return true;
+        if (limited == 0)
+            return false;
+        if (weightLimit && totalWeight - exemptWeight + weightOf(item) > weightLimit)
+            return true;
+        return exceedsSpan && exceedsSpan(slots[(head + exemptCount) % slots.size()], item);
+    }
+
+    T popLocked()
+    {
+        T item = std::move(slots[head]);
+        slots[head] = T();
+        size_t w = weightOf(item);
+        totalWeight -= w;
+        if (exemptCount)
+        {
+            exemptCount--;
+            exemptWeight -= w;
+        }
+        head = (head + 1) % slots.size();
+        count--;
+        return item;
+    }
+
+    void popBackLocked()
+    {
+        size_t tail = (head + count - 1) % slots.size();
+        totalWeight -= weightOf(slots[tail]);
+        slots[tail] = T();
+        count--;
+    }
+
+    // 扩大存储, 元素按顺序移到开头
+    void grow(size_t size)
+    {
+        std::vector<T> larger(size);
+        for (size_t i = 0; i < count; i++)
+            larger[i] = std::move(slots[(head + i) % slots.size()]);
+        slots.swap(larger);
+        head = 0;
+    }
+};
+
+#endif // RING_QUEUE_H
@@ -0,0 +1,67 @@
+// segment_writer.hh
+#ifndef SEGMENT_WRITER_H
+#define SEGMENT_WRITER_H
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+#include <deque>
+#include <string>
+
+// 录制选项, 用于协议为 record 的输出(地址为切片文件的路径前缀, 如 /var/record/cam01)
+struct RecordOptions
+{
+    std::string format = "fmp4"; // fmp4: 分片 MP4; hls: MPEG-TS 切片并维护 m3u8 播放列表
+    int segmentSeconds = 60;     // 切片时长, 达到后在下一个关键帧处切换
+    int retentionHours = 72;     // 保留时长, 更早的切片在切换时删除; 0 表示不删除
+    int bufferKb = 1024;         // 写缓冲, 攒满后一次写盘
+};
+
+// 录制切片文件的管理: 命名、大块缓冲写、落盘、保留期清理和播放列表
+// 写入中的切片带 .part 后缀, 写完 fsync 后改名; 异常退出留下的 .part 在下次启动时恢复
+// fMP4 按关键帧分片, 每个分片自包含, 写到一半的切片也能播放到最后一个完整分片
+class SegmentWriter
+{
+private:
+    struct Segment
+    {
+        std::string name;
+        double seconds;
+    };
+
+    std::string dir;
+    std::string prefix;
+    RecordOptions options;
+    int fd = -1;
+    std::string partPath;
+    std::string finalPath;
+    bool recovered = false;
+    std::deque<Segment> playlist; // hls: 仍在保留期内的切片
+    uint64_t mediaSequence = 0;
+
+    const char *extension() const;
+    void recover();
+    void prune();
+    void writePlaylist();
+
+public:
+    SegmentWriter(const std::string &pathPrefix, const RecordOptions &opts);
+    ~SegmentWriter();
+    SegmentWriter(const SegmentWriter &) = delete;
+    SegmentWriter &operator=(const SegmentWriter &) = delete;
+
+    // 切片的封装格式名
+    const char *formatName() const;
+    // fmp4 所需的封装器选项, 写头之前设置
+    void setMuxerOptions(AVDictionary **opts) const;
+    // 新建一个切片文件, 返回写入它的 AVIOContext(不可定位), 失败返回 nullptr
+    AVIOContext *begin();
+    // 当前切片的文件名(不含 .part)
+    const std::string &currentPath() const { return finalPath; }
+    // 结束当前切片: 刷出缓冲、fsync、改为正式文件名, 再删除过期切片并更新播放列表
+    // seconds 为切片包含的时长, 不大于 0 表示没有写入任何包, 直接删除
+    void finish(AVIOContext **pb, double seconds);
+};
+
+#endif // SEGMENT_WRITER_H
@@ -0,0 +1,45 @@
+// shm_frame_publisher.hh
+#ifndef SHM_FRAME_PUBLISHER_H
+#define SHM_FRAME_PUBLISHER_H
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libavutil/rational.h>
+}
+#include <cstdint>
+#include <string>
+
+#include "shm_frame_ring.hh"
+
+// 发布方: 创建共享内存段, 把解码后的帧按原生像素格式拷贝到环中的下一个槽
+// 每帧只拷贝一次, 之后任意多个读者零拷贝读取; 写入从不等待读者
+// 第一帧到来时按帧大小创建共享内存段, 分辨率变大放不下时重新创建(读者需重新 open)
+class ShmFramePublisher
+{
+private:
+    std::string name;
+    uint32_t slotCount;
+    int fd = -1;
+    ShmFrameHeader *header = nullptr;
+    size_t mappedBytes = 0;
+    uint64_t frameNumber = 0;
+    bool warned = false;
+
+    bool create(uint32_t slotBytes);
+    void destroy();
+
+public:
+    // shmName 为 POSIX 共享内存名(不以 / 开头时自动补上), slots 为环的槽数
+    ShmFramePublisher(const std::string &shmName, int slots = 4);
+    ~ShmFramePublisher();
+    ShmFramePublisher(const ShmFramePublisher &) = delete;
+    ShmFramePublisher &operator=(const ShmFramePublisher &) = delete;
+
+    // 拷贝一帧到下一个槽并发布; 硬件帧等无法按平面拷贝的格式返回 false
+    bool publish(const AVFrame *frame, AVRational timeBase);
+    uint64_t published() const { return frameNumber; }
+    const std::string &getName() const { return name; }
+};
+
+#endif // SHM_FRAME_PUBLISHER_H
@@ -0,0 +1,114 @@
+// shm_frame_ring.hh
+#ifndef SHM_FRAME_RING_H
+#define SHM_FRAME_RING_H
+
+// 本机共享内存帧环: 拉流进程把解码后的帧发布到 POSIX 共享内存, 任意多个本地分析进程零拷贝读取
+// 本文件只依赖标准库和 POSIX, 分析进程只需链接 shm_frame_reader 库, 不需要 FFmpeg 和 OpenCV
+//
+// 内存布局: [ShmFrameHeader][ShmFrameSlot x slotCount][槽 0 的图像]...[槽 n-1 的图像], 均 64 字节对齐
+// 每个槽用序号锁(seqlock)保护: 写入前序号加 1 成为奇数, 写完再加 1 成为偶数;
+// 读者读取前后序号相同且为偶数, 说明期间没有被覆盖. 写入方从不等待读者
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "共享内存中的原子变量必须是无锁的");
+
+// 槽的元数据, 图像数据按 offset/linesize 存放在槽的数据区
+struct ShmFrameSlot
+{
+    std::atomic<uint64_t> seq; // 序号锁, 奇数表示正在写
+    uint64_t frameNumber;      // 发布序号, 从 1 开始
+    int64_t pts;               // 解码输出的时间戳, 时间基为 timeBaseNum/timeBaseDen
+    int32_t timeBaseNum;
+    int32_t timeBaseDen;
+    int32_t width;
+    int32_t height;
+    int32_t format;      // AVPixelFormat 的取值(如 0 为 YUV420P, 23 为 NV12)
+    int32_t planes;      // 有效平面数
+    int32_t linesize[4]; // 各平面每行字节数
+    uint32_t offset[4];  // 各平面相对槽数据区起点的偏移
+    uint32_t dataBytes;  // 图像数据的总字节数
+    uint32_t keyFrame;   // 解码出的帧是否为关键帧
+};
+
+struct ShmFrameHeader
+{
+    static const uint32_t Magic = 0x52465356; // "VSFR"
+    static const uint32_t Version = 1;
+
+    uint32_t magic; // 初始化完成后才写入, 读者据此判断共享内存段是否可用
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t slotBytes;          // 每个槽数据区的容量
+    std::atomic<uint64_t> latest; // 最近发布完成的帧序号, 0 表示还没有帧
+
+    static size_t align(size_t n) { return (n + 63) & ~static_cast<size_t>(63); }
+    static size_t slotsOffset() { return align(sizeof(ShmFrameHeader)); }
+    static size_t dataOffset(uint32_t slots) { return align(slotsOffset() + slots * sizeof(ShmFrameSlot)); }
+    // 整个共享内存段的大小
+    static size_t totalBytes(uint32_t slots, uint32_t slotBytes) { return dataOffset(slots) + static_cast<size_t>(slots) * slotBytes; }
+
+    ShmFrameSlot *slot(uint32_t i)
+    {
+        return reinterpret_cast<ShmFrameSlot *>(reinterpret_cast<uint8_t *>(this) + slotsOffset()) + i;
+    }
+    uint8_t *slotData(uint32_t i)
+    {
+        return reinterpret_cast<uint8_t *>(this) + dataOffset(slotCount) + static_cast<size_t>(i) * slotBytes;
+    }
+    const ShmFrameSlot *slot(uint32_t i) const { return const_cast<ShmFrameHeader *>(this)->slot(i); }
+    const uint8_t *slotData(uint32_t i) const { return const_cast<ShmFrameHeader *>(this)->slotData(i); }
+};
+
+// 读者看到的一帧: 指针直接指向共享内存, 不拷贝
+struct ShmFrameView
+{
+    uint64_t frameNumber = 0;
+    int64_t pts = 0;
+    int timeBaseNum = 0;
+    int timeBaseDen = 1;
+    int width = 0;
+    int height = 0;
+    int format = -1;
+    int planes = 0;
+    bool keyFrame = false;
+    const uint8_t *data[4] = {nullptr, nullptr, nullptr, nullptr};
+    int linesize[4] = {0, 0, 0, 0};
+
+    uint32_t slot = 0;
+    uint64_t seq = 0;
+};
+
+// 读者: 只读映射发布方创建的共享内存段
+// 用法: latest 取得最新帧的视图, 处理(或拷贝)完后用 valid 确认期间没有被覆盖;
+// 环中有多个槽, 发布方要再写满一圈才会覆盖同一个槽, 处理时间短于 (槽数-1) 帧时不会失效
+class ShmFrameReader
+{
+private:
+    std::string name;
+    int fd = -1;
+    ShmFrameHeader *header = nullptr;
+    size_t mappedBytes = 0;
+
+public:
+    ShmFrameReader() = default;
+    ~ShmFrameReader();
+    ShmFrameReader(const ShmFrameReader &) = delete;
+    ShmFrameReader &operator=(const ShmFrameReader &) = delete;
+
+    // 名字与发布方的 shm_name 相同(如 /video_streamer.cam01); 发布方尚未创建或尚未写入时返回 false
+    bool open(const std::string &shmName);
+    void close();
+    bool isOpen() const { return header != nullptr; }
+
+    // 最近发布的帧序号, 0 表示还没有帧
+    uint64_t latestNumber() const;
+    // 取最新一帧的零拷贝视图; 没有比 after 更新的帧, 或最新的槽正被写入时返回 false
+    bool latest(ShmFrameView &view, uint64_t after = 0) const;
+    // 视图使用完后调用: 期间没有被覆盖返回 true, 否则读到的数据可能不完整, 应丢弃
+    bool valid(const ShmFrameView &view) const;
+};
+
+#endif // SHM_FRAME_RING_H
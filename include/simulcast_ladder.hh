@@ -0,0 +1,106 @@
+// simulcast_ladder.hh
+#ifndef SIMULCAST_LADDER_H
+#define SIMULCAST_LADDER_H
+
+extern "C"
+{
+#include <libavutil/frame.h>
+}
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "ffmpeg_encoder.hh"
+#include "frame_pool.hh"
+#include "metrics.hh"
+#include "ring_queue.hh"
+#include "video_frame.hh"
+
+class FFmpegPusher;
+
+// 分级输出的一级: 尺寸、编码档位和该级的输出
+struct RenditionConfig
+{
+    int width = 0;
+    int height = 0;
+    EncoderProfile profile;
+    std::vector<std::pair<std::string, std::string>> outputs; // <协议, 地址>
+};
+
+// 分级输出(simulcast): 源尺寸由上级推流器编码, 各级从上一级缩放后的帧继续缩小(1080→720→360),
+// 每级一个线程和一个推流器, 编码和写出互不阻塞
+// 关键帧由分级统一安排(固定 GOP + 请求), 同一源帧在所有级别上同时编为关键帧, 各级可无缝切换
+class SimulcastLadder
+{
+public:
+    using PusherFactory = std::function<std::unique_ptr<FFmpegPusher>(const RenditionConfig &)>;
+
+private:
+    // 在级间传递的帧, key 表示该帧在所有级别上编为关键帧
+    struct LadderFrame
+    {
+        FramePtr frame;
+        bool key = false;
+    };
+
+    struct Level
+    {
+        RenditionConfig config;
+        std::string label; // 如 "1280x720", 用于日志和指标名
+        std::unique_ptr<FFmpegPusher> pusher;
+        RingQueue<LadderFrame> queue;
+        FrameConverter scaler;
+        std::thread thread;
+        Level *next = nullptr;
+        std::atomic<uint64_t> frames{0};
+
+        explicit Level(const RenditionConfig &c);
+    };
+
+    std::vector<std::unique_ptr<Level>> levels;
+    StreamMetrics *metrics = nullptr;
+
+    // 关键帧安排, 只在上级的编码线程中访问(请求标志除外)
+    int gopFrames = 50;
+    int keyframeMinIntervalMs = 1000;
+    int64_t sinceKeyframe = -1; // 距上一个关键帧的帧数, -1 表示还没有送入过帧
+    std::chrono::steady_clock::time_point lastKeyframeTime;
+    std::atomic<bool> keyframeRequested{false};
+
+    void levelLoop(Level *level);
+
+public:
+    SimulcastLadder() = default;
+    ~SimulcastLadder();
+    SimulcastLadder(const SimulcastLadder &) = delete;
+    SimulcastLadder &operator=(const SimulcastLadder &) = delete;
+
+    // 增加一级, 需在 start 之前调用; 同一尺寸只保留一级, 重复时合并输出
+    void addRendition(const RenditionConfig &config);
+    bool empty() const { return levels.empty(); }
+    // 关键帧间隔(帧数)和按请求强制关键帧的最小间隔, 需在 start 之前设置
+    void setKeyframeSchedule(int gop, int minIntervalMs);
+    // 缩放计时和各级的丢帧/积压写入指标, 需在 start 之前设置
+    void setMetrics(StreamMetrics *m) { metrics = m; }
+
+    // 按尺寸从大到小排列, 逐级创建推流器并启动编码线程; 任一级创建失败时返回 false
+    bool start(const PusherFactory &create);
+    // 上级每送入编码器一帧调用一次(持有上级的编码锁): 决定该帧是否为关键帧, 并交给第一级
+    // forceKey 为上级自己要求的关键帧; 返回值为 true 时上级也必须把该帧编为关键帧
+    // requested 不为空时写入该关键帧是否来自请求(forceKey 或 requestKeyframe), 固定 GOP 的关键帧为 false
+    bool schedule(const AVFrame *frame, bool forceKey, bool *requested = nullptr);
+    // 请求下一帧在所有级别上编为关键帧, 可在任意线程调用; 受最小间隔限制
+    void requestKeyframe() { keyframeRequested = true; }
+    // 已送入的帧逐级编码写出后关闭各级推流器
+    void close();
+
+    size_t size() const { return levels.size(); }
+};
+
+#endif // SIMULCAST_LADDER_H
@@ -0,0 +1,73 @@
+// stream_channel.hh
+#ifndef STREAM_CHANNEL_H
+#define STREAM_CHANNEL_H
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "channel_config.hh"
+#include "ffmpeg_capture.hh"
+#include "ffmpeg_pusher.hh"
+#include "frame_processor.hh"
+#include "input_pacer.hh"
+#include "metrics.hh"
+#include "ring_queue.hh"
+#include "worker_pool.hh"
+
+// 多路模式下的一路: 读包在本路线程中进行(阻塞网络IO),
+// 解码和编码作为任务提交到共享的 WorkerPool, 不再每路独占计算线程
+class StreamChannel
+{
+private:
+    ChannelConfig config;
+    WorkerPool &pool;
+    int poolChannel = -1;
+
+    FFmpegCapture capturer;
+    std::unique_ptr<FFmpegPusher> pusher;
+    std::unique_ptr<ProcessingChain> chain; // 在解码任务中串行处理, 并行度来自共享线程池的多路
+    bool passthrough = false;
+    bool pacing = false;
+    InputPacer pacer;
+
+    RingQueue<PacketPtr> packetQueue;
+    std::mutex decodeMutex; // 解码任务与重连互斥
+    AVFrame *decodedFrame = nullptr;
+    std::vector<PacketPtr> encodedPackets; // 只在持有解码锁时使用
+
+    std::thread readerThread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopping{false};
+    StreamMetrics *metrics = nullptr;
+
+    void readLoop();
+    void process();
+    bool reconnect();
+
+public:
+    StreamChannel(const ChannelConfig &cfg, WorkerPool &workerPool);
+    ~StreamChannel();
+
+    bool start();
+    void stop();
+    bool isRunning() const { return running; }
+    // 本路的指标, 在 start 之前调用
+    void setMetrics(StreamMetrics *m) { metrics = m; }
+    const std::string &getName() const { return config.name; }
+    // 下一帧强制编为关键帧, 可在任意线程调用; 需在 start 之后、stop 之前调用
+    void requestKeyframe()
+    {
+        if (pusher)
+            pusher->requestKeyframe();
+    }
+    // 运行中接入一个输出, 可在任意线程调用
+    bool attachOutput(const std::string &prot, const std::string &url)
+    {
+        return pusher && pusher->attachOutput(url, prot);
+    }
+};
+
+#endif // STREAM_CHANNEL_H
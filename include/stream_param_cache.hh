@@ -0,0 +1,32 @@
+// stream_param_cache.hh
+#ifndef STREAM_PARAM_CACHE_H
+#define STREAM_PARAM_CACHE_H
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+}
+#include <string>
+
+// 按 URL 缓存探测得到的视频流参数(编码、extradata、尺寸、像素格式、帧率)
+// 下次打开同一地址时直接使用, 跳过 avformat_find_stream_info 的数秒探测
+class StreamParamCache
+{
+private:
+    std::string dir;
+
+    std::string pathFor(const std::string &url) const;
+
+public:
+    explicit StreamParamCache(const std::string &cacheDir) : dir(cacheDir) {}
+
+    bool enabled() const { return !dir.empty(); }
+    // 读取缓存的参数到 par, 没有缓存或内容无效时返回 false
+    bool load(const std::string &url, AVCodecParameters *par, AVRational &frameRate) const;
+    // 写入缓存(先写临时文件再改名, 不会留下半个文件)
+    bool save(const std::string &url, const AVCodecParameters *par, AVRational frameRate) const;
+    // 缓存与实际码流不符时删除, 下次打开重新探测
+    void remove(const std::string &url) const;
+};
+
+#endif // STREAM_PARAM_CACHE_H
@@ -0,0 +1,106 @@
+// stream_pipeline.hh
+#ifndef STREAM_PIPELINE_H
+#define STREAM_PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "ffmpeg_capture.hh"
+#include "ffmpeg_pusher.hh"
+#include "frame_processor.hh"
+#include "input_pacer.hh"
+#include "metrics.hh"
+#include "ring_queue.hh"
+#include "video_frame.hh"
+
+// 一帧编码出的所有包(直通时为一个输入包), 在队列中作为一个整体传递和丢弃
+using PacketBatch = std::vector<PacketPtr>;
+
+struct PipelineOptions
+{
+    // 按源时间戳的节奏读取, 只对文件输入生效; 实时输入按到达速度处理, 不额外等待
+    bool pace = false;
+    // 解码帧队列: 编码跟不上时丢弃最旧的帧
+    size_t frameQueueSize = 8;
+    OverflowPolicy frameOverflow = OverflowPolicy::DropOldest;
+    // 编码包队列(以帧为单位, 一帧的所有包为一个元素): 网络跟不上时丢弃到下一个关键帧
+    size_t packetQueueSize = 128;
+    OverflowPolicy packetOverflow = OverflowPolicy::DropNonKey;
+    // 延迟预算(毫秒), 0 表示不限制: 超出预算的旧帧在转换和编码之前丢弃(最新帧优先),
+    // 解码持续落后时依次开启 skip_frame=nonref/nonkey
+    int latencyBudgetMs = 0;
+};
+
+// 按原因统计的丢帧/丢包数
+struct DropStats
+{
+    uint64_t staleFrames = 0;    // 超出延迟预算, 被更新的帧取代
+    uint64_t queueFrames = 0;    // 帧队列满时丢弃的最旧帧
+    uint64_t decoderSkipped = 0; // 解码器 skip_frame 丢弃的帧(估算)
+    uint64_t queuePackets = 0;   // 包队列满时丢弃到下一个关键帧
+    uint64_t outputPackets = 0;  // 各输出队列满时丢弃的包
+};
+
+// 拉流/解码 -> 编码 -> 封装/写出 三线程流水线, 线程间以有界队列连接
+// 设置了并行的处理链时, 解码与编码之间再加一个分发线程, 各帧在处理链的工作线程中并行处理、按序交给编码
+// 直通模式下只有 拉流 -> 写出 两个线程
+class StreamPipeline
+{
+private:
+    FFmpegCapture &capturer;
+    FFmpegPusher &pusher;
+    bool passthrough;
+    PipelineOptions options;
+
+    RingQueue<VideoFrame> frameQueue;
+    RingQueue<PacketBatch> packetQueue;
+    bool pacing = false;
+    InputPacer pacer;
+
+    // 延迟预算模式的状态
+    std::atomic<uint64_t> staleFrames{0};
+    double lagBaseline = 0; // (墙钟 - 帧时间戳) 的最小值, 超出部分即解码落后的时间
+    bool lagValid = false;
+    std::chrono::steady_clock::time_point overloadSince;
+    std::chrono::steady_clock::time_point healthySince;
+    uint64_t lastPacketDrops = 0;
+    std::chrono::steady_clock::time_point lastKeyframeRequest;
+
+    StreamMetrics *metrics = nullptr;
+    ProcessingChain *chain = nullptr;
+
+    std::thread captureThread;
+    std::thread processThread;
+    std::thread encodeThread;
+    std::thread muxThread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopping{false};
+
+    void captureLoop();
+    void processLoop();
+    void encodeLoop();
+    bool nextFrame(VideoFrame &frame);
+    void muxLoop();
+    bool reconnect();
+    void adjustDecoderSkip(const AVFrame *frame);
+    void checkPacketDrops();
+
+public:
+    StreamPipeline(FFmpegCapture &cap, FFmpegPusher &push, bool copyMode,
+                   const PipelineOptions &opts = PipelineOptions());
+    ~StreamPipeline();
+
+    bool start();
+    void stop();
+    bool isRunning() const { return running; }
+    DropStats getDropStats() const;
+    // 导出队列深度、丢弃数等指标, 在 start 之前调用; 计时由拉流/推流模块自己记录
+    void setMetrics(StreamMetrics *m);
+    // 解码与编码之间的处理链(已 plan), 为空或没有处理器时不处理; 在 start 之前调用, 生命周期长于流水线
+    void setProcessingChain(ProcessingChain *c) { chain = c && !c->empty() ? c : nullptr; }
+};
+
+#endif // STREAM_PIPELINE_H
@@ -0,0 +1,83 @@
+// video_frame.hh
+#ifndef VIDEO_FRAME_H
+#define VIDEO_FRAME_H
+
+extern "C"
+{
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+#include <chrono>
+#include <utility>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_pool.hh"
+
+// 像素格式/尺寸转换器, 缓存 SWS 上下文, 输出缓冲区来自帧池
+class FrameConverter
+{
+private:
+    SwsContext *swsContext = nullptr;
+    FramePool framePool;
+    int swsFlags;
+
+    bool prepare(const AVFrame *src, AVPixelFormat format, int width, int height);
+
+public:
+    explicit FrameConverter(int flags = SWS_BILINEAR);
+    ~FrameConverter();
+    FrameConverter(const FrameConverter &) = delete;
+    FrameConverter &operator=(const FrameConverter &) = delete;
+
+    // 转换到池化帧 dst, 并复制 pts 等帧属性
+    bool convert(const AVFrame *src, AVFrame *dst, AVPixelFormat format, int width, int height);
+    // 转换到调用者提供的缓冲区
+    bool convert(const AVFrame *src, uint8_t *const dstData[], const int dstLinesize[],
+                 AVPixelFormat format, int width, int height);
+    FramePoolStats stats() const { return framePool.stats(); }
+};
+
+// 在线程间传递的视频帧: 持有解码器原生格式的帧, RGB 视图仅在被请求时转换一次
+class VideoFrame
+{
+private:
+    FramePtr nativeFrame;
+    FramePtr rgbFrame;
+    FramePtr processedFrame;
+    cv::Mat rgbMat;
+    std::chrono::steady_clock::time_point arrival; // 解码完成的时间
+    bool repeated = false;                         // 断线补帧: 重复已编码过的帧, 不再处理
+
+public:
+    VideoFrame() = default;
+    explicit VideoFrame(FramePtr frame)
+        : nativeFrame(std::move(frame)), arrival(std::chrono::steady_clock::now()) {}
+
+    bool empty() const { return !nativeFrame; }
+    void markRepeated() { repeated = true; }
+    bool isRepeated() const { return repeated; }
+    AVFrame *native() const { return nativeFrame.get(); }
+
+    // 返回 RGB24 的 cv::Mat 视图(零拷贝), 首次调用时转换
+    // 请求过 RGB 后, 对该视图的修改会被编码(current 返回 RGB 帧)
+    cv::Mat &rgb(FrameConverter &converter);
+    bool hasRgb() const { return static_cast<bool>(rgbFrame); }
+
+    // 处理链的输出, 之后 current 返回它
+    void setProcessed(FramePtr frame) { processedFrame = std::move(frame); }
+
+    // 应送入编码器的帧: 处理链的输出、处理过的 RGB 帧或原生帧
+    const AVFrame *current() const
+    {
+        if (processedFrame)
+            return processedFrame.get();
+        return rgbFrame ? rgbFrame.get() : nativeFrame.get();
+    }
+
+    // 解码完成后经过的时间, 即在队列中等待的时间
+    std::chrono::steady_clock::duration age() const { return std::chrono::steady_clock::now() - arrival; }
+};
+
+#endif // VIDEO_FRAME_H
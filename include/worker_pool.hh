@@ -0,0 +1,76 @@
+// worker_pool.hh
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// 多路共享的工作线程池
+// 每路(channel)的任务按提交顺序串行执行, 各路之间轮转调度保证公平;
+// 每路可设置CPU预算(核数), 在一个统计窗口内用完预算的路会被暂缓到下个窗口
+class WorkerPool
+{
+public:
+    struct ChannelStats
+    {
+        std::string name;
+        uint64_t tasks = 0;       // 已执行的任务数
+        uint64_t throttled = 0;   // 因超出预算被暂缓的次数
+        double cpuSeconds = 0;    // 累计CPU时间
+        size_t pending = 0;       // 等待中的任务数
+    };
+
+    explicit WorkerPool(size_t threads, std::chrono::milliseconds window = std::chrono::milliseconds(1000));
+    ~WorkerPool();
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    // 注册一路, cpuBudget 为允许占用的核数, <= 0 表示不限制
+    int addChannel(const std::string &name, double cpuBudget);
+    // 注销一路, 丢弃其未执行的任务并等待正在执行的任务结束
+    void removeChannel(int channel);
+    // 提交一个任务到指定的路
+    bool post(int channel, std::function<void()> task);
+    void stop();
+
+    size_t threadCount() const { return workers.size(); }
+    std::vector<ChannelStats> stats() const;
+
+private:
+    struct Channel
+    {
+        std::string name;
+        double cpuBudget = 0;
+        std::deque<std::function<void()>> tasks;
+        bool running = false;  // 同一路同时只有一个任务在执行
+        bool queued = false;   // 是否在就绪队列中
+        bool removed = false;
+        double windowCpu = 0;  // 当前窗口内已用的CPU时间(秒)
+        ChannelStats stats;
+    };
+
+    std::vector<std::thread> workers;
+    std::map<int, Channel> channels;
+    std::deque<int> ready;
+    int nextChannelId = 0;
+    bool stopping = false;
+    std::chrono::milliseconds windowLength;
+    std::chrono::steady_clock::time_point windowStart;
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    std::condition_variable idle;
+
+    void workerLoop();
+    bool overBudget(const Channel &ch) const;
+    void rollWindow(std::chrono::steady_clock::time_point now);
+};
+
+#endif // WORKER_POOL_H
@@ -0,0 +1,120 @@
+// bitrate_controller.cc
+#include "bitrate_controller.hh"
+
+#include <algorithm>
+#include <iostream>
+
+BitrateController::BitrateController(FFmpegEncoder &enc, const AdaptiveBitrateOptions &opts)
+    : encoder(enc), options(opts)
+{
+}
+
+bool BitrateController::start()
+{
+    ceiling = encoder.getRateCeiling();
+    if (ceiling <= 0)
+    {
+        std::cerr << "自适应码率需要编码档位设置最大码率(max_bitrate), 已禁用" << std::endl;
+        return false;
+    }
+
+    rate = ceiling;
+    decimation = 1;
+    clearWindows = 0;
+    holdWindows = 0;
+    lastStats.clear();
+    windowStart = std::chrono::steady_clock::now();
+    std::cout << "自适应码率: 范围 " << std::min(options.minBitRate, ceiling) << " - " << ceiling << std::endl;
+    return true;
+}
+
+void BitrateController::update(const std::vector<std::unique_ptr<FFmpegOutput>> &outputs)
+{
+    auto now = std::chrono::steady_clock::now();
+    double windowSeconds = std::chrono::duration<double>(now - windowStart).count();
+    if (windowSeconds * 1000 < options.intervalMs)
+        return;
+    windowStart = now;
+
+    // 第一个窗口只记录基准值
+    bool first = lastStats.size() != outputs.size();
+    lastStats.resize(outputs.size());
+
+    bool congested = false;
+    double throughput = 0; // 拥塞输出中最低的实测吞吐(bps)
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+        const FFmpegOutput &output = *outputs[i];
+        OutputStats stats = output.getStats();
+        OutputStats last = lastStats[i];
+        lastStats[i] = stats;
+        if (first || !output.isOpened() || output.isFailed() || output.isLocal())
+            continue;
+
+        double busy = (stats.writeSeconds - last.writeSeconds) / windowSeconds;
+        double queueSeconds = stats.queuedBytes * 8.0 / rate;
+        bool dropped = stats.droppedPackets > last.droppedPackets;
+        if (busy < options.busyThreshold && queueSeconds < options.maxQueueSeconds && !dropped)
+            continue;
+
+        double bps = (stats.writtenBytes - last.writtenBytes) * 8.0 / windowSeconds;
+        if (!congested || bps < throughput)
+            throughput = bps;
+        congested = true;
+        std::cerr << "输出拥塞 (" << output.getUrl() << "): 写出阻塞=" << static_cast<int>(busy * 100)
+                  << "%, 积压=" << stats.queuedBytes << "字节, 吞吐=" << static_cast<int64_t>(bps) << "bps"
+                  << (dropped ? ", 已丢包" : "") << std::endl;
+    }
+
+    // 降码率后队列里还有旧码率的积压, 等一个窗口再评估
+    if (holdWindows > 0)
+    {
+        holdWindows--;
+        return;
+    }
+
+    int64_t minRate = std::min(options.minBitRate, ceiling);
+    if (congested)
+    {
+        clearWindows = 0;
+        if (rate > minRate)
+        {
+            // 降到实测吞吐以下, 给队列留出排空的余量
+            int64_t target = static_cast<int64_t>(rate * options.stepDown);
+            if (throughput > 0)
+                target = std::min(target, static_cast<int64_t>(throughput * 0.9));
+            target = std::max(target, minRate);
+            std::cout << "自适应码率: 下调 " << rate << " -> " << target << std::endl;
+            rate = target;
+            encoder.requestRateLimit(rate);
+            holdWindows = 1;
+        }
+        else if (options.reduceFrameRate && decimation < options.maxFrameDecimation)
+        {
+            decimation = std::min(decimation * 2, options.maxFrameDecimation);
+            std::cout << "自适应码率: 码率已到下限, 帧率降为 1/" << decimation << std::endl;
+            encoder.setFrameDecimation(decimation);
+            holdWindows = 1;
+        }
+        return;
+    }
+
+    if (++clearWindows < options.probeIntervals)
+        return;
+    clearWindows = 0;
+
+    // 先恢复帧率, 再逐步回升码率
+    if (decimation > 1)
+    {
+        decimation /= 2;
+        std::cout << "自适应码率: 帧率恢复为 1/" << decimation << std::endl;
+        encoder.setFrameDecimation(decimation);
+    }
+    else if (rate < ceiling)
+    {
+        int64_t target = std::min(ceiling, static_cast<int64_t>(rate * options.stepUp) + 1);
+        std::cout << "自适应码率: 上调 " << rate << " -> " << target << std::endl;
+        rate = target;
+        encoder.requestRateLimit(rate);
+    }
+}
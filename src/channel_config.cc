@@ -0,0 +1,324 @@
+// channel_config.cc
+#include "channel_config.hh"
+#include "frame_processor.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+static std::string trim(const std::string &s)
+{
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos)
+        return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+static bool parseBool(const std::string &value)
+{
+    if (value == "1" || value == "true" || value == "yes" || value == "on")
+        return true;
+    if (value == "0" || value == "false" || value == "no" || value == "off")
+        return false;
+    throw std::invalid_argument(value);
+}
+
+static AVDiscard parseDiscard(const std::string &value)
+{
+    if (value == "none")
+        return AVDISCARD_NONE;
+    if (value == "default")
+        return AVDISCARD_DEFAULT;
+    if (value == "nonref")
+        return AVDISCARD_NONREF;
+    if (value == "bidir")
+        return AVDISCARD_BIDIR;
+    if (value == "nonintra")
+        return AVDISCARD_NONINTRA;
+    if (value == "nonkey")
+        return AVDISCARD_NONKEY;
+    if (value == "all")
+        return AVDISCARD_ALL;
+    throw std::invalid_argument(value);
+}
+
+static DecodeThreadType parseThreadType(const std::string &value)
+{
+    if (value == "auto")
+        return DecodeThreadType::Auto;
+    if (value == "frame")
+        return DecodeThreadType::Frame;
+    if (value == "slice")
+        return DecodeThreadType::Slice;
+    throw std::invalid_argument(value);
+}
+
+bool applyChannelOption(ChannelConfig &ch, const std::string &key, const std::string &value)
+{
+    if (key == "input")
+        ch.input = value;
+    else if (key == "output")
+    {
+        std::istringstream ss(value);
+        std::string prot, url;
+        if (!(ss >> prot >> url))
+            return false;
+        ch.outputs.emplace_back(prot, url);
+    }
+    else if (key == "mode")
+        ch.mode = value;
+    else if (key == "frame_rate")
+        ch.frameRate = std::stoi(value);
+    else if (key == "pace")
+        ch.pace = parseBool(value);
+    else if (key == "latency_budget_ms")
+        ch.latencyBudgetMs = std::stoi(value);
+    else if (key == "cpu_budget")
+        ch.cpuBudget = std::stod(value);
+    else if (key == "encoder_threads")
+        ch.encoderThreads = std::stoi(value);
+    else if (key == "decoder_threads")
+        ch.capture.decoderThreads = std::stoi(value);
+    else if (key == "decoder_thread_type")
+        ch.capture.threadType = parseThreadType(value);
+    else if (key == "low_delay")
+        ch.capture.lowDelay = parseBool(value);
+    else if (key == "skip_loop_filter")
+        ch.capture.skipLoopFilter = parseDiscard(value);
+    else if (key == "decoder")
+        ch.capture.decoderName = value;
+    else if (key == "probe_size")
+        ch.capture.probeSize = std::stoll(value);
+    else if (key == "analyze_duration_ms")
+        ch.capture.analyzeDurationMs = std::stoll(value);
+    else if (key == "param_cache_dir")
+        ch.capture.paramCacheDir = value;
+    else if (key == "encoder_profile")
+        return encoderProfileByName(value, ch.encoder);
+    else if (key == "encoder")
+    {
+        // 逗号分隔, 按顺序尝试, 前面的没有或打不开时用下一个
+        std::vector<std::string> encoders;
+        std::istringstream ss(value);
+        std::string name;
+        while (std::getline(ss, name, ','))
+        {
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t") + 1);
+            if (name.empty())
+                return false;
+            encoders.push_back(name);
+        }
+        if (encoders.empty())
+            return false;
+        ch.encoder.encoders = encoders;
+    }
+    else if (key == "bitrate")
+        ch.encoder.bitRate = std::stoll(value);
+    else if (key == "max_bitrate")
+        ch.encoder.maxRate = std::stoll(value);
+    else if (key == "vbv_seconds")
+        ch.encoder.vbvSeconds = std::stod(value);
+    else if (key == "gop_seconds")
+        ch.encoder.gopSeconds = std::stod(value);
+    else if (key == "bframes")
+        ch.encoder.maxBFrames = std::stoi(value);
+    else if (key == "lookahead")
+        ch.encoder.lookahead = std::stoi(value);
+    else if (key == "crf")
+        ch.encoder.crf = std::stoi(value);
+    else if (key == "preset")
+        ch.encoder.preset = value;
+    else if (key == "tune")
+        ch.encoder.tune = value;
+    else if (key == "sliced_threads")
+        ch.encoder.slicedThreads = parseBool(value);
+    else if (key == "intra_refresh")
+        ch.encoder.intraRefresh = parseBool(value);
+    else if (key == "adaptive_bitrate")
+        ch.adaptiveBitrate.enabled = parseBool(value);
+    else if (key == "min_bitrate")
+        ch.adaptiveBitrate.minBitRate = std::stoll(value);
+    else if (key == "abr_max_queue_seconds")
+        ch.adaptiveBitrate.maxQueueSeconds = std::stod(value);
+    else if (key == "abr_reduce_frame_rate")
+        ch.adaptiveBitrate.reduceFrameRate = parseBool(value);
+    else if (key == "reconnect_delay_ms")
+        ch.reconnect.initialDelayMs = std::stoi(value);
+    else if (key == "reconnect_max_delay_ms")
+        ch.reconnect.maxDelayMs = std::stoi(value);
+    else if (key == "reconnect_attempts")
+        ch.reconnect.maxAttempts = std::stoi(value);
+    else if (key == "io_open_timeout_ms")
+        ch.io.openMs = std::stoi(value);
+    else if (key == "io_read_timeout_ms")
+        ch.io.readMs = std::stoi(value);
+    else if (key == "io_write_timeout_ms")
+        ch.io.writeMs = std::stoi(value);
+    else if (key == "output_queue_max_bytes")
+        ch.outputQueue.maxBytes = std::stoull(value);
+    else if (key == "output_queue_max_seconds")
+        ch.outputQueue.maxSeconds = std::stod(value);
+    else if (key == "gop_cache_bytes")
+        ch.gopCacheBytes = std::stoull(value);
+    else if (key == "keyframe_min_interval_ms")
+        ch.keyframeMinIntervalMs = std::stoi(value);
+    else if (key == "process")
+    {
+        // 创建一次检查名字和参数, 运行时每路各自创建
+        if (!createFrameProcessor(value))
+            return false;
+        ch.processors.push_back(value);
+    }
+    else if (key == "process_threads")
+        ch.processThreads = std::stoi(value);
+    else if (key == "rendition")
+    {
+        std::istringstream ss(value);
+        std::string size, prot, url;
+        RenditionConfig rendition;
+        if (!(ss >> size >> rendition.profile.bitRate >> prot >> url) ||
+            std::sscanf(size.c_str(), "%dx%d", &rendition.width, &rendition.height) != 2 ||
+            rendition.width <= 0 || rendition.height <= 0 || rendition.profile.bitRate <= 0)
+            return false;
+        rendition.outputs.emplace_back(prot, url);
+        ch.renditions.push_back(rendition);
+    }
+    else if (key == "shm_name")
+        ch.capture.shmName = value;
+    else if (key == "shm_slots")
+        ch.capture.shmSlots = std::stoi(value);
+    else if (key == "record_format")
+    {
+        if (value != "fmp4" && value != "hls")
+            return false;
+        ch.record.format = value;
+    }
+    else if (key == "record_segment_seconds")
+        ch.record.segmentSeconds = std::stoi(value);
+    else if (key == "record_retention_hours")
+        ch.record.retentionHours = std::stoi(value);
+    else if (key == "record_buffer_kb")
+        ch.record.bufferKb = std::stoi(value);
+    else
+        return false;
+    return true;
+}
+
+bool applyProcessOption(ProcessConfig &config, const std::string &key, const std::string &value)
+{
+    if (key == "workers")
+        config.workers = std::stoi(value);
+    else if (key == "metrics_port")
+        config.metrics.httpPort = std::stoi(value);
+    else if (key == "metrics_socket")
+        config.metrics.unixSocket = value;
+    else if (key == "metrics_json")
+        config.metrics.jsonPath = value;
+    else if (key == "metrics_interval")
+        config.metrics.jsonIntervalSeconds = std::stoi(value);
+    else if (key == "control_socket")
+        config.controlSocket = value;
+    else
+        return false;
+    return true;
+}
+
+int resolveFrameRate(const ChannelConfig &ch, AVRational inputRate)
+{
+    if (ch.frameRate > 0)
+        return ch.frameRate;
+    if (inputRate.num > 0 && inputRate.den > 0)
+        return std::max(1, static_cast<int>(std::lround(av_q2d(inputRate))));
+    return 25;
+}
+
+std::vector<RenditionConfig> resolveRenditions(const ChannelConfig &ch)
+{
+    std::vector<RenditionConfig> result;
+    for (const auto &r : ch.renditions)
+    {
+        RenditionConfig rendition = r;
+        rendition.profile = ch.encoder;
+        rendition.profile.bitRate = r.profile.bitRate;
+        if (ch.encoder.maxRate > 0)
+            rendition.profile.maxRate = ch.encoder.bitRate > 0
+                                            ? r.profile.bitRate * ch.encoder.maxRate / ch.encoder.bitRate
+                                            : r.profile.bitRate;
+        result.push_back(rendition);
+    }
+    return result;
+}
+
+bool loadProcessConfig(const std::string &path, ProcessConfig &config)
+{
+    std::ifstream in(path);
+    if (!in)
+    {
+        std::cerr << "无法打开配置文件: " << path << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNo = 0;
+    ChannelConfig *current = nullptr;
+    while (std::getline(in, line))
+    {
+        lineNo++;
+        line = trim(line);
+        if (line.empty() || line[0] == '#' || line[0] == ';')
+            continue;
+
+        if (line.front() == '[' && line.back() == ']')
+        {
+            config.channels.emplace_back();
+            current = &config.channels.back();
+            current->name = trim(line.substr(1, line.size() - 2));
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos)
+        {
+            std::cerr << "配置格式错误 (" << path << ":" << lineNo << "): " << line << std::endl;
+            return false;
+        }
+        std::string key = trim(line.substr(0, eq));
+        std::string value = trim(line.substr(eq + 1));
+
+        bool ok = true;
+        try
+        {
+            if (!current)
+                ok = applyProcessOption(config, key, value);
+            else
+            {
+                ok = applyChannelOption(*current, key, value);
+            }
+        }
+        catch (const std::exception &)
+        {
+            ok = false;
+        }
+        if (!ok)
+        {
+            std::cerr << "无效的配置项 (" << path << ":" << lineNo << "): " << line << std::endl;
+            return false;
+        }
+    }
+
+    for (const auto &ch : config.channels)
+    {
+        if (ch.input.empty() || ch.outputs.empty())
+        {
+            std::cerr << "通道 " << ch.name << " 缺少 input 或 output" << std::endl;
+            return false;
+        }
+    }
+    return !config.channels.empty();
+}
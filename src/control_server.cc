@@ -0,0 +1,160 @@
+// control_server.cc
+#include "control_server.hh"
+#include "local_socket.hh"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <iostream>
+#include <sstream>
+
+ControlServer::ControlServer(const std::string &path) : socketPath(path)
+{
+}
+
+ControlServer::~ControlServer()
+{
+    stop();
+}
+
+void ControlServer::addStream(const std::string &name, std::function<void()> requestKeyframe,
+                              std::function<bool(const std::string &, const std::string &)> attachOutput)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    keyframeHandlers[name] = std::move(requestKeyframe);
+    if (attachOutput)
+        outputHandlers[name] = std::move(attachOutput);
+}
+
+void ControlServer::removeStream(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    keyframeHandlers.erase(name);
+    outputHandlers.erase(name);
+}
+
+bool ControlServer::listenUnix()
+{
+    fd = LocalSocket::listenUnix(socketPath, "控制");
+    if (fd < 0)
+        return false;
+    std::cout << "控制接口: unix:" << socketPath << std::endl;
+    return true;
+}
+
+bool ControlServer::start()
+{
+    if (socketPath.empty() || !listenUnix())
+        return false;
+    stopping = false;
+    serverThread = std::thread(&ControlServer::serveLoop, this);
+    return true;
+}
+
+void ControlServer::stop()
+{
+    stopping = true;
+    if (serverThread.joinable())
+        serverThread.join();
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+        ::unlink(socketPath.c_str());
+    }
+}
+
+void ControlServer::serveLoop()
+{
+    while (!stopping)
+    {
+        // 定时醒来检查是否需要退出
+        pollfd pfd = {fd, POLLIN, 0};
+        if (::poll(&pfd, 1, 200) <= 0 || !(pfd.revents & POLLIN))
+            continue;
+        int client = ::accept(fd, nullptr, nullptr);
+        if (client < 0)
+            continue;
+
+        timeval timeout = {1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        serveClient(client);
+        ::close(client);
+    }
+}
+
+void ControlServer::serveClient(int client)
+{
+    // 逐行处理, 客户端关闭写端或超时后结束
+    std::string buffer;
+    char buf[1024];
+    while (!stopping && buffer.size() < 8192)
+    {
+        ssize_t n = ::recv(client, buf, sizeof(buf), 0);
+        if (n <= 0)
+            break;
+        buffer.append(buf, static_cast<size_t>(n));
+
+        size_t newline;
+        while ((newline = buffer.find('\n')) != std::string::npos)
+        {
+            std::string line = buffer.substr(0, newline);
+            buffer.erase(0, newline + 1);
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty())
+                LocalSocket::writeAll(client, handle(line) + "\n");
+        }
+    }
+    if (!buffer.empty())
+        LocalSocket::writeAll(client, handle(buffer) + "\n");
+}
+
+std::string ControlServer::handle(const std::string &line)
+{
+    std::istringstream ss(line);
+    std::string command, name;
+    ss >> command >> name;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (command == "keyframe")
+    {
+        if (name.empty())
+        {
+            for (auto &handler : keyframeHandlers)
+                handler.second();
+            std::cout << "控制接口: 请求所有流的关键帧" << std::endl;
+            return "ok " + std::to_string(keyframeHandlers.size());
+        }
+        auto it = keyframeHandlers.find(name);
+        if (it == keyframeHandlers.end())
+            return "error unknown stream: " + name;
+        it->second();
+        std::cout << "控制接口: 请求关键帧 [" << name << "]" << std::endl;
+        return "ok 1";
+    }
+    if (command == "add_output")
+    {
+        std::string prot, url;
+        ss >> prot >> url;
+        if (url.empty())
+            return "error usage: add_output <stream> <protocol> <url>";
+        auto it = outputHandlers.find(name);
+        if (it == outputHandlers.end())
+            return "error unknown stream: " + name;
+        if (!it->second(prot, url))
+            return "error failed to open output: " + url;
+        std::cout << "控制接口: 接入输出 [" << name << "] " << prot << " " << url << std::endl;
+        return "ok 1";
+    }
+    if (command == "streams")
+    {
+        std::string names;
+        for (const auto &handler : keyframeHandlers)
+            names += (names.empty() ? "" : " ") + handler.first;
+        return "ok " + names;
+    }
+    return "error unknown command: " + command;
+}
@@ -2,8 +2,33 @@
 #include "ffmpeg_capture.hh"
 
 #include "ffmpeg_metwork_init.hh"
+#include "stream_param_cache.hh"
 
-FFmpegCapture::FFmpegCapture(const std::string &url) : rtspUrl(url), width(0), height(0)
+#include <chrono>
+#include <cstring>
+
+static int64_t elapsedNs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool validFrameRate(AVRational rate)
+{
+    // 部分封装器会给出 90000 或 1000 之类的时间基作为帧率, 视为无效
+    return rate.num > 0 && rate.den > 0 && av_q2d(rate) <= 1000;
+}
+
+static const char *threadTypeName(int type)
+{
+    if (type & FF_THREAD_FRAME)
+        return "frame";
+    if (type & FF_THREAD_SLICE)
+        return "slice";
+    return "none";
+}
+
+FFmpegCapture::FFmpegCapture(const std::string &url, const CaptureOptions &opts)
+    : rtspUrl(url), width(0), height(0), options(opts)
 {
 }
 
@@ -15,27 +40,54 @@ FFmpegCapture::~FFmpegCapture()
 bool FFmpegCapture::open()
 {
     FFmpegNetworkInitializer::init();
+    if (metrics)
+        metrics->beginStartup();
+    paramsStale = false;
     AVDictionary *options = NULL;
 
     av_dict_set(&options, "buffer_size", "4096000", 0); // 设置缓存大小,1080p可将值跳到最大
     av_dict_set(&options, "rtsp_transport", "tcp", 0);  // 以tcp的方式打开
-    av_dict_set(&options, "stimeout", "10000000", 0);   // 设置超时断开链接时间，单位us
     av_dict_set(&options, "max_delay", "500000", 0);    // 设置最大时延
-
-    // 打开RTSP流
-    if (avformat_open_input(&formatContext, rtspUrl.c_str(), nullptr, &options) < 0)
+    // 限制探测的数据量和时长, 默认值在部分摄像头上需要数秒
+    if (this->options.probeSize > 0)
+        av_dict_set_int(&options, "probesize", this->options.probeSize, 0);
+    if (this->options.analyzeDurationMs > 0)
+        av_dict_set_int(&options, "analyzeduration", this->options.analyzeDurationMs * 1000, 0);
+
+    // 超时由中断回调控制, 不依赖各协议的超时选项(stimeout 在新版本中已改名); 打开和探测共用一个时限
+    formatContext = avformat_alloc_context();
+    if (!formatContext)
     {
-        std::cerr << "无法打开RTSP流" << std::endl;
+        av_dict_free(&options);
+        std::cerr << "无法分配输入上下文" << std::endl;
         return false;
     }
+    formatContext->interrupt_callback = deadline.callback();
+    IoDeadlineScope openDeadline(deadline, timeouts.openMs);
 
-    // 读取流信息
-    if (avformat_find_stream_info(formatContext, nullptr) < 0)
+    // 打开RTSP流, 失败时 formatContext 由 FFmpeg 释放
+    int ret = avformat_open_input(&formatContext, rtspUrl.c_str(), nullptr, &options);
+    av_dict_free(&options);
+    if (ret < 0)
     {
-        std::cerr << "无法读取流信息" << std::endl;
+        std::cerr << "无法打开RTSP流" << (deadline.timedOut() ? " (超时)" : "") << std::endl;
         return false;
     }
 
+    // 读取流信息; 有缓存的参数时跳过探测
+    StreamParamCache paramCache(this->options.paramCacheDir);
+    paramsFromCache = paramCache.enabled() && applyCachedParams(paramCache);
+    if (!paramsFromCache)
+    {
+        auto probeStart = std::chrono::steady_clock::now();
+        if (avformat_find_stream_info(formatContext, nullptr) < 0)
+        {
+            std::cerr << "无法读取流信息" << (deadline.timedOut() ? " (超时)" : "") << std::endl;
+            return false;
+        }
+        std::cout << "探测流信息耗时: " << elapsedNs(probeStart) / 1000000 << "ms" << std::endl;
+    }
+
     // 查找视频流
     videoStreamIndex = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
     if (videoStreamIndex < 0)
@@ -45,8 +97,106 @@ bool FFmpegCapture::open()
     }
     videoStream = formatContext->streams[videoStreamIndex];
 
-    // 查找解码器
-    const AVCodec *codec = avcodec_find_decoder(videoStream->codecpar->codec_id);
+    if (!openDecoder())
+        return false;
+
+    // 分配帧和包
+    frame = av_frame_alloc();
+    packet = av_packet_alloc();
+    if (!frame || !packet)
+    {
+        std::cerr << "无法分配帧或包" << std::endl;
+        return false;
+    }
+
+    // RGB 转换按需进行, SWS 上下文在第一次转换时按实际像素格式创建
+    width = codecContext->width;
+    height = codecContext->height;
+
+    // 帧率取自输入流, 可变帧率的流以 avg_frame_rate 为准
+    frameRate = AVRational{0, 1};
+    if (validFrameRate(videoStream->avg_frame_rate))
+        frameRate = videoStream->avg_frame_rate;
+    else if (validFrameRate(videoStream->r_frame_rate))
+        frameRate = videoStream->r_frame_rate;
+    live = !formatContext->pb || !(formatContext->pb->seekable & AVIO_SEEKABLE_NORMAL);
+    if (paramCache.enabled() && !paramsFromCache)
+        paramCache.save(rtspUrl, videoStream->codecpar, frameRate);
+
+    std::cout << "拉流初始化成功: " << width << "x" << height
+              << ", 像素格式=" << av_get_pix_fmt_name(codecContext->pix_fmt)
+              << ", 帧率=" << (frameRate.num ? av_q2d(frameRate) : 0)
+              << (live ? ", 实时流" : ", 文件") << std::endl;
+    isOpened = true;
+    return true;
+}
+
+bool FFmpegCapture::applyCachedParams(const StreamParamCache &cache)
+{
+    int index = av_find_best_stream(formatContext, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    if (index < 0)
+        return false;
+    AVStream *stream = formatContext->streams[index];
+
+    AVCodecParameters *cached = avcodec_parameters_alloc();
+    AVRational rate = {0, 1};
+    bool ok = cached && cache.load(rtspUrl, cached, rate);
+
+    // 打开时已知的编码或 extradata(如 RTSP 的 SDP)与缓存不一致, 说明码流已变化, 重新探测
+    const AVCodecParameters *par = stream->codecpar;
+    if (ok && par->codec_id != AV_CODEC_ID_NONE && par->codec_id != cached->codec_id)
+        ok = false;
+    if (ok && par->extradata_size > 0 &&
+        (par->extradata_size != cached->extradata_size ||
+         std::memcmp(par->extradata, cached->extradata, par->extradata_size) != 0))
+        ok = false;
+    if (ok)
+        ok = avcodec_parameters_copy(stream->codecpar, cached) >= 0;
+    if (ok && validFrameRate(rate))
+        stream->avg_frame_rate = stream->r_frame_rate = rate;
+    avcodec_parameters_free(&cached);
+
+    if (ok)
+        std::cout << "使用缓存的流参数, 跳过探测" << std::endl;
+    return ok;
+}
+
+bool FFmpegCapture::checkCachedParams(const AVFrame *decoded)
+{
+    // 只检查第一帧
+    paramsFromCache = false;
+    if (decoded->width == width && decoded->height == height)
+        return true;
+
+    std::cerr << "缓存的流参数与码流不符 (" << width << "x" << height << " -> " << decoded->width << "x"
+              << decoded->height << "), 删除缓存并重新打开" << std::endl;
+    StreamParamCache(options.paramCacheDir).remove(rtspUrl);
+    paramsStale = true;
+    return false;
+}
+
+inline std::string avErrorString(int errnum)
+{
+    char buf[AV_ERROR_MAX_STRING_SIZE];
+    av_strerror(errnum, buf, sizeof(buf));
+    return std::string(buf);
+}
+
+bool FFmpegCapture::openDecoder()
+{
+    // 查找解码器, 可指定具体实现
+    const AVCodec *codec = nullptr;
+    if (!options.decoderName.empty())
+    {
+        codec = avcodec_find_decoder_by_name(options.decoderName.c_str());
+        if (!codec || codec->id != videoStream->codecpar->codec_id)
+        {
+            std::cerr << "指定的解码器不可用: " << options.decoderName << ", 使用默认解码器" << std::endl;
+            codec = nullptr;
+        }
+    }
+    if (!codec)
+        codec = avcodec_find_decoder(videoStream->codecpar->codec_id);
     if (!codec)
     {
         std::cerr << "未找到合适的解码器" << std::endl;
@@ -67,6 +217,27 @@ bool FFmpegCapture::open()
         std::cerr << "无法复制流参数到解码器上下文" << std::endl;
         return false;
     }
+    codecContext->pkt_timebase = videoStream->time_base;
+
+    // 解码线程数, 0 表示由 FFmpeg 按CPU核数决定
+    if (options.decoderThreads >= 0)
+        codecContext->thread_count = options.decoderThreads;
+    switch (options.threadType)
+    {
+    case DecodeThreadType::Frame:
+        codecContext->thread_type = FF_THREAD_FRAME;
+        break;
+    case DecodeThreadType::Slice:
+        codecContext->thread_type = FF_THREAD_SLICE;
+        break;
+    case DecodeThreadType::Auto:
+        codecContext->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+        break;
+    }
+    if (options.lowDelay)
+        codecContext->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    codecContext->skip_loop_filter = options.skipLoopFilter;
+    codecContext->skip_frame = skipFrame;
 
     // 打开解码器
     if (avcodec_open2(codecContext, codec, nullptr) < 0)
@@ -75,47 +246,76 @@ bool FFmpegCapture::open()
         return false;
     }
 
-    // 分配帧和包
-    frame = av_frame_alloc();
-    packet = av_packet_alloc();
-    if (!frame || !packet)
+    // 输出实际生效的解码配置
+    std::cout << "解码器: " << codec->name
+              << ", 线程数=" << codecContext->thread_count
+              << ", 线程类型=" << threadTypeName(codecContext->active_thread_type)
+              << ", 低延迟=" << ((codecContext->flags & AV_CODEC_FLAG_LOW_DELAY) ? "是" : "否")
+              << ", skip_loop_filter=" << static_cast<int>(codecContext->skip_loop_filter) << std::endl;
+    return true;
+}
+
+void FFmpegCapture::setSkipFrame(AVDiscard discard)
+{
+    skipFrame = discard;
+    if (codecContext)
+        codecContext->skip_frame = discard;
+}
+
+void FFmpegCapture::countPacket(int64_t ns)
+{
+    statPackets++;
+    statDecodeNs += ns;
+    if (metrics)
+        metrics->record(Stage::DecodeSend, ns);
+    if (skipFrame != AVDISCARD_DEFAULT)
+        statSkipped++;
+}
+
+void FFmpegCapture::countFrame(int64_t ns)
+{
+    uint64_t frames = ++statFrames;
+    statDecodeNs += ns;
+    if (metrics)
     {
-        std::cerr << "无法分配帧或包" << std::endl;
-        return false;
+        metrics->record(Stage::DecodeReceive, ns);
+        metrics->framesDecoded++;
     }
-
-    // 初始化SWS上下文（如果需要格式转换）
-    width = codecContext->width;
-    height = codecContext->height;
-    swsContext = sws_getContext(
-        width, height, AV_PIX_FMT_YUV420P,
-        // width, height, codecContext->pix_fmt,
-        width, height, AV_PIX_FMT_RGB24, // 转换为RGB888
-        SWS_BILINEAR, nullptr, nullptr, nullptr);
-    if (!swsContext)
+    if (skipFrame != AVDISCARD_DEFAULT && statSkipped > 0)
+        statSkipped--;
+
+    // 已送入但尚未输出的包数, 即解码器内部的积压深度
+    uint64_t packets = statPackets;
+    uint64_t depth = packets > frames ? packets - frames : 0;
+    uint64_t maxDepth = statMaxDepth;
+    while (depth > maxDepth && !statMaxDepth.compare_exchange_weak(maxDepth, depth))
     {
-        std::cerr << "无法初始化SWS上下文" << std::endl;
-        return false;
     }
+}
 
-    std::cout << "SWS上下文创建成功: "
-              << "输入=" << av_get_pix_fmt_name(codecContext->pix_fmt)
-              << ", 输出=" << av_get_pix_fmt_name(AV_PIX_FMT_RGB24)
-              << ", 尺寸=" << width << "x" << height << std::endl;
-
-    std::cout << "拉流初始化成功: " << width << "x" << height << std::endl;
-    isOpened = true;
-    return true;
+void FFmpegCapture::publishFrame(const AVFrame *decoded)
+{
+    if (options.shmName.empty())
+        return;
+    // 每路只解码一次, 本地分析进程从共享内存读取, 不再各自拉流解码
+    if (!shmPublisher)
+        shmPublisher.reset(new ShmFramePublisher(options.shmName, options.shmSlots));
+    StageTimer timer(metrics, Stage::ShmPublish);
+    shmPublisher->publish(decoded, getTimeBase());
 }
 
-inline std::string avErrorString(int errnum)
+DecodeStats FFmpegCapture::getDecodeStats() const
 {
-    char buf[AV_ERROR_MAX_STRING_SIZE];
-    av_strerror(errnum, buf, sizeof(buf));
-    return std::string(buf);
+    DecodeStats stats;
+    stats.packets = statPackets;
+    stats.frames = statFrames;
+    stats.decodeSeconds = statDecodeNs / 1e9;
+    stats.maxDepth = statMaxDepth;
+    stats.skipped = statSkipped;
+    return stats;
 }
 
-bool FFmpegCapture::readFrame(cv::Mat &outFrame)
+bool FFmpegCapture::decodeFrame()
 {
     if (!isOpened)
         return false;
@@ -123,9 +323,16 @@ bool FFmpegCapture::readFrame(cv::Mat &outFrame)
     while (true)
     {
         // 1. 尝试从解码器获取帧
+        auto receiveStart = std::chrono::steady_clock::now();
         int ret = avcodec_receive_frame(codecContext, frame);
         if (ret == 0)
         {
+            countFrame(elapsedNs(receiveStart));
+            if (paramsFromCache && !checkCachedParams(frame))
+                return false;
+            if (frame->pts == AV_NOPTS_VALUE)
+                frame->pts = frame->best_effort_timestamp;
+            publishFrame(frame);
             break; // 成功获取帧
         }
         else if (ret != AVERROR(EAGAIN))
@@ -143,7 +350,7 @@ bool FFmpegCapture::readFrame(cv::Mat &outFrame)
             av_packet_unref(packet); // 清理前一个包
 
             // 读取网络数据包
-            ret = av_read_frame(formatContext, packet);
+            ret = readInputPacket(packet);
             if (ret < 0)
             {
                 if (ret == AVERROR(EAGAIN))
@@ -155,7 +362,9 @@ bool FFmpegCapture::readFrame(cv::Mat &outFrame)
             // 3. 只处理视频流
             if (packet->stream_index == videoStreamIndex)
             {
+                auto sendStart = std::chrono::steady_clock::now();
                 ret = avcodec_send_packet(codecContext, packet);
+                countPacket(elapsedNs(sendStart));
                 av_packet_unref(packet); // 立即释放
                 if (ret < 0)
                 {
@@ -168,6 +377,14 @@ bool FFmpegCapture::readFrame(cv::Mat &outFrame)
         }
     }
 
+    return true;
+}
+
+bool FFmpegCapture::readFrame(cv::Mat &outFrame)
+{
+    if (!decodeFrame())
+        return false;
+
     // 4. 准备输出缓冲区 (优化内存复用)
     if (outFrame.empty() ||
         outFrame.cols != width ||
@@ -180,24 +397,121 @@ bool FFmpegCapture::readFrame(cv::Mat &outFrame)
     // 5. 转换YUV->RGB
     uint8_t *dstData[1] = {outFrame.data};
     int dstLinesize[1] = {static_cast<int>(outFrame.step)};
-    sws_scale(swsContext, frame->data, frame->linesize,
-              0, height, dstData, dstLinesize);
+    StageTimer timer(metrics, Stage::CaptureScale);
+    return rgbConverter.convert(frame, dstData, dstLinesize, AV_PIX_FMT_RGB24, width, height);
+}
+
+bool FFmpegCapture::readFrame(AVFrame *outFrame)
+{
+    if (!outFrame || !decodeFrame())
+        return false;
+
+    // 转换YUV->RGB, 直接写入帧池中的缓冲区, 避免每帧分配内存
+    StageTimer timer(metrics, Stage::CaptureScale);
+    return rgbConverter.convert(frame, outFrame, AV_PIX_FMT_RGB24, width, height);
+}
 
+bool FFmpegCapture::readNativeFrame(AVFrame *outFrame)
+{
+    if (!outFrame || !decodeFrame())
+        return false;
+
+    // 直接转移解码器输出的引用, 不转换不拷贝
+    av_frame_unref(outFrame);
+    av_frame_move_ref(outFrame, frame);
     return true;
 }
 
-void FFmpegCapture::close()
+bool FFmpegCapture::sendPacket(const AVPacket *inPacket)
 {
     if (!isOpened)
-        return;
+        return false;
 
-    // 释放资源
-    if (swsContext)
+    auto sendStart = std::chrono::steady_clock::now();
+    int ret = avcodec_send_packet(codecContext, inPacket);
+    if (inPacket)
+        countPacket(elapsedNs(sendStart));
+    if (ret < 0 && ret != AVERROR(EAGAIN) && !(ret == AVERROR_EOF && !inPacket))
     {
-        sws_freeContext(swsContext);
-        swsContext = nullptr;
+        std::cerr << "发送包失败: " << avErrorString(ret) << std::endl;
+        return false;
     }
+    return true;
+}
+
+bool FFmpegCapture::receiveFrame(AVFrame *outFrame, bool &gotFrame)
+{
+    gotFrame = false;
+    if (!isOpened || !outFrame)
+        return false;
 
+    auto receiveStart = std::chrono::steady_clock::now();
+    int ret = avcodec_receive_frame(codecContext, outFrame);
+    if (ret == AVERROR(EAGAIN))
+        return true; // 需要更多数据包
+    if (ret < 0)
+    {
+        if (ret != AVERROR_EOF)
+            std::cerr << "解码错误: " << avErrorString(ret) << std::endl;
+        return false;
+    }
+
+    countFrame(elapsedNs(receiveStart));
+    if (paramsFromCache && !checkCachedParams(outFrame))
+    {
+        av_frame_unref(outFrame);
+        return false;
+    }
+    if (outFrame->pts == AV_NOPTS_VALUE)
+        outFrame->pts = outFrame->best_effort_timestamp;
+    publishFrame(outFrame);
+    gotFrame = true;
+    return true;
+}
+
+int FFmpegCapture::readInputPacket(AVPacket *pkt)
+{
+    // 缓存的参数已失效, 让调用者走重连流程重新探测
+    if (paramsStale)
+        return AVERROR_INVALIDDATA;
+    StageTimer timer(metrics, Stage::Read);
+    IoDeadlineScope readDeadline(deadline, timeouts.readMs);
+    int ret = av_read_frame(formatContext, pkt);
+    // 超时报告为 ETIMEDOUT, 与取消(AVERROR_EXIT)区分
+    if (ret < 0 && deadline.timedOut())
+        return AVERROR(ETIMEDOUT);
+    return ret;
+}
+
+bool FFmpegCapture::readPacket(AVPacket *outPacket)
+{
+    if (!isOpened || !outPacket)
+        return false;
+
+    while (true)
+    {
+        av_packet_unref(outPacket);
+
+        // 读取网络数据包, 不经过解码器
+        int ret = readInputPacket(outPacket);
+        if (ret < 0)
+        {
+            if (ret == AVERROR(EAGAIN))
+                continue;
+            std::cerr << "读取失败: " << avErrorString(ret) << std::endl;
+            return false;
+        }
+
+        // 只返回视频流的包
+        if (outPacket->stream_index == videoStreamIndex)
+            return true;
+    }
+}
+
+void FFmpegCapture::close()
+{
+    // 打开失败时也可能留下部分资源, 不按 isOpened 判断, 逐项释放
+    // 释放资源
     if (packet)
     {
         av_packet_free(&packet);
@@ -219,6 +533,8 @@ void FFmpegCapture::close()
 
     if (formatContext)
     {
+        // RTSP 关闭时会发送 TEARDOWN, 对端无响应时同样限时
+        IoDeadlineScope closeDeadline(deadline, timeouts.openMs);
         avformat_close_input(&formatContext);
         formatContext = nullptr;
     }
@@ -228,3 +544,37 @@ void FFmpegCapture::close()
 
     isOpened = false;
 }
+
+bool FFmpegCapture::reconnect(const std::atomic<bool> &cancel, std::mutex *decodeLock)
+{
+    reconnecting = true;
+    bool ok = false;
+    while (!cancel && !deadline.isCancelled() && !IoDeadline::isShutdown())
+    {
+        if (backoff.exhausted())
+        {
+            std::cerr << "重连失败 " << backoff.attempts() << " 次, 放弃: " << rtspUrl << std::endl;
+            break;
+        }
+        // 退避等待期间不持有解码锁, 其他线程可以继续处理已读到的包
+        if (!backoff.wait(cancel))
+            break;
+        std::cerr << "正在重新连接输入 (第 " << backoff.attempts() << " 次)..." << std::endl;
+        if (metrics)
+            metrics->reconnects++;
+
+        std::unique_lock<std::mutex> lock;
+        if (decodeLock)
+            lock = std::unique_lock<std::mutex>(*decodeLock);
+        close();
+        if (open())
+        {
+            std::cout << "输入已恢复: " << rtspUrl << std::endl;
+            backoff.reset();
+            ok = true;
+            break;
+        }
+    }
+    reconnecting = false;
+    return ok;
+}
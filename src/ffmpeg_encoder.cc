@@ -0,0 +1,597 @@
+// ffmpeg_encoder.cc
+#include "ffmpeg_encoder.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+bool encoderProfileByName(const std::string &name, EncoderProfile &profile)
+{
+    EncoderProfile p;
+    p.name = name;
+    p.encoders = profile.encoders; // 编码器选择与档位无关, 写在档位之前也保留
+    if (name == "ultra-low-latency")
+    {
+        // 无 B 帧、无 lookahead、片级线程, 编码器不缓存帧; 单帧 VBV 让每帧大小接近平均值
+        p.preset = "superfast";
+        p.tune = "zerolatency";
+        p.maxBFrames = 0;
+        p.lookahead = 0;
+        p.slicedThreads = true;
+        p.crf = -1;
+        p.bitRate = 2048000;
+        p.maxRate = 2048000;
+        p.vbvSeconds = 0;
+        p.gopSeconds = 1.0;
+    }
+    else if (name == "balanced")
+    {
+        // 保持原有的默认参数
+    }
+    else if (name == "archival")
+    {
+        // 录制存档: 画质和压缩率优先, 不限制峰值码率
+        p.preset = "slow";
+        p.maxBFrames = 3;
+        p.lookahead = 40;
+        p.crf = 20;
+        p.bitRate = 0;
+        p.maxRate = 0;
+        p.gopSeconds = 4.0;
+    }
+    else
+    {
+        return false;
+    }
+    profile = p;
+    return true;
+}
+
+FFmpegEncoder::FFmpegEncoder(int w, int h, int fr)
+    : width(w), height(h), frameRate(fr)
+{
+}
+
+FFmpegEncoder::~FFmpegEncoder()
+{
+    close();
+}
+
+// 未指定编码器时的候选: 优先 libx264, 其次本机 FFmpeg 中任意 H.264 编码器
+static const char *const DefaultEncoders[] = {"libx264", "h264"};
+
+// 先按编码器名(libx264/libx265/libopenh264/libsvtav1/mpeg4 等)查找, 再按编码格式名(h264/hevc/av1)取该格式的默认编码器
+static const AVCodec *findEncoder(const std::string &name)
+{
+    const AVCodec *found = avcodec_find_encoder_by_name(name.c_str());
+    if (!found)
+    {
+        const AVCodecDescriptor *desc = avcodec_descriptor_get_by_name(name.c_str());
+        if (desc)
+            found = avcodec_find_encoder(desc->id);
+    }
+    return found && found->type == AVMEDIA_TYPE_VIDEO ? found : nullptr;
+}
+
+// 编码器的私有选项, 没有时返回空
+static const AVOption *findOption(const AVCodec *codec, const char *name)
+{
+    if (!codec->priv_class)
+        return nullptr;
+    return av_opt_find(const_cast<AVClass **>(&codec->priv_class), name, nullptr, 0, AV_OPT_SEARCH_FAKE_OBJ);
+}
+
+// 数字 preset(libsvtav1 等, 越大越快)按 x264 的名字换算, 已是数字时原样返回
+static std::string numericPreset(const std::string &preset)
+{
+    static const std::pair<const char *, int> table[] = {
+        {"ultrafast", 12}, {"superfast", 11}, {"veryfast", 10}, {"faster", 9}, {"fast", 8},
+        {"medium", 7}, {"slow", 5}, {"slower", 4}, {"veryslow", 2}, {"placebo", 0}};
+    for (const auto &entry : table)
+    {
+        if (preset == entry.first)
+            return std::to_string(entry.second);
+    }
+    return preset;
+}
+
+bool FFmpegEncoder::open(const AVCodec *candidate)
+{
+    // 创建编码器上下文
+    codecContext = avcodec_alloc_context3(candidate);
+    if (!codecContext)
+    {
+        std::cerr << "无法分配编码器上下文" << std::endl;
+        return false;
+    }
+
+    // 设置编码器参数
+    codecContext->codec_id = candidate->id;
+    codecContext->codec_type = AVMEDIA_TYPE_VIDEO;
+    codecContext->pix_fmt = AV_PIX_FMT_YUV420P;
+    codecContext->width = width;
+    codecContext->height = height;
+    // 有源时间戳时沿用输入时间基, 否则按帧序号计时
+    codecContext->time_base = inputTimeBase.num > 0 ? inputTimeBase : AVRational{1, frameRate};
+    codecContext->framerate = {frameRate, 1};
+    // 设置目标码率
+    if (profile.bitRate > 0)
+        codecContext->bit_rate = profile.bitRate;
+    // 设置最大码率和缓冲区大小: 缓冲区越小每帧大小越平稳, 网络上的排队延迟越低
+    if (profile.maxRate > 0)
+    {
+        codecContext->rc_max_rate = profile.maxRate;
+        double vbvSeconds = profile.vbvSeconds > 0 ? profile.vbvSeconds : 1.0 / frameRate;
+        codecContext->rc_buffer_size = static_cast<int>(profile.maxRate * vbvSeconds);
+    }
+    codecContext->gop_size = std::max(1, static_cast<int>(std::lround(profile.gopSeconds * frameRate)));
+    codecContext->max_b_frames = profile.maxBFrames;
+    // 强制第一帧为关键帧
+    codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    // 多路共用进程时限制每路编码线程, 避免 路数 x 编码线程 超额占用CPU
+    if (threadCount >= 0)
+        codecContext->thread_count = threadCount;
+    codecContext->thread_type = profile.slicedThreads ? FF_THREAD_SLICE : FF_THREAD_FRAME;
+
+    // 设置编码器选项: 只设置该编码器有的选项, 没有的列出来, 换用其他编码器时一目了然
+    AVDictionary *options = nullptr;
+    std::string skipped;
+    auto setOption = [&](const char *name, const std::string &value)
+    {
+        const AVOption *option = findOption(candidate, name);
+        if (!option)
+        {
+            skipped += skipped.empty() ? name : std::string(", ") + name;
+            return false;
+        }
+        // libsvtav1 的 preset 是数字
+        std::string v = option->type == AV_OPT_TYPE_INT && std::string(name) == "preset" ? numericPreset(value) : value;
+        av_dict_set(&options, name, v.c_str(), 0);
+        return true;
+    };
+    // libx265 和 libsvtav1 用自己的线程池, 线程数、lookahead 和场景切换通过各自的参数串设置
+    bool x265 = findOption(candidate, "x265-params") != nullptr;
+    bool svtav1 = findOption(candidate, "svtav1-params") != nullptr;
+    setOption("preset", profile.preset);
+    if (!profile.tune.empty())
+        setOption("tune", profile.tune);
+    if (profile.crf >= 0 && !setOption("crf", std::to_string(profile.crf)) && profile.bitRate <= 0)
+    {
+        // 不支持 CRF 的编码器(libopenh264/mpeg4 等)只能按码率编码, 没有目标码率时取最大码率
+        codecContext->bit_rate = profile.maxRate > 0 ? profile.maxRate : 2048000;
+        std::cerr << "编码器 " << candidate->name << " 不支持 CRF, 按码率 " << codecContext->bit_rate << " 编码"
+                  << std::endl;
+    }
+    if (profile.lookahead >= 0 && !x265 && !svtav1)
+        setOption("rc-lookahead", std::to_string(profile.lookahead));
+    if (profile.intraRefresh && !fixedGop)
+        setOption("intra-refresh", "1");
+    if (fixedGop && !x265 && !svtav1)
+        setOption("sc_threshold", "0");
+    // 请求的关键帧编为 IDR, 下游可从该帧开始解码; 其他编码器强制的 I 帧本身就是 IDR
+    if (findOption(candidate, "forced-idr"))
+        setOption("forced-idr", "1");
+
+    std::string params;
+    auto addParam = [&params](const std::string &param)
+    {
+        params += params.empty() ? param : ":" + param;
+    };
+    if (x265)
+    {
+        if (fixedGop)
+            addParam("scenecut=0");
+        if (profile.lookahead >= 0)
+            addParam("rc-lookahead=" + std::to_string(profile.lookahead));
+        // x265 没有片级线程, 帧级线程数为 1 时不增加延迟
+        if (profile.slicedThreads)
+            addParam("frame-threads=1");
+        if (threadCount > 0)
+            addParam("pools=" + std::to_string(threadCount));
+        if (!params.empty())
+            setOption("x265-params", params);
+    }
+    else if (svtav1)
+    {
+        if (fixedGop)
+            addParam("scd=0");
+        if (profile.lookahead >= 0)
+            addParam("lookahead=" + std::to_string(profile.lookahead));
+        // 无 B 帧的档位用低延迟预测结构
+        if (profile.maxBFrames == 0)
+            addParam("pred-struct=1");
+        if (threadCount > 0)
+            addParam("lp=" + std::to_string(threadCount));
+        if (!params.empty())
+            setOption("svtav1-params", params);
+    }
+    if (!skipped.empty())
+        std::cout << "编码器 " << candidate->name << " 没有这些选项, 已跳过: " << skipped << std::endl;
+
+    // 打开编码器
+    if (avcodec_open2(codecContext, candidate, &options) < 0)
+    {
+        av_dict_free(&options);
+        avcodec_free_context(&codecContext);
+        codecContext = nullptr;
+        return false;
+    }
+    codec = candidate;
+    logConfig(options);
+    av_dict_free(&options);
+    return true;
+}
+
+bool FFmpegEncoder::init()
+{
+    // 重新打开时先用上次选中的编码器, 不再逐个尝试
+    bool opened = codec && open(codec);
+    if (!opened)
+    {
+        std::vector<std::string> candidates = profile.encoders;
+        if (candidates.empty())
+            candidates.assign(std::begin(DefaultEncoders), std::end(DefaultEncoders));
+        for (const auto &name : candidates)
+        {
+            const AVCodec *candidate = findEncoder(name);
+            if (!candidate)
+            {
+                std::cerr << "未找到编码器: " << name << std::endl;
+                continue;
+            }
+            if (open(candidate))
+            {
+                opened = true;
+                break;
+            }
+            std::cerr << "无法打开编码器: " << candidate->name << ", 尝试下一个" << std::endl;
+        }
+    }
+    if (!opened)
+    {
+        std::cerr << "没有可用的编码器" << std::endl;
+        return false;
+    }
+
+    // 分配帧, 帧缓冲区每次编码时从帧池获取
+    frame = av_frame_alloc();
+    // cv::Mat 输入的包装帧, 只引用 Mat 的数据
+    matFrame = av_frame_alloc();
+    if (!frame || !matFrame)
+    {
+        std::cerr << "无法分配视频帧" << std::endl;
+        return false;
+    }
+
+    frameCount = 0;
+    firstPts = AV_NOPTS_VALUE;
+    lastPts = AV_NOPTS_VALUE;
+    ptsOffset = 0;
+    decimationCount = 0;
+    pendingRateLimit = 0;
+    rateLimit = codecContext->rc_max_rate;
+    framesIn = 0;
+    packetsOut = 0;
+    draining = false;
+    lastKeyframeTime = std::chrono::steady_clock::time_point();
+    initialized = true;
+    return true;
+}
+
+std::string FFmpegEncoder::threadLayout() const
+{
+    if (!codecContext)
+        return "-";
+    // libx265/libsvtav1 等不经过 FFmpeg 的线程, 由编码器自己的线程池调度
+    if (codecContext->active_thread_type & FF_THREAD_SLICE)
+        return "slice";
+    if (codecContext->active_thread_type & FF_THREAD_FRAME)
+        return "frame";
+    if (codec->capabilities & AV_CODEC_CAP_OTHER_THREADS)
+        return "internal";
+    return "single";
+}
+
+void FFmpegEncoder::logConfig(AVDictionary *unused) const
+{
+    // 从编码器读回实际生效的 preset/tune
+    auto privOption = [this](const char *name)
+    {
+        uint8_t *value = nullptr;
+        std::string result = "-";
+        if (codecContext->priv_data && av_opt_get(codecContext->priv_data, name, 0, &value) >= 0 && value)
+        {
+            if (value[0])
+                result = reinterpret_cast<const char *>(value);
+            av_free(value);
+        }
+        return result;
+    };
+
+    std::cout << "编码器: " << codec->name << ", 档位=" << profile.name
+              << ", preset=" << privOption("preset") << ", tune=" << privOption("tune")
+              << ", 码率=" << codecContext->bit_rate << ", 最大码率=" << codecContext->rc_max_rate
+              << ", VBV=" << codecContext->rc_buffer_size << ", GOP=" << codecContext->gop_size
+              << ", B帧=" << codecContext->max_b_frames
+              << ", 线程数=" << codecContext->thread_count
+              << ", 线程类型=" << threadLayout()
+              << ", 编码延迟=" << codecContext->delay << "帧" << std::endl;
+
+    // 当前编码器不认识的选项(如换用非 x264 编码器时)留在字典中
+    AVDictionaryEntry *entry = nullptr;
+    while ((entry = av_dict_get(unused, "", entry, AV_DICT_IGNORE_SUFFIX)))
+        std::cerr << "编码选项未生效: " << entry->key << "=" << entry->value << std::endl;
+}
+
+bool FFmpegEncoder::sendFrame(cv::Mat &inFrame)
+{
+    if (!initialized || inFrame.empty())
+        return false;
+
+    if (inFrame.type() != CV_8UC3)
+    {
+        std::cerr << "只支持RGB888格式的帧" << std::endl;
+        return false;
+    }
+
+    // 包装为 RGB24 帧, 不拷贝像素
+    matFrame->format = AV_PIX_FMT_RGB24;
+    matFrame->width = inFrame.cols;
+    matFrame->height = inFrame.rows;
+    matFrame->data[0] = inFrame.data;
+    matFrame->linesize[0] = static_cast<int>(inFrame.step);
+    return sendFrame(matFrame);
+}
+
+bool FFmpegEncoder::sendFrame(const AVFrame *inFrame)
+{
+    return sendFrame(inFrame, false, false);
+}
+
+bool FFmpegEncoder::sendKeyframe(const AVFrame *inFrame, bool requested)
+{
+    return sendFrame(inFrame, true, requested);
+}
+
+bool FFmpegEncoder::sendFrame(const AVFrame *inFrame, bool mustKey, bool requested)
+{
+    if (!initialized || draining || !inFrame || !inFrame->data[0])
+        return false;
+
+    if (inFrame->width != width || inFrame->height != height)
+    {
+        std::cerr << "帧尺寸与编码器尺寸不匹配" << std::endl;
+        return false;
+    }
+
+    int64_t newRateLimit = pendingRateLimit.exchange(0);
+    if (newRateLimit > 0)
+        applyRateLimit(newRateLimit);
+
+    // 降帧率时跳过的帧不送入编码器, 保留下来的帧沿用各自的时间戳, 播放时长不变
+    // 必须编为关键帧的帧(分级输出各级同时切换)不跳过, 降帧的计数从它重新开始
+    int64_t pts = nextPts(inFrame);
+    int decimation = frameDecimation;
+    if (mustKey)
+        decimationCount = 1;
+    else if (decimation > 1 && decimationCount++ % decimation != 0)
+        return true;
+
+    if (inFrame->format == codecContext->pix_fmt)
+    {
+        // 已是编码器格式(如解码输出的 YUV420P), 直接引用, 不做转换
+        av_frame_unref(frame);
+        if (av_frame_ref(frame, inFrame) < 0)
+        {
+            std::cerr << "无法引用视频帧" << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        // 其他格式(RGB24/NV12 等)转换到帧池中的新缓冲区, 编码器持有的上一帧引用不受影响
+        StageTimer timer(metrics, Stage::PushScale);
+        if (!converter.convert(inFrame, frame, codecContext->pix_fmt, width, height))
+        {
+            std::cerr << "无法转换帧格式到编码器格式" << std::endl;
+            return false;
+        }
+    }
+
+    frame->pts = pts;
+    // 帧类型由编码器决定, 有关键帧请求时强制为 I 帧(forced-idr 使其编为 IDR)
+    // 指定的关键帧只有来自请求时才计入强制关键帧数, 分级的固定 GOP 边界不算
+    bool byRequest = mustKey ? requested : keyframeRequested && keyframeAllowed();
+    bool forceKey = mustKey || byRequest;
+    if (forceKey)
+    {
+        keyframeRequested = false;
+        lastKeyframeTime = std::chrono::steady_clock::now();
+        if (metrics && byRequest)
+            metrics->forcedKeyframes++;
+    }
+    frame->pict_type = forceKey ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+#ifdef AV_FRAME_FLAG_KEY
+    if (forceKey)
+        frame->flags |= AV_FRAME_FLAG_KEY;
+    else
+        frame->flags &= ~AV_FRAME_FLAG_KEY;
+#else
+    frame->key_frame = forceKey ? 1 : 0;
+#endif
+
+    // 发送帧到编码器
+    int ret;
+    {
+        StageTimer timer(metrics, Stage::EncodeSend);
+        ret = avcodec_send_frame(codecContext, frame);
+    }
+    av_frame_unref(frame);
+    if (ret < 0)
+    {
+        std::cerr << "发送帧到编码器失败: " << ret << std::endl;
+        return false;
+    }
+    framesIn++;
+    return true;
+}
+
+bool FFmpegEncoder::receivePacket(AVPacket *outPacket, bool &gotPacket)
+{
+    gotPacket = false;
+    if (!initialized || !outPacket)
+        return false;
+
+    int ret;
+    {
+        StageTimer timer(metrics, Stage::EncodeReceive);
+        ret = avcodec_receive_packet(codecContext, outPacket);
+    }
+    if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF)
+    {
+        return true; // 需要更多帧 / 编码器完成了所有输入数据的处理
+    }
+    else if (ret < 0)
+    {
+        std::cerr << "从编码器接收数据包失败" << std::endl;
+        return false;
+    }
+
+    packetsOut++;
+    if (metrics)
+        metrics->framesOut++;
+    // 自然产生的关键帧同样满足之前的请求, 并重新开始计算最小间隔
+    if (outPacket->flags & AV_PKT_FLAG_KEY)
+    {
+        lastKeyframeTime = std::chrono::steady_clock::now();
+        keyframeRequested = false;
+    }
+    gotPacket = true;
+    return true;
+}
+
+bool FFmpegEncoder::sendFlush()
+{
+    if (!initialized)
+        return false;
+    if (draining)
+        return true;
+    int ret = avcodec_send_frame(codecContext, nullptr);
+    if (ret < 0 && ret != AVERROR_EOF)
+    {
+        std::cerr << "发送结束标志到编码器失败: " << ret << std::endl;
+        return false;
+    }
+    draining = true;
+    return true;
+}
+
+bool FFmpegEncoder::reopen()
+{
+    if (!initialized)
+        return false;
+    if (!draining)
+        return true;
+
+#ifdef AV_CODEC_CAP_ENCODER_FLUSH
+    // 支持清空的编码器(新版本的 libx264 等)直接复位, 不重新分配
+    if (codec->capabilities & AV_CODEC_CAP_ENCODER_FLUSH)
+    {
+        avcodec_flush_buffers(codecContext);
+        draining = false;
+        keyframeRequested = true;
+        return true;
+    }
+#endif
+
+    // 按同样的参数重新打开, 时间戳和码率上限接续排空之前的状态
+    int64_t savedFrameCount = frameCount, savedFirstPts = firstPts, savedLastPts = lastPts, savedOffset = ptsOffset;
+    int64_t savedRateLimit = rateLimit;
+    uint64_t savedIn = framesIn, savedOut = packetsOut;
+    close();
+    if (!init())
+        return false;
+    frameCount = savedFrameCount;
+    firstPts = savedFirstPts;
+    lastPts = savedLastPts;
+    ptsOffset = savedOffset;
+    framesIn = savedIn;
+    packetsOut = savedOut;
+    if (savedRateLimit > 0 && savedRateLimit != rateLimit)
+        applyRateLimit(savedRateLimit);
+    return true;
+}
+
+bool FFmpegEncoder::keyframeAllowed() const
+{
+    return keyframeMinIntervalMs <= 0 ||
+           std::chrono::steady_clock::now() - lastKeyframeTime >= std::chrono::milliseconds(keyframeMinIntervalMs);
+}
+
+int64_t FFmpegEncoder::nextPts(const AVFrame *inFrame)
+{
+    AVRational frameTimeBase = {1, frameRate};
+    int64_t pts;
+    if (inputTimeBase.num > 0 && inFrame->pts != AV_NOPTS_VALUE)
+        pts = av_rescale_q(inFrame->pts, inputTimeBase, codecContext->time_base);
+    else
+        pts = av_rescale_q(frameCount, frameTimeBase, codecContext->time_base);
+    frameCount++;
+
+    // 以第一帧为零点
+    if (firstPts == AV_NOPTS_VALUE)
+        firstPts = pts;
+    pts = pts - firstPts + ptsOffset;
+
+    // 时间戳回退或跳变(重连后源时间戳重新开始等)时接在上一帧之后, 保证送入编码器的 pts 单调递增
+    if (lastPts != AV_NOPTS_VALUE)
+    {
+        int64_t step = std::max<int64_t>(1, av_rescale_q(1, frameTimeBase, codecContext->time_base));
+        int64_t maxJump = av_rescale_q(10, AVRational{1, 1}, codecContext->time_base);
+        if (pts <= lastPts || pts - lastPts > maxJump)
+        {
+            ptsOffset += lastPts + step - pts;
+            pts = lastPts + step;
+        }
+    }
+    lastPts = pts;
+    return pts;
+}
+
+void FFmpegEncoder::applyRateLimit(int64_t maxRate)
+{
+    if (codecContext->rc_max_rate <= 0 || maxRate == codecContext->rc_max_rate)
+        return;
+
+    // 目标码率和缓冲区与档位中的比例保持一致; libx264 检测到参数变化后在下一帧重新配置
+    if (profile.bitRate > 0 && profile.maxRate > 0)
+        codecContext->bit_rate = profile.bitRate * maxRate / profile.maxRate;
+    double vbvSeconds = profile.vbvSeconds > 0 ? profile.vbvSeconds : 1.0 / frameRate;
+    codecContext->rc_buffer_size = static_cast<int>(maxRate * vbvSeconds);
+    codecContext->rc_max_rate = maxRate;
+    rateLimit = maxRate;
+}
+
+void FFmpegEncoder::close()
+{
+    if (frame)
+    {
+        av_frame_free(&frame);
+        frame = nullptr;
+    }
+    if (matFrame)
+    {
+        av_frame_free(&matFrame);
+        matFrame = nullptr;
+    }
+
+    if (codecContext)
+    {
+        avcodec_free_context(&codecContext);
+        codecContext = nullptr;
+    }
+
+    initialized = false;
+}
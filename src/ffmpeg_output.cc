@@ -0,0 +1,412 @@
+// ffmpeg_output.cc
+#include "ffmpeg_output.hh"
+#include "ffmpeg_metwork_init.hh"
+
+#include <algorithm>
+#include <chrono>
+
+static bool isKeyPacket(const PacketPtr &pkt)
+{
+    return pkt && (pkt->flags & AV_PKT_FLAG_KEY);
+}
+
+static size_t packetBytes(const PacketPtr &pkt)
+{
+    return pkt ? static_cast<size_t>(pkt->size) : 0;
+}
+
+static bool isDisposablePacket(const PacketPtr &pkt)
+{
+    // 编码器标记的不被参考的帧(如 x264 的非参考 B 帧), 单独丢弃不影响其他帧解码
+    return pkt && (pkt->flags & AV_PKT_FLAG_DISPOSABLE);
+}
+
+static int64_t packetTime(const PacketPtr &pkt)
+{
+    return pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+}
+
+FFmpegOutput::FFmpegOutput(const std::string &outUrl, const std::string &prot, size_t queueSize)
+    : url(outUrl), protocol(prot), queue(queueSize, OverflowPolicy::DropNonKey, isKeyPacket, packetBytes)
+{
+    queue.setDisposable(isDisposablePacket);
+}
+
+FFmpegOutput::~FFmpegOutput()
+{
+    close();
+}
+
+const char *FFmpegOutput::formatNameFor(const std::string &prot)
+{
+    if (prot == "rtsp")
+        return "rtsp";
+    if (prot == "file")
+        return nullptr;
+    if (prot == "null")
+        return "null"; // 丢弃输出, 用于测试和性能测量
+    if (prot == "record")
+        return "mp4";
+    return "flv"; // RTMP默认使用flv格式
+}
+
+bool FFmpegOutput::open(const AVCodecParameters *codecpar, AVRational timeBase)
+{
+    if (opened || !codecpar)
+        return false;
+
+    FFmpegNetworkInitializer::init();
+
+    // 保存编码参数, 断线重连时用同样的参数重新写头
+    if (!codecParams)
+        codecParams = avcodec_parameters_alloc();
+    if (!codecParams || avcodec_parameters_copy(codecParams, codecpar) < 0)
+    {
+        std::cerr << "无法保存输出的编码参数" << std::endl;
+        return false;
+    }
+    srcTimeBase = timeBase;
+    if (protocol == "record")
+        segments.reset(new SegmentWriter(url, recordOptions));
+    segmentStart = segmentEnd = AV_NOPTS_VALUE;
+    if (!openContext())
+        return false;
+
+    // 时长上限换算到输入时间基, 入队时只比较整数
+    int64_t maxSpan = 0;
+    if (queueLimits.maxSeconds > 0 && timeBase.num > 0 && timeBase.den > 0)
+        maxSpan = static_cast<int64_t>(queueLimits.maxSeconds * timeBase.den / timeBase.num);
+    RingQueue<PacketPtr>::SpanCheck spanExceeds;
+    if (maxSpan > 0)
+        spanExceeds = [maxSpan](const PacketPtr &oldest, const PacketPtr &incoming)
+        {
+            int64_t first = packetTime(oldest), last = packetTime(incoming);
+            return first != AV_NOPTS_VALUE && last != AV_NOPTS_VALUE && last - first > maxSpan;
+        };
+    queue.setLimits(queueLimits.maxBytes, spanExceeds);
+
+    queue.reset();
+    waitKey = true;
+    needPrime = true;
+    failed = false;
+    reconnecting = false;
+    closing = false;
+    backoff.reset();
+    opened = true;
+    writerThread = std::thread(&FFmpegOutput::writeLoop, this);
+
+    std::cout << "输出已打开: 协议=" << protocol << ", 地址=" << url << std::endl;
+    return true;
+}
+
+bool FFmpegOutput::openContext()
+{
+    // 分配输出格式上下文, 录制目标每个切片一个上下文
+    AVIOContext *segmentIo = segments ? segments->begin() : nullptr;
+    if (segments && !segmentIo)
+        return false;
+    const std::string &target = segments ? segments->currentPath() : url;
+    if (avformat_alloc_output_context2(&formatContext, nullptr,
+                                       segments ? segments->formatName() : formatNameFor(protocol),
+                                       target.c_str()) < 0)
+    {
+        std::cerr << "无法创建输出上下文 (协议: " << protocol << ")" << std::endl;
+        if (segments)
+            segments->finish(&segmentIo, 0);
+        return false;
+    }
+
+    // 创建输出流
+    formatContext->pb = segmentIo;
+    stream = avformat_new_stream(formatContext, nullptr);
+    if (!stream)
+    {
+        std::cerr << "无法创建输出流" << std::endl;
+        closeContext(false);
+        return false;
+    }
+    if (avcodec_parameters_copy(stream->codecpar, codecParams) < 0)
+    {
+        std::cerr << "无法复制编码参数到输出流" << std::endl;
+        closeContext(false);
+        return false;
+    }
+    stream->codecpar->codec_tag = 0; // 由输出封装器重新选择
+    stream->time_base = srcTimeBase;
+
+    // 封装器选项在写文件头时生效, avio_open2 只接受协议层选项
+    AVDictionary *format_options = nullptr;
+    // RTSP特殊设置
+    if (protocol == "rtsp")
+    {
+        av_dict_set(&format_options, "rtsp_transport", "tcp", 0); // 使用TCP传输
+    }
+    else if (protocol == "rtmp")
+    {
+        // 对于RTMP，不关心文件大小和时长
+        // formatContext->oformat->flags |= AVFMT_NOTIMESTAMPS;
+        formatContext->flags |= AVFMT_NOTIMESTAMPS; // 正确设置标志的方法
+        // 设置flvflags
+        av_dict_set(&format_options, "flvflags", "no_duration_filesize", 0);
+    }
+    else if (segments)
+    {
+        segments->setMuxerOptions(&format_options);
+    }
+    // 网络输出每写一个包就刷新IO缓冲, 不在本地攒数据; 录制切片攒满写缓冲再写盘
+    if (!isLocal())
+        av_dict_set(&format_options, "flush_packets", "1", 0);
+
+    // 网络输出的连接、写头和写包都受中断回调的时限约束; 本地文件不设回调, 退出时仍能写完文件尾
+    const AVIOInterruptCB *interrupt = nullptr;
+    if (!isLocal())
+    {
+        formatContext->interrupt_callback = deadline.callback();
+        interrupt = &formatContext->interrupt_callback;
+    }
+    IoDeadlineScope openDeadline(deadline, timeouts.openMs);
+
+    // 打开输出URL, 录制切片已经接上了自己的写缓冲
+    if (!segments && !(formatContext->oformat->flags & AVFMT_NOFILE))
+    {
+        if (avio_open2(&formatContext->pb, url.c_str(), AVIO_FLAG_WRITE, interrupt, nullptr) < 0)
+        {
+            std::cerr << "无法打开输出URL (协议: " << protocol << ")" << (deadline.timedOut() ? " (超时)" : "")
+                      << std::endl;
+            av_dict_free(&format_options);
+            closeContext(false);
+            return false;
+        }
+    }
+
+    // 写入文件头
+    if (avformat_write_header(formatContext, &format_options) < 0)
+    {
+        std::cerr << "写入头信息失败" << (deadline.timedOut() ? " (超时)" : "") << std::endl;
+        av_dict_free(&format_options);
+        closeContext(false);
+        return false;
+    }
+    AVDictionaryEntry *unused = nullptr;
+    while ((unused = av_dict_get(format_options, "", unused, AV_DICT_IGNORE_SUFFIX)))
+        std::cerr << "输出选项未生效: " << unused->key << "=" << unused->value << std::endl;
+    av_dict_free(&format_options);
+    return true;
+}
+
+void FFmpegOutput::closeContext(bool writeTrailer)
+{
+    if (formatContext)
+    {
+        IoDeadlineScope closeDeadline(deadline, timeouts.writeMs);
+        // 写入文件尾
+        if (writeTrailer)
+            av_write_trailer(formatContext);
+
+        if (segments)
+        {
+            // 刷盘后改为正式文件名, 没写入任何包的切片直接删除
+            double seconds = 0;
+            if (segmentStart != AV_NOPTS_VALUE && segmentEnd != AV_NOPTS_VALUE)
+                seconds = (segmentEnd - segmentStart) * av_q2d(srcTimeBase);
+            segments->finish(&formatContext->pb, seconds);
+            segmentStart = segmentEnd = AV_NOPTS_VALUE;
+        }
+        else if (!(formatContext->oformat->flags & AVFMT_NOFILE))
+        {
+            avio_closep(&formatContext->pb);
+        }
+        avformat_free_context(formatContext);
+        formatContext = nullptr;
+    }
+    stream = nullptr;
+}
+
+bool FFmpegOutput::reconnect()
+{
+    // 本地文件写失败(磁盘满等)重试没有意义, 录制目标在下一个关键帧开始新切片
+    if (isLocal())
+        return false;
+
+    reconnecting = true;
+    closeContext(false);
+    while (!closing && !deadline.isCancelled() && !IoDeadline::isShutdown())
+    {
+        if (backoff.exhausted())
+        {
+            std::cerr << "输出重连失败 " << backoff.attempts() << " 次, 放弃: " << url << std::endl;
+            break;
+        }
+        if (!backoff.wait(closing))
+            break;
+
+        // 断线期间的包已经过时, 直接丢弃
+        PacketPtr stale;
+        while (queue.tryPop(stale))
+            stale.reset();
+
+        std::cerr << "正在重新连接输出 (第 " << backoff.attempts() << " 次): " << url << std::endl;
+        if (metrics)
+            metrics->outputReconnects++;
+        if (openContext())
+        {
+            // 新会话从关键帧开始: 分发线程先写入 GOP 缓存, 没有缓存时请求编码器立即输出关键帧
+            // 先结束重连状态再要求起播: 分发线程看到 needPrime 时 prime 不会因 reconnecting 直接返回
+            backoff.reset();
+            waitKey = true;
+            reconnecting = false;
+            needPrime = true;
+            std::cout << "输出已恢复: " << url << std::endl;
+            return true;
+        }
+    }
+    reconnecting = false;
+    return false;
+}
+
+bool FFmpegOutput::send(const AVPacket *pkt)
+{
+    if (!opened || failed || !pkt)
+        return false;
+    // 重连期间不入队, 恢复后从关键帧开始
+    if (reconnecting)
+        return true;
+
+    // 从关键帧开始输出, 避免下游解码出花屏
+    if (waitKey)
+    {
+        if (!(pkt->flags & AV_PKT_FLAG_KEY))
+            return true;
+        waitKey = false;
+    }
+
+    PacketPtr ref(av_packet_alloc());
+    if (!ref || av_packet_ref(ref.get(), pkt) < 0)
+        return false;
+
+    // 队列满时丢弃到下一个关键帧, 慢速目标不会拖慢编码
+    return queue.push(std::move(ref));
+}
+
+void FFmpegOutput::prime(const std::vector<PacketPtr> &packets)
+{
+    needPrime = false;
+    if (!opened || failed || reconnecting || packets.empty())
+        return;
+
+    // 起播的 GOP 可能长于队列的时长/字节上限, 作为豁免元素入队, 不会被溢出策略截断; 之后的包照常受上限约束
+    for (const auto &pkt : packets)
+    {
+        PacketPtr ref(av_packet_alloc());
+        if (!ref || av_packet_ref(ref.get(), pkt.get()) < 0 || !queue.pushExempt(std::move(ref)))
+            return;
+    }
+    waitKey = false;
+}
+
+bool FFmpegOutput::rotateSegment(const AVPacket *pkt)
+{
+    bool key = pkt->flags & AV_PKT_FLAG_KEY;
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    if (formatContext)
+    {
+        if (segmentStart == AV_NOPTS_VALUE)
+        {
+            segmentStart = ts;
+            return true;
+        }
+        // 切片只在关键帧处切换, 每个切片都能独立解码
+        if (!key || ts == AV_NOPTS_VALUE || (ts - segmentStart) * av_q2d(srcTimeBase) < recordOptions.segmentSeconds)
+            return true;
+        closeContext(true);
+    }
+
+    // 上一个切片写盘出错或新切片创建失败时, 丢弃到下一个关键帧再试
+    if (!key || !openContext())
+        return false;
+    segmentStart = ts;
+    return true;
+}
+
+void FFmpegOutput::writeLoop()
+{
+    PacketPtr pkt;
+    while (queue.pop(pkt))
+    {
+        if (segments && !failed && !rotateSegment(pkt.get()))
+        {
+            pkt.reset();
+            continue;
+        }
+        if (!failed)
+        {
+            // 有 B 帧时 pts 不单调, 取最大值作为切片的结束时间
+            if (segments && pkt->pts != AV_NOPTS_VALUE)
+                segmentEnd = std::max(segmentEnd, pkt->pts + pkt->duration);
+
+            // 转换时间基
+            av_packet_rescale_ts(pkt.get(), srcTimeBase, stream->time_base);
+            pkt->stream_index = stream->index;
+            pkt->pos = -1;
+
+            // 写入数据包, av_interleaved_write_frame 会接管并释放包的引用
+            // 网络发送缓冲区满时写出会阻塞, 阻塞时间即为链路拥塞的程度
+            int size = pkt->size;
+            auto writeStart = std::chrono::steady_clock::now();
+            int ret;
+            {
+                IoDeadlineScope writeDeadline(deadline, timeouts.writeMs);
+                ret = av_interleaved_write_frame(formatContext, pkt.get());
+            }
+            int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - writeStart)
+                             .count();
+            writeNs += ns;
+            if (metrics)
+                metrics->record(Stage::Write, ns);
+            if (ret < 0)
+            {
+                std::cerr << "写入数据包失败 (" << url << ")" << (deadline.timedOut() ? ": 写出超时" : "") << std::endl;
+                if (segments)
+                    closeContext(false);
+                else if (!reconnect())
+                    failed = true;
+            }
+            else
+            {
+                writtenPackets++;
+                writtenBytes += size;
+                if (metrics)
+                    metrics->bytesWritten += size;
+            }
+        }
+        pkt.reset();
+    }
+}
+
+OutputStats FFmpegOutput::getStats() const
+{
+    OutputStats stats;
+    stats.writtenPackets = writtenPackets;
+    stats.writtenBytes = writtenBytes;
+    stats.droppedPackets = queue.dropped();
+    stats.queuedPackets = queue.size();
+    stats.queuedBytes = queue.weight();
+    stats.writeSeconds = writeNs / 1e9;
+    return stats;
+}
+
+void FFmpegOutput::close()
+{
+    closing = true;
+    queue.close();
+    if (writerThread.joinable())
+        writerThread.join();
+
+    closeContext(opened && !failed && !reconnecting);
+    segments.reset();
+    if (codecParams)
+        avcodec_parameters_free(&codecParams);
+    reconnecting = false;
+    opened = false;
+}
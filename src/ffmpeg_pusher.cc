@@ -2,14 +2,15 @@
 #include "ffmpeg_pusher.hh"
 #include "ffmpeg_metwork_init.hh"
 
-// #include <thread>
-// #include <chrono>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 
-#define MAX_RETRIES 10
 
 FFmpegPusher::FFmpegPusher(const std::string &url, int w, int h, int fr, const std::string &prot)
-    : rtmpUrl(url), width(w), height(h), frameRate(fr), protocol(prot)
+    : encoder(w, h, fr), width(w), height(h), frameRate(fr)
 {
+    addOutput(url, prot);
 }
 
 FFmpegPusher::~FFmpegPusher()
@@ -17,307 +18,729 @@ FFmpegPusher::~FFmpegPusher()
     close();
 }
 
-bool FFmpegPusher::init()
+void FFmpegPusher::addOutput(const std::string &url, const std::string &prot)
 {
-    // 初始化FFmpeg库
-    FFmpegNetworkInitializer::init();
-    // 确定输出格式
-    std::string formatName = "flv"; // RTMP默认使用flv格式
-    if (protocol == "rtsp")
+    outputs.emplace_back(new FFmpegOutput(url, prot));
+    outputs.back()->setMetrics(metrics);
+    outputs.back()->setReconnectOptions(reconnectOptions);
+    outputs.back()->setIoTimeouts(ioTimeouts);
+    outputs.back()->setQueueLimits(queueLimits);
+    outputs.back()->setRecordOptions(recordOptions);
+}
+
+bool FFmpegPusher::attachOutput(const std::string &url, const std::string &prot)
+{
+    // 参数在锁内复制一份, 打开期间推流器关闭也不受影响
+    std::unique_ptr<AVCodecParameters, void (*)(AVCodecParameters *)> params(
+        avcodec_parameters_alloc(), [](AVCodecParameters *p)
+        { avcodec_parameters_free(&p); });
+    AVRational timeBase;
+    bool copyMode;
     {
-        formatName = "rtsp";
+        std::lock_guard<std::mutex> lock(outputsMutex);
+        if (!acceptingOutputs || !params || avcodec_parameters_copy(params.get(), outputParams) < 0)
+            return false;
+        timeBase = outputTimeBase;
+        copyMode = passthrough;
     }
-
-    // 分配输出格式上下文
-    if (avformat_alloc_output_context2(&formatContext, nullptr,
-                                       formatName.c_str(), rtmpUrl.c_str()) < 0)
+    if (copyMode && !supportsPassthrough(params->codec_id, prot, url))
     {
-        std::cerr << "无法创建输出上下文 (协议: " << protocol << ")" << std::endl;
+        std::cerr << "输出不支持直通的编码: " << url << std::endl;
         return false;
     }
 
-    // 查找编码器  硬解可以改用H265推流
-    codec = avcodec_find_encoder(AV_CODEC_ID_H264);
-    // codec = avcodec_find_encoder(AV_CODEC_ID_HEVC);
-    if (!codec)
+    // 连接和写头可能较慢, 在调用线程中完成, 不阻塞分发; 打开后 needsPrime 为 true, 分发时先写入 GOP 缓存
+    std::unique_ptr<FFmpegOutput> output(new FFmpegOutput(url, prot));
+    output->setMetrics(metrics);
+    output->setReconnectOptions(reconnectOptions);
+    output->setIoTimeouts(ioTimeouts);
+    output->setQueueLimits(queueLimits);
+    output->setRecordOptions(recordOptions);
+    if (!output->open(params.get(), timeBase))
     {
-        std::cerr << "未找到H.264编码器" << std::endl;
+        std::cerr << "输出打开失败: " << url << std::endl;
         return false;
     }
 
-    // 创建编码器上下文
-    codecContext = avcodec_alloc_context3(codec);
-    if (!codecContext)
+    std::lock_guard<std::mutex> lock(outputsMutex);
+    if (!acceptingOutputs)
     {
-        std::cerr << "无法分配编码器上下文" << std::endl;
+        output->close();
         return false;
     }
+    attachedOutputs.push_back(std::move(output));
+    std::cout << "已接入输出: " << url << std::endl;
+    return true;
+}
+
+void FFmpegPusher::addRendition(const RenditionConfig &rendition)
+{
+    // 各级从源尺寸逐级缩小, 不放大
+    if (static_cast<int64_t>(rendition.width) * rendition.height >= static_cast<int64_t>(width) * height)
+    {
+        std::cerr << "分级输出尺寸 " << rendition.width << "x" << rendition.height << " 不小于源尺寸 " << width
+                  << "x" << height << ", 已忽略" << std::endl;
+        return;
+    }
+    if (!ladder)
+        ladder.reset(new SimulcastLadder());
+    ladder->addRendition(rendition);
+}
+
+std::unique_ptr<FFmpegPusher> FFmpegPusher::createRenditionPusher(const RenditionConfig &rendition)
+{
+    // 时间基、线程数和输出选项与本推流器相同, 各级的时间戳因此一致
+    std::unique_ptr<FFmpegPusher> pusher(new FFmpegPusher(rendition.outputs[0].second, rendition.width,
+                                                          rendition.height, frameRate, rendition.outputs[0].first));
+    for (size_t i = 1; i < rendition.outputs.size(); i++)
+        pusher->addOutput(rendition.outputs[i].second, rendition.outputs[i].first);
+    pusher->setEncoderThreads(encoderThreads);
+    pusher->setInputTimeBase(inputTimeBase);
+    pusher->setEncoderProfile(rendition.profile);
+    pusher->setReconnectOptions(reconnectOptions);
+    pusher->setIoTimeouts(ioTimeouts);
+    pusher->setOutputQueueLimits(queueLimits);
+    pusher->setRecordOptions(recordOptions);
+    pusher->setGopCacheBytes(gopCacheBytes);
+    // 最小间隔由分级统一检查, 各级按帧照做
+    pusher->setKeyframeMinInterval(0);
+    pusher->encoder.setFixedGop(true);
+    return pusher;
+}
+
+void FFmpegPusher::setReconnectOptions(const ReconnectOptions &options)
+{
+    reconnectOptions = options;
+    for (auto &output : outputs)
+        output->setReconnectOptions(options);
+}
+
+void FFmpegPusher::setIoTimeouts(const IoTimeouts &timeouts)
+{
+    ioTimeouts = timeouts;
+    for (auto &output : outputs)
+        output->setIoTimeouts(timeouts);
+}
+
+void FFmpegPusher::setOutputQueueLimits(const OutputQueueLimits &limits)
+{
+    queueLimits = limits;
+    for (auto &output : outputs)
+        output->setQueueLimits(limits);
+}
+
+void FFmpegPusher::setRecordOptions(const RecordOptions &options)
+{
+    recordOptions = options;
+    for (auto &output : outputs)
+        output->setRecordOptions(options);
+}
+
+void FFmpegPusher::setMetrics(StreamMetrics *m)
+{
+    metrics = m;
+    encoder.setMetrics(m);
+    for (auto &output : outputs)
+        output->setMetrics(m);
+}
 
-    // 设置编码器参数 硬解可以改用H265推流
-    codecContext->codec_id = AV_CODEC_ID_H264;
-    // codecContext->codec_id = AV_CODEC_ID_HEVC;
-    codecContext->codec_type = AVMEDIA_TYPE_VIDEO;
-    codecContext->pix_fmt = AV_PIX_FMT_YUV420P;
-    codecContext->width = width;
-    codecContext->height = height;
-    codecContext->time_base = {1, frameRate};
-    // codecContext->framerate = {frameRate, 1};
-    // 设置目标码率
-    codecContext->bit_rate = 1024000; // 平均要求 1024 kbps
-    // 设置最大码率和缓冲区大小
-    codecContext->rc_max_rate = 2048000;    // 最大限制 2048 kbps
-    codecContext->rc_buffer_size = 4096000; // 缓冲区大小：最大码率缓存池[低延迟优先，缓冲区大小与目标码率相同, 平常最大码率的2-5倍]
-    codecContext->gop_size = 50;
-    codecContext->max_b_frames = 1;
-    // 强制第一帧为关键帧
-    codecContext->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
-
-    // 设置编码器选项
-    AVDictionary *options = nullptr;
-    // av_dict_set(&options, "preset", "ultrafast", 0); // 使用快速压缩[带宽占用多]
-    av_dict_set(&options, "preset", "medium", 0); // 使用普通压缩[性能占用多]
-    av_dict_set(&options, "crf", "23", 0);        // 追求画质优先 设置 CRF 值 (H264 CRF 值差不多是23)
-
-    // 打开编码器
-    if (avcodec_open2(codecContext, codec, &options) < 0)
-    {
-        std::cerr << "无法打开编码器" << std::endl;
-        // av_dict_free(&options);
+bool FFmpegPusher::openOutputs(const AVCodecParameters *codecpar, AVRational timeBase)
+{
+    // 运行中接入的输出沿用同样的参数
+    if (!outputParams)
+        outputParams = avcodec_parameters_alloc();
+    if (!outputParams || avcodec_parameters_copy(outputParams, codecpar) < 0)
         return false;
+    outputTimeBase = timeBase;
+
+    // 单个输出失败不影响其他输出, 至少一个成功即可
+    size_t openedCount = 0;
+    for (auto &output : outputs)
+    {
+        if (output->open(codecpar, timeBase))
+            openedCount++;
+        else
+            std::cerr << "输出打开失败: " << output->getUrl() << std::endl;
     }
-    av_dict_free(&options);
+    return openedCount > 0;
+}
 
-    // 创建输出流
-    stream = avformat_new_stream(formatContext, codec);
-    if (!stream)
+bool FFmpegPusher::init()
+{
+    // 初始化FFmpeg库
+    FFmpegNetworkInitializer::init();
+
+    // 有分级输出时关键帧由分级安排, 本编码器与各级一样按帧照做
+    bool simulcast = ladder && !ladder->empty();
+    if (simulcast)
     {
-        std::cerr << "无法创建输出流" << std::endl;
-        return false;
+        encoder.setFixedGop(true);
+        encoder.setKeyframeMinInterval(0);
     }
-    stream->time_base = codecContext->time_base;
 
-    // 复制编码器参数到输出流
-    if (avcodec_parameters_from_context(stream->codecpar, codecContext) < 0)
+    if (!encoder.init())
+        return false;
+
+    // 编码器参数作为所有输出流的参数
+    AVCodecParameters *codecpar = avcodec_parameters_alloc();
+    if (!codecpar || avcodec_parameters_from_context(codecpar, encoder.getCodecContext()) < 0)
     {
         std::cerr << "无法复制编码器参数到输出流" << std::endl;
+        avcodec_parameters_free(&codecpar);
         return false;
     }
+    bool ok = openOutputs(codecpar, encoder.getTimeBase());
+    avcodec_parameters_free(&codecpar);
+    if (!ok)
+        return false;
 
-    AVDictionary *format_options = nullptr;
-    // RTSP特殊设置
-    if (protocol == "rtsp")
-    {
-        av_dict_set(&format_options, "rtsp_transport", "tcp", 0); // 使用TCP传输
-    }
-    else if (protocol == "rtmp")
+    packet = av_packet_alloc();
+    lastFrame = av_frame_alloc();
+    if (!packet || !lastFrame)
     {
-        // 对于RTMP，不关心文件大小和时长
-        // formatContext->oformat->flags |= AVFMT_NOTIMESTAMPS;
-        formatContext->flags |= AVFMT_NOTIMESTAMPS; // 正确设置标志的方法
-        // 设置flvflags
-        av_dict_set(&format_options, "flvflags", "no_duration_filesize", 0);
+        std::cerr << "无法分配数据包" << std::endl;
+        return false;
     }
 
-    av_dict_set(&format_options, "tune", "zerolatency", 0);
-    av_dict_set(&format_options, "fflags", "nobuffer", 0);
-
-    // 打开输出URL
-    if (!(formatContext->oformat->flags & AVFMT_NOFILE))
+    if (simulcast)
     {
-        if (avio_open2(&formatContext->pb, rtmpUrl.c_str(), AVIO_FLAG_WRITE, nullptr, &format_options) < 0)
+        const EncoderProfile &profile = encoder.getProfile();
+        ladder->setKeyframeSchedule(static_cast<int>(std::lround(profile.gopSeconds * frameRate)), keyframeMinIntervalMs);
+        ladder->setMetrics(metrics);
+        if (!ladder->start([this](const RenditionConfig &rendition)
+                           { return createRenditionPusher(rendition); }))
         {
-            std::cerr << "无法打开输出URL (协议: " << protocol << ")" << std::endl;
+            ladder->close();
             return false;
         }
     }
 
-    av_dict_free(&format_options);
+    if (bitrateOptions.enabled)
+    {
+        bitrateController.reset(new BitrateController(encoder, bitrateOptions));
+        if (!bitrateController->start())
+            bitrateController.reset();
+    }
+
+    std::cout << "推流器初始化成功: "
+              << "输出数=" << outputs.size() << ", 尺寸=" << width << "x" << height
+              << ", 帧率=" << frameRate << ", 编码器=" << encoder.getCodecName() << "(" << encoder.threadLayout()
+              << ")" << ", 分级数=" << getRenditionCount() << std::endl;
+
+    initialized = true;
+    std::lock_guard<std::mutex> lock(outputsMutex);
+    acceptingOutputs = true;
+    return true;
+}
+
+bool FFmpegPusher::initPassthrough(const AVCodecParameters *codecpar, AVRational timeBase)
+{
+    if (!codecpar)
+        return false;
+    if (ladder && !ladder->empty())
+        std::cerr << "直通模式不解码, 忽略分级输出" << std::endl;
+
+    // 输出流参数直接复制自输入流
+    if (!openOutputs(codecpar, timeBase))
+        return false;
+    srcTimeBase = timeBase;
 
-    // 写入文件头
-    if (avformat_write_header(formatContext, nullptr) < 0)
+    packet = av_packet_alloc();
+    lastKeyPacket = av_packet_alloc();
+    if (!packet || !lastKeyPacket)
     {
-        std::cerr << "写入头信息失败" << std::endl;
+        std::cerr << "无法分配数据包" << std::endl;
         return false;
     }
 
-    // 分配帧和包
-    frame = av_frame_alloc();
-    if (!frame)
+    std::cout << "推流器初始化成功(直通模式): "
+              << "输出数=" << outputs.size() << ", 编码=" << avcodec_get_name(codecpar->codec_id)
+              << ", 尺寸=" << codecpar->width << "x" << codecpar->height << std::endl;
+
+    startTs = AV_NOPTS_VALUE;
+    lastDts = AV_NOPTS_VALUE;
+    tsOffset = 0;
+    waitKeyframe = false;
+    passthrough = true;
+    initialized = true;
+    std::lock_guard<std::mutex> lock(outputsMutex);
+    acceptingOutputs = true;
+    return true;
+}
+
+bool FFmpegPusher::dispatch(const AVPacket *pkt)
+{
+    bool key = pkt->flags & AV_PKT_FLAG_KEY;
+    std::vector<PacketPtr> primer;
+    bool primerLoaded = false;
+
+    // 运行中接入的输出在这里并入, outputs 只在分发线程中修改
     {
-        std::cerr << "无法分配视频帧" << std::endl;
-        return false;
+        std::lock_guard<std::mutex> lock(outputsMutex);
+        for (auto &output : attachedOutputs)
+            outputs.push_back(std::move(output));
+        attachedOutputs.clear();
     }
-    frame->format = codecContext->pix_fmt;
-    frame->width = codecContext->width;
-    frame->height = codecContext->height;
-    if (av_frame_get_buffer(frame, 0) < 0)
+
+    // 每个输出各自持有包的引用, 数据不拷贝
+    bool anyAlive = false;
+    for (auto &output : outputs)
     {
-        std::cerr << "无法分配视频帧数据" << std::endl;
+        // 新接入或重连的输出先写入 GOP 缓存; 当前包是关键帧时直接从它开始
+        if (output->needsPrime())
+        {
+            if (!key && !primerLoaded)
+            {
+                primerLoaded = true;
+                // 没有缓存时请求编码器立即输出关键帧(直通模式下等待输入的关键帧)
+                if (!gopCache.enabled() || !gopCache.snapshot(primer))
+                    requestKeyframe();
+            }
+            output->prime(primer); // 当前包是关键帧时 primer 为空
+        }
+        if (output->send(pkt))
+            anyAlive = true;
+    }
+    gopCache.add(pkt);
+    return anyAlive;
+}
+
+bool FFmpegPusher::pushPacket(const AVPacket *inPacket)
+{
+    if (!initialized || !passthrough || !inPacket)
         return false;
+
+    std::lock_guard<std::mutex> lock(streamMutex);
+    bool key = inPacket->flags & AV_PKT_FLAG_KEY;
+    // 从第一个关键帧开始转发, 避免下游解码出花屏; 输入重连后同样等待关键帧
+    if (startTs == AV_NOPTS_VALUE || waitKeyframe)
+    {
+        if (!key)
+            return true;
+        waitKeyframe = false;
+        if (startTs == AV_NOPTS_VALUE)
+        {
+            startTs = inPacket->dts != AV_NOPTS_VALUE ? inPacket->dts : inPacket->pts;
+            if (startTs == AV_NOPTS_VALUE)
+                startTs = 0;
+        }
     }
 
-    packet = av_packet_alloc();
-    if (!packet)
+    if (av_packet_ref(packet, inPacket) < 0)
     {
-        std::cerr << "无法分配数据包" << std::endl;
+        std::cerr << "无法引用数据包" << std::endl;
         return false;
     }
 
-    // 初始化 SWS 上下文用于 RGB 到 YUV420P 的转换
-    swsContext = sws_getContext(
-        width, height, AV_PIX_FMT_RGB24,
-        width, height, codecContext->pix_fmt,
-        SWS_BILINEAR, nullptr, nullptr, nullptr);
-    if (!swsContext)
+    // 以第一个关键帧为零点, 各输出再从输入时间基转换到自己的时间基
+    // 时间戳回退或跳变(重连后输入时间戳重新开始等)时接在上一个包之后, 保证输出的 dts 单调递增
+    int64_t ts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+    if (ts != AV_NOPTS_VALUE && lastDts != AV_NOPTS_VALUE)
     {
-        std::cerr << "无法初始化 SWS 上下文" << std::endl;
-        return false;
+        int64_t out = ts - startTs + tsOffset;
+        int64_t step = std::max<int64_t>(1, av_rescale_q(1, AVRational{1, frameRate}, srcTimeBase));
+        int64_t maxJump = av_rescale_q(10, AVRational{1, 1}, srcTimeBase);
+        if (out <= lastDts || out - lastDts > maxJump)
+            tsOffset += lastDts + step - out;
+    }
+    int64_t offset = tsOffset - startTs;
+    if (packet->pts != AV_NOPTS_VALUE)
+        packet->pts += offset;
+    if (packet->dts != AV_NOPTS_VALUE)
+        packet->dts += offset;
+    if (ts != AV_NOPTS_VALUE)
+    {
+        lastDts = ts + offset;
+        lastInputTs = ts;
     }
 
-    std::cout << "推流器初始化成功: "
-              << "协议=" << protocol << ", 尺寸=" << width << "x" << height
-              << ", 帧率=" << frameRate << std::endl;
+    // 保留最后一个关键帧(输入时间戳), 输入断线时用于补帧
+    if (key)
+    {
+        av_packet_unref(lastKeyPacket);
+        av_packet_ref(lastKeyPacket, inPacket);
+    }
 
-    initialized = true;
-    return true;
+    if (metrics)
+        metrics->framesOut++;
+    bool ok = dispatch(packet);
+    av_packet_unref(packet);
+    if (ok)
+        reportFirstOutput();
+    return ok;
 }
 
-bool FFmpegPusher::pushFrame(cv::Mat &inFrame)
+void FFmpegPusher::startFiller(std::function<void(FramePtr)> frameSink, std::function<void(PacketPtr)> packetSink)
 {
-    if (!initialized || inFrame.empty())
-        return false;
+    if (!initialized || fillerThread.joinable())
+        return;
+    fillerFrameSink = std::move(frameSink);
+    fillerPacketSink = std::move(packetSink);
+    fillerTs = AV_NOPTS_VALUE;
+    fillerStop = false;
+    fillerThread = std::thread(&FFmpegPusher::fillerLoop, this);
+}
 
-    if (inFrame.cols != width || inFrame.rows != height)
+void FFmpegPusher::stopFiller()
+{
+    if (fillerThread.joinable())
     {
-        std::cerr << "帧尺寸与编码器尺寸不匹配" << std::endl;
-        return false;
+        {
+            std::lock_guard<std::mutex> lock(fillerMutex);
+            fillerStop = true;
+        }
+        fillerCv.notify_all();
+        fillerThread.join();
     }
+    if (!initialized)
+        return;
 
-    // static auto lastFrameTime = std::chrono::steady_clock::now();
-    // auto currentTime = std::chrono::steady_clock::now();
-    // auto frameDuration = std::chrono::milliseconds((int)(1000 / frameRate)); // For 25 FPS
+    // 输入恢复后尽快让观众看到新画面
+    std::lock_guard<std::mutex> lock(streamMutex);
+    if (passthrough)
+        waitKeyframe = true;
+    else
+        requestKeyframe();
+}
 
-    // if (currentTime - lastFrameTime < frameDuration)
-    // {
-    //     std::this_thread::sleep_for(frameDuration - (currentTime - lastFrameTime));
-    // }
+void FFmpegPusher::requestKeyframe()
+{
+    if (keyframeHandler)
+        keyframeHandler();
+    else if (ladder && !ladder->empty() && !passthrough)
+        ladder->requestKeyframe();
+    else
+        encoder.requestKeyframe();
+}
 
-    // lastFrameTime = std::chrono::steady_clock::now();
+void FFmpegPusher::fillerLoop()
+{
+    // 转码按帧率重复最后一帧(重复帧编码后很小); 直通只能重复关键帧, 每秒一次
+    // 补帧排在已排队的真实帧之后, 不需要等待它们先写出
+    auto interval = passthrough ? std::chrono::microseconds(1000000)
+                                : std::chrono::microseconds(1000000 / std::max(1, frameRate));
+    auto next = std::chrono::steady_clock::now() + interval;
+    bool logged = false;
+
+    std::unique_lock<std::mutex> lock(fillerMutex);
+    while (!fillerCv.wait_until(lock, next, [this]
+                                { return fillerStop; }))
+    {
+        auto now = std::chrono::steady_clock::now();
+        next = std::max(next + interval, now);
+        lock.unlock();
+        bool ok = makeFiller();
+        lock.lock();
+        if (ok && !logged)
+        {
+            std::cout << "输入中断, 发送补帧保持输出" << std::endl;
+            logged = true;
+        }
+    }
+}
 
-    uint8_t *src_data[4];
-    int src_linesize[4];
-    src_data[0] = inFrame.data;
-    src_linesize[0] = inFrame.step;
+bool FFmpegPusher::makeFiller()
+{
+    std::unique_lock<std::mutex> lock(streamMutex);
+    if (passthrough)
+    {
+        if (!fillerPacketSink || !lastKeyPacket->data || lastInputTs == AV_NOPTS_VALUE)
+            return false;
+        PacketPtr pkt(av_packet_alloc());
+        if (!pkt || av_packet_ref(pkt.get(), lastKeyPacket) < 0)
+            return false;
+        // 时间戳在输入时间基中每次顺延一秒, 经 pushPacket 换算后接在已转发的包之后
+        if (fillerTs == AV_NOPTS_VALUE)
+            fillerTs = lastInputTs;
+        fillerTs += std::max<int64_t>(1, av_rescale_q(1, AVRational{1, 1}, srcTimeBase));
+        pkt->pts = pkt->dts = fillerTs;
+        lock.unlock();
+        fillerPacketSink(std::move(pkt));
+        return true;
+    }
 
-    // 将 RGB 数据转换为 YUV420P 并存储在 frame 中
-    sws_scale(swsContext, src_data, src_linesize, 0,
-              inFrame.rows, frame->data, frame->linesize);
-    // sws_freeContext(sws_ctx);
+    if (!fillerFrameSink || !lastFrame->buf[0])
+        return false;
+    FramePtr frame(av_frame_clone(lastFrame));
+    if (!frame)
+        return false;
+    // 时间戳接在最后一帧之后按帧率顺延, 编码器按输入时间基换算
+    if (lastFrame->pts != AV_NOPTS_VALUE && inputTimeBase.num > 0)
+    {
+        if (fillerTs == AV_NOPTS_VALUE)
+            fillerTs = lastFrame->pts;
+        fillerTs += std::max<int64_t>(1, av_rescale_q(1, AVRational{1, frameRate}, inputTimeBase));
+        frame->pts = fillerTs;
+    }
+    lock.unlock();
+    fillerFrameSink(std::move(frame));
+    return true;
+}
 
-    int retries = 0;
-    bool frame_sent = false;
-    int ret;
+bool FFmpegPusher::supportsPassthrough(AVCodecID codecId, const std::string &prot, const std::string &url)
+{
+    const char *formatName = FFmpegOutput::formatNameFor(prot);
+    const AVOutputFormat *ofmt = av_guess_format(formatName, formatName ? nullptr : url.c_str(), nullptr);
+    if (!ofmt)
+        return false;
 
-    // 从编码器接收数据包并写入输出流
-    do
-    {
-        frame->pts = frameCount++;
+    int ret = avformat_query_codec(ofmt, codecId, FF_COMPLIANCE_NORMAL);
+    if (ret >= 0)
+        return ret == 1;
 
-        // 发送帧到编码器
-        ret = avcodec_send_frame(codecContext, frame);
-        if (ret < 0)
-        {
-            std::cerr << "发送帧到编码器失败: " << ret << std::endl;
+    // 封装器未提供编码表(如rtsp), 按RTP常见负载判断
+    return codecId == AV_CODEC_ID_H264 || codecId == AV_CODEC_ID_HEVC;
+}
+
+bool FFmpegPusher::selectPassthrough(const std::string &mode, AVCodecID codecId,
+                                     const std::vector<std::pair<std::string, std::string>> &outputs)
+{
+    if (mode != "auto")
+        return mode == "copy";
+
+    for (const auto &output : outputs)
+    {
+        if (!supportsPassthrough(codecId, output.first, output.second))
             return false;
-        }
+    }
+    return !outputs.empty();
+}
 
-        ret = avcodec_receive_packet(codecContext, packet);
-        if (ret == AVERROR(EAGAIN))
-        {
-            if (++retries > MAX_RETRIES)
-            {
-                std::cerr << "超过接收数据包的最大重试次数. " << std::endl;
-                return false;
-            }
+bool FFmpegPusher::pushFrame(cv::Mat &inFrame)
+{
+    std::vector<PacketPtr> packets;
+    if (!encodeFrame(inFrame, packets))
+        return false;
 
-            return true; // 需要更多帧, 也属于是成功
-        }
-        else if (ret == AVERROR_EOF)
-        {
-            // 编码器完成了所有输入数据的处理
-            frame_sent = false;
-            break;
-        }
-        else if (ret < 0)
-        {
-            std::cerr << "从编码器接收数据包失败" << std::endl;
+    // 没有包表示编码器需要更多帧, 也属于是成功
+    return packets.empty() || writePackets(packets);
+}
+
+bool FFmpegPusher::receivePackets(std::vector<PacketPtr> &packets)
+{
+    // 取到编码器没有已完成的包为止, 不在编码器内部积压
+    while (true)
+    {
+        PacketPtr pkt(av_packet_alloc());
+        bool gotPacket = false;
+        if (!pkt || !encoder.receivePacket(pkt.get(), gotPacket))
             return false;
-        }
+        if (!gotPacket)
+            return true;
+        packets.push_back(std::move(pkt));
+    }
+}
 
-        frame_sent = true;
-    } while (!frame_sent);
+bool FFmpegPusher::encodeFrame(cv::Mat &inFrame, std::vector<PacketPtr> &packets)
+{
+    if (!initialized || passthrough)
+        return false;
+    std::lock_guard<std::mutex> lock(streamMutex);
+    return encoder.sendFrame(inFrame) && receivePackets(packets);
+}
+
+bool FFmpegPusher::encodeFrame(const AVFrame *inFrame, std::vector<PacketPtr> &packets)
+{
+    return encodeFrame(inFrame, false, packets);
+}
+
+bool FFmpegPusher::encodeFrame(const AVFrame *inFrame, bool keyframe, std::vector<PacketPtr> &packets)
+{
+    if (!initialized || passthrough)
+        return false;
+    std::lock_guard<std::mutex> lock(streamMutex);
+    // 引用计数的帧只增加一个引用, 留作输入断线时的补帧
+    if (inFrame && inFrame->buf[0])
+    {
+        av_frame_unref(lastFrame);
+        av_frame_ref(lastFrame, inFrame);
+    }
+    return sendFrame(inFrame, keyframe, packets);
+}
+
+bool FFmpegPusher::sendFrame(const AVFrame *frame, bool keyframe, std::vector<PacketPtr> &packets)
+{
+    keyframe = keyframe || forceNextKeyframe;
+    forceNextKeyframe = false;
+    // 分级决定该帧是否为关键帧并把它交给各级, 本编码器照做, 所有级别在同一帧上切换 GOP
+    // 只有请求的关键帧计入强制关键帧数; 下级收到的关键帧是分级的安排, 不再计入
+    bool requested = false;
+    if (ladder && !ladder->empty())
+        keyframe = ladder->schedule(frame, keyframe, &requested);
+    // 指定的关键帧(分级的安排、重新打开后的第一帧)不因降帧率跳过, 也不受最小间隔限制
+    bool ok = keyframe ? encoder.sendKeyframe(frame, requested) : encoder.sendFrame(frame);
+    return ok && receivePackets(packets);
+}
+
+bool FFmpegPusher::writePacket(AVPacket *inPacket)
+{
+    if (!initialized || passthrough || !inPacket)
+        return false;
 
-    // 转换时间基
-    av_packet_rescale_ts(packet, codecContext->time_base, stream->time_base);
-    packet->stream_index = stream->index;
     // 确保 packet->pts 和 packet->dts 已正确设置
-    if (packet->pts == AV_NOPTS_VALUE || packet->dts == AV_NOPTS_VALUE)
+    if (inPacket->pts == AV_NOPTS_VALUE || inPacket->dts == AV_NOPTS_VALUE)
     {
         std::cerr << "PTS 或 DTS 设置不正确!" << std::endl;
     }
 
-    // 写入数据包
-    ret = av_interleaved_write_frame(formatContext, packet);
-    if (ret < 0)
+    // 分发给所有输出, 时间基转换在各输出的写出线程中完成
+    bool ok = dispatch(inPacket);
+    av_packet_unref(inPacket);
+    if (!ok)
     {
-        std::cerr << "写入数据包失败" << std::endl;
+        std::cerr << "写入数据包失败: 没有可用的输出" << std::endl;
         return false;
     }
 
+    reportFirstOutput();
+    if (bitrateController)
+        bitrateController->update(outputs);
+
     return true;
 }
 
-void FFmpegPusher::close()
+bool FFmpegPusher::writePackets(std::vector<PacketPtr> &packets)
 {
-    if (!initialized)
-        return;
-
-    // 写入文件尾
-    av_write_trailer(formatContext);
+    if (!initialized || passthrough)
+        return false;
 
-    // 释放资源
-    if (packet)
+    // 同一批包按顺序分发, 码率控制每批只更新一次
+    bool ok = true;
+    for (auto &pkt : packets)
     {
-        av_packet_free(&packet);
-        packet = nullptr;
+        if (pkt && !dispatch(pkt.get()))
+            ok = false;
     }
-
-    if (frame)
+    packets.clear();
+    if (!ok)
     {
-        av_frame_free(&frame);
-        frame = nullptr;
+        std::cerr << "写入数据包失败: 没有可用的输出" << std::endl;
+        return false;
     }
-    if (swsContext)
+
+    reportFirstOutput();
+    if (bitrateController)
+        bitrateController->update(outputs);
+    return true;
+}
+
+bool FFmpegPusher::drainEncoder(bool reopen)
+{
+    std::vector<PacketPtr> packets;
+    bool ok;
     {
-        sws_freeContext(swsContext);
-        swsContext = nullptr;
+        std::lock_guard<std::mutex> lock(streamMutex);
+        ok = encoder.sendFlush() && receivePackets(packets);
+        if (ok && reopen)
+            ok = encoder.reopen();
+        // 重新打开的编码器从关键帧开始, 分级的各级同时切换
+        if (ok && reopen && ladder)
+            forceNextKeyframe = true;
     }
+    size_t count = packets.size();
+    if (!packets.empty() && !writePackets(packets))
+        ok = false;
+    std::cout << "编码器已排空: 剩余包=" << count << ", 送入帧=" << encoder.getFramesIn()
+              << ", 输出包=" << encoder.getPacketsOut() << ", 未输出=" << encoder.getPendingFrames() << std::endl;
+    return ok;
+}
 
-    if (codecContext)
+bool FFmpegPusher::flushEncoder()
+{
+    if (!initialized || passthrough)
+        return false;
+    return drainEncoder(true);
+}
+
+bool FFmpegPusher::finishEncoding(std::vector<PacketPtr> &packets)
+{
+    if (!initialized || passthrough)
+        return false;
+    std::lock_guard<std::mutex> lock(streamMutex);
+    return encoder.sendFlush() && receivePackets(packets);
+}
+
+void FFmpegPusher::reportFirstOutput()
+{
+    if (!metrics)
+        return;
+    // 补帧不算, 只统计打开输入后第一个真实帧
+    double seconds = metrics->markFirstOutput();
+    if (seconds >= 0)
+        std::cout << "首帧输出耗时: " << static_cast<int>(seconds * 1000) << "ms" << std::endl;
+}
+
+uint64_t FFmpegPusher::getDroppedPackets() const
+{
+    std::lock_guard<std::mutex> lock(outputsMutex);
+    uint64_t dropped = 0;
+    for (const auto &output : outputs)
+        dropped += output->getDroppedPackets();
+    return dropped;
+}
+
+OutputStats FFmpegPusher::getOutputStats() const
+{
+    std::lock_guard<std::mutex> lock(outputsMutex);
+    OutputStats total;
+    for (const auto &output : outputs)
     {
-        avcodec_free_context(&codecContext);
-        codecContext = nullptr;
+        OutputStats stats = output->getStats();
+        total.writtenPackets += stats.writtenPackets;
+        total.writtenBytes += stats.writtenBytes;
+        total.droppedPackets += stats.droppedPackets;
+        total.queuedPackets += stats.queuedPackets;
+        total.queuedBytes += stats.queuedBytes;
+        total.writeSeconds += stats.writeSeconds;
     }
+    return total;
+}
+
+void FFmpegPusher::close()
+{
+    if (!initialized)
+        return;
 
-    if (formatContext)
+    // 不再接受新的输出, 已打开但还没并入的一起关闭
     {
-        if (!(formatContext->oformat->flags & AVFMT_NOFILE))
-        {
-            avio_closep(&formatContext->pb);
-        }
-        avformat_free_context(formatContext);
-        formatContext = nullptr;
+        std::lock_guard<std::mutex> lock(outputsMutex);
+        acceptingOutputs = false;
+        for (auto &output : attachedOutputs)
+            outputs.push_back(std::move(output));
+        attachedOutputs.clear();
     }
 
+    stopFiller();
+
+    // 取出编码器中缓存的最后几帧, 写完后输出才完整
+    if (!passthrough && encoder.isInitialized())
+        drainEncoder(false);
+    // 已交给分级的帧逐级编码写完
+    if (ladder)
+        ladder->close();
+
+    gopCache.clear();
+
+    // 各输出写完剩余的包和文件尾
+    for (auto &output : outputs)
+        output->close();
+
+    bitrateController.reset();
+    encoder.close();
+
+    // 释放资源
+    if (packet)
+    {
+        av_packet_free(&packet);
+        packet = nullptr;
+    }
+    if (lastFrame)
+        av_frame_free(&lastFrame);
+    if (lastKeyPacket)
+        av_packet_free(&lastKeyPacket);
+    if (outputParams)
+        avcodec_parameters_free(&outputParams);
+
+    passthrough = false;
     initialized = false;
 }
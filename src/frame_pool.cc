@@ -0,0 +1,130 @@
+// frame_pool.cc
+#include "frame_pool.hh"
+
+namespace
+{
+    // 池化缓冲区的外层引用, 释放时把内层缓冲区还给 AVBufferPool 并更新统计
+    struct PooledBuffer
+    {
+        AVBufferRef *inner;
+        std::shared_ptr<void> counters;
+    };
+
+    const int kFrameAlign = 32;
+}
+
+FramePool::FramePool() : counters(std::make_shared<Counters>())
+{
+}
+
+FramePool::~FramePool()
+{
+    // 已借出的缓冲区在归还后由 AVBufferPool 自行释放
+    av_buffer_pool_uninit(&pool);
+}
+
+AVBufferRef *FramePool::allocBuffer(void *opaque, size_t size)
+{
+    Counters *c = static_cast<Counters *>(opaque);
+    c->allocations++;
+    return av_buffer_alloc(size);
+}
+
+void FramePool::releaseBuffer(void *opaque, uint8_t *)
+{
+    PooledBuffer *pooled = static_cast<PooledBuffer *>(opaque);
+    static_cast<Counters *>(pooled->counters.get())->outstanding--;
+    av_buffer_unref(&pooled->inner);
+    delete pooled;
+}
+
+bool FramePool::acquire(AVFrame *frame, AVPixelFormat format, int width, int height)
+{
+    if (!frame || width <= 0 || height <= 0)
+        return false;
+
+    int size = av_image_get_buffer_size(format, width, height, kFrameAlign);
+    if (size < 0)
+        return false;
+
+    AVBufferRef *inner = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // 尺寸变化时重建池, 旧池在其缓冲区全部归还后自动释放
+        if (!pool || size != poolSize)
+        {
+            av_buffer_pool_uninit(&pool);
+            pool = av_buffer_pool_init2(size, counters.get(), allocBuffer, nullptr);
+            poolSize = size;
+        }
+        if (pool)
+            inner = av_buffer_pool_get(pool);
+    }
+    if (!inner)
+        return false;
+
+    PooledBuffer *pooled = new PooledBuffer{inner, counters};
+    AVBufferRef *outer = av_buffer_create(inner->data, inner->size, releaseBuffer, pooled, 0);
+    if (!outer)
+    {
+        av_buffer_unref(&pooled->inner);
+        delete pooled;
+        return false;
+    }
+
+    av_frame_unref(frame);
+    frame->buf[0] = outer;
+    frame->format = format;
+    frame->width = width;
+    frame->height = height;
+    av_image_fill_arrays(frame->data, frame->linesize, outer->data, format, width, height, kFrameAlign);
+
+    counters->acquires++;
+    uint64_t out = ++counters->outstanding;
+    uint64_t high = counters->highWater;
+    while (out > high && !counters->highWater.compare_exchange_weak(high, out))
+    {
+    }
+    return true;
+}
+
+FramePoolStats FramePool::stats() const
+{
+    FramePoolStats s;
+    s.acquires = counters->acquires;
+    s.allocations = counters->allocations;
+    s.reuses = s.acquires > s.allocations ? s.acquires - s.allocations : 0;
+    s.outstanding = counters->outstanding;
+    s.highWater = counters->highWater;
+    return s;
+}
+
+cv::Mat FramePool::toMat(const AVFrame *frame)
+{
+    if (!frame || !frame->data[0])
+        return cv::Mat();
+
+    switch (frame->format)
+    {
+    case AV_PIX_FMT_RGB24:
+    case AV_PIX_FMT_BGR24:
+        return cv::Mat(frame->height, frame->width, CV_8UC3, frame->data[0], frame->linesize[0]);
+    case AV_PIX_FMT_GRAY8:
+        return cv::Mat(frame->height, frame->width, CV_8UC1, frame->data[0], frame->linesize[0]);
+    case AV_PIX_FMT_YUV420P:
+        // I420: 三个平面需连续存放且色度行宽为亮度一半(池化帧宽度为64的倍数时成立)
+        if (frame->height % 2 == 0 &&
+            frame->linesize[1] * 2 == frame->linesize[0] && frame->linesize[2] == frame->linesize[1] &&
+            frame->data[1] == frame->data[0] + frame->linesize[0] * frame->height &&
+            frame->data[2] == frame->data[1] + frame->linesize[1] * (frame->height / 2))
+            return cv::Mat(frame->height * 3 / 2, frame->width, CV_8UC1, frame->data[0], frame->linesize[0]);
+        return cv::Mat();
+    case AV_PIX_FMT_NV12:
+        if (frame->height % 2 == 0 && frame->linesize[1] == frame->linesize[0] &&
+            frame->data[1] == frame->data[0] + frame->linesize[0] * frame->height)
+            return cv::Mat(frame->height * 3 / 2, frame->width, CV_8UC1, frame->data[0], frame->linesize[0]);
+        return cv::Mat();
+    default:
+        return cv::Mat();
+    }
+}
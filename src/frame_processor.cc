@@ -0,0 +1,340 @@
+// frame_processor.cc
+#include "frame_processor.hh"
+
+extern "C"
+{
+#include <libavutil/pixdesc.h>
+}
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+
+// 左上角叠加当前时间
+class TimestampProcessor : public FrameProcessor
+{
+public:
+    std::string name() const override { return "timestamp"; }
+    ProcessorRequirements requirements() const override
+    {
+        ProcessorRequirements r;
+        r.format = AV_PIX_FMT_BGR24;
+        return r;
+    }
+    bool process(ProcessorFrame &frame) override
+    {
+        if (frame.image.empty())
+            return true;
+        char text[32];
+        std::time_t now = std::time(nullptr);
+        struct tm local;
+        localtime_r(&now, &local);
+        std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+
+        // 字号随画面高度缩放, 先描黑边再写白字, 亮暗背景下都清晰
+        double scale = frame.image.rows / 720.0;
+        int thickness = std::max(1, static_cast<int>(2 * scale));
+        cv::Point origin(static_cast<int>(16 * scale), static_cast<int>(40 * scale));
+        cv::putText(frame.image, text, origin, cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(0, 0, 0), thickness + 2);
+        cv::putText(frame.image, text, origin, cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(255, 255, 255), thickness);
+        return true;
+    }
+};
+
+// 矩形区域遮挡(填黑)或模糊, 坐标为处理尺寸下的像素
+class RegionProcessor : public FrameProcessor
+{
+private:
+    cv::Rect region;
+    bool blur;
+
+public:
+    RegionProcessor(const cv::Rect &rect, bool blurRegion) : region(rect), blur(blurRegion) {}
+
+    std::string name() const override { return blur ? "blur" : "mask"; }
+    ProcessorRequirements requirements() const override
+    {
+        ProcessorRequirements r;
+        r.format = AV_PIX_FMT_BGR24;
+        return r;
+    }
+    bool process(ProcessorFrame &frame) override
+    {
+        cv::Rect roi = region & cv::Rect(0, 0, frame.image.cols, frame.image.rows);
+        if (roi.area() <= 0)
+            return true;
+        cv::Mat area = frame.image(roi);
+        if (blur)
+            cv::GaussianBlur(area, area, cv::Size(0, 0), std::max(roi.width, roi.height) / 10.0 + 1);
+        else
+            area.setTo(cv::Scalar::all(0));
+        return true;
+    }
+};
+
+std::unique_ptr<FrameProcessor> createFrameProcessor(const std::string &spec)
+{
+    std::istringstream ss(spec);
+    std::string kind, args;
+    ss >> kind;
+    std::getline(ss >> std::ws, args);
+
+    if (kind == "timestamp")
+        return std::unique_ptr<FrameProcessor>(new TimestampProcessor());
+    if (kind == "mask" || kind == "blur")
+    {
+        int x, y, w, h;
+        if (std::sscanf(args.c_str(), "%d,%d,%d,%d", &x, &y, &w, &h) != 4 || w <= 0 || h <= 0)
+            return nullptr;
+        return std::unique_ptr<FrameProcessor>(new RegionProcessor(cv::Rect(x, y, w, h), kind == "blur"));
+    }
+    return nullptr;
+}
+
+ProcessingChain::ProcessingChain(int threads) : threadCount(threads > 0 ? threads : 0)
+{
+}
+
+ProcessingChain::~ProcessingChain()
+{
+    close();
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+void ProcessingChain::add(std::unique_ptr<FrameProcessor> processor)
+{
+    if (!processor)
+        return;
+    processors.push_back(std::move(processor));
+    counters.emplace_back(new Counters());
+}
+
+bool ProcessingChain::add(const std::string &spec)
+{
+    std::unique_ptr<FrameProcessor> processor = createFrameProcessor(spec);
+    if (!processor)
+    {
+        std::cerr << "无效的处理器: " << spec << std::endl;
+        return false;
+    }
+    add(std::move(processor));
+    return true;
+}
+
+bool ProcessingChain::plan(AVPixelFormat srcFormat, int srcWidth, int srcHeight, AVRational srcTimeBase)
+{
+    workFormat = srcFormat;
+    workWidth = srcWidth;
+    workHeight = srcHeight;
+    timeBase = srcTimeBase;
+
+    // 所有处理器共用一种格式, 只在进入处理链时转换一次
+    AVPixelFormat required = AV_PIX_FMT_NONE;
+    std::string requiredBy;
+    for (const auto &processor : processors)
+    {
+        ProcessorRequirements r = processor->requirements();
+        if (r.format != AV_PIX_FMT_NONE)
+        {
+            if (required != AV_PIX_FMT_NONE && r.format != required)
+            {
+                std::cerr << "处理器 " << requiredBy << " 与 " << processor->name() << " 要求的像素格式不同" << std::endl;
+                return false;
+            }
+            required = r.format;
+            requiredBy = processor->name();
+        }
+        // 只缩小不放大, 多个要求取最小的
+        if (r.width > 0 && r.height > 0 &&
+            static_cast<int64_t>(r.width) * r.height < static_cast<int64_t>(workWidth) * workHeight)
+        {
+            workWidth = r.width;
+            workHeight = r.height;
+        }
+    }
+    if (required != AV_PIX_FMT_NONE)
+        workFormat = required;
+    // 编码器(YUV420P)要求偶数尺寸
+    workWidth &= ~1;
+    workHeight &= ~1;
+
+    const char *formatName = av_get_pix_fmt_name(workFormat);
+    std::cout << "处理链: 处理器数=" << processors.size() << ", 格式=" << (formatName ? formatName : "输入格式")
+              << ", 尺寸=" << workWidth << "x" << workHeight << ", 线程数=" << threadCount << std::endl;
+    return workWidth > 0 && workHeight > 0;
+}
+
+void ProcessingChain::start()
+{
+    if (threadCount == 0 || !workers.empty())
+        return;
+
+    // 在途帧数限制为线程数的两倍: 线程不空闲, 也不积压过多延迟
+    maxInFlight = static_cast<size_t>(threadCount) * 2;
+    closed = false;
+    for (int i = 0; i < threadCount; i++)
+        workers.emplace_back(&ProcessingChain::workerLoop, this);
+}
+
+void ProcessingChain::setMetrics(StreamMetrics *m)
+{
+    metrics = m;
+    if (!metrics)
+        return;
+    // 同名处理器可以出现多次, 指标名带上位置
+    for (size_t i = 0; i < processors.size(); i++)
+    {
+        Counters *c = counters[i].get();
+        metrics->addGauge("processor_" + std::to_string(i) + "_" + processors[i]->name() + "_avg_ms", [c]
+                          { return c->frames ? c->ns / 1e6 / c->frames : 0.0; });
+    }
+}
+
+bool ProcessingChain::apply(VideoFrame &frame, uint64_t index, FrameConverter &converter)
+{
+    const AVFrame *src = frame.current();
+    if (!src)
+        return false;
+    // 补帧是处理链已输出过的帧, 再处理一次会重复叠加
+    if (frame.isRepeated())
+        return true;
+
+    StageTimer timer(metrics, Stage::Process);
+    FramePtr work(av_frame_alloc());
+    if (!work)
+        return false;
+    AVPixelFormat format = workFormat != AV_PIX_FMT_NONE ? workFormat : static_cast<AVPixelFormat>(src->format);
+    if (src->format == format && src->width == workWidth && src->height == workHeight)
+    {
+        // 解码器可能仍以该帧作参考, 原地修改前先取得可写的缓冲区(共享时拷贝一次)
+        if (av_frame_ref(work.get(), src) < 0 || av_frame_make_writable(work.get()) < 0)
+            return false;
+    }
+    else if (!converter.convert(src, work.get(), format, workWidth, workHeight))
+    {
+        return false;
+    }
+
+    ProcessorFrame item;
+    item.frame = work.get();
+    item.image = FramePool::toMat(work.get());
+    item.index = index;
+    item.pts = work->pts;
+    item.timeBase = timeBase;
+    for (size_t i = 0; i < processors.size(); i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        bool keep = processors[i]->process(item);
+        counters[i]->ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+        counters[i]->frames++;
+        if (!keep)
+        {
+            counters[i]->dropped++;
+            return false;
+        }
+    }
+    frame.setProcessed(std::move(work));
+    return true;
+}
+
+bool ProcessingChain::processInline(VideoFrame &frame)
+{
+    return apply(frame, nextIn++, inlineConverter);
+}
+
+void ProcessingChain::workerLoop()
+{
+    // 缩放上下文不能跨线程共用, 每个线程一个转换器
+    FrameConverter converter;
+    while (true)
+    {
+        std::pair<uint64_t, VideoFrame> item;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            inputCv.wait(lock, [this]
+                         { return closed || !input.empty(); });
+            if (input.empty())
+                return;
+            item = std::move(input.front());
+            input.pop_front();
+        }
+
+        if (!apply(item.second, item.first, converter))
+            item.second = VideoFrame();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.emplace(item.first, std::move(item.second));
+        }
+        outputCv.notify_all();
+    }
+}
+
+bool ProcessingChain::submit(VideoFrame frame)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    spaceCv.wait(lock, [this]
+                 { return closed || nextIn - nextOut < maxInFlight; });
+    if (closed)
+        return false;
+    input.emplace_back(nextIn++, std::move(frame));
+    inputCv.notify_one();
+    return true;
+}
+
+bool ProcessingChain::next(VideoFrame &frame)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        // 等待下一个序号处理完; 后面的帧先处理完也要排队, 输出不乱序
+        outputCv.wait(lock, [this]
+                      { return done.count(nextOut) > 0 || (closed && nextOut == nextIn); });
+        auto it = done.find(nextOut);
+        if (it == done.end())
+            return false;
+        VideoFrame result = std::move(it->second);
+        done.erase(it);
+        nextOut++;
+        spaceCv.notify_one();
+        if (!result.empty())
+        {
+            frame = std::move(result);
+            return true;
+        }
+    }
+}
+
+void ProcessingChain::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    inputCv.notify_all();
+    outputCv.notify_all();
+    spaceCv.notify_all();
+}
+
+std::vector<ProcessorStats> ProcessingChain::stats() const
+{
+    std::vector<ProcessorStats> result;
+    for (size_t i = 0; i < processors.size(); i++)
+    {
+        ProcessorStats s;
+        s.name = processors[i]->name();
+        s.frames = counters[i]->frames;
+        s.dropped = counters[i]->dropped;
+        s.seconds = counters[i]->ns / 1e9;
+        result.push_back(s);
+    }
+    return result;
+}
@@ -0,0 +1,97 @@
+// gop_cache.cc
+#include "gop_cache.hh"
+
+void GopCache::setMaxBytes(size_t limit)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    maxBytes = limit;
+    if (maxBytes == 0 || bytes > maxBytes)
+    {
+        packets.clear();
+        bytes = 0;
+        overflowed = maxBytes > 0;
+    }
+}
+
+void GopCache::add(const AVPacket *pkt)
+{
+    if (!pkt)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (maxBytes == 0)
+        return;
+
+    if (pkt->flags & AV_PKT_FLAG_KEY)
+    {
+        packets.clear();
+        bytes = 0;
+        overflowed = false;
+    }
+    else if (packets.empty() || overflowed)
+    {
+        // 没有关键帧开头的内容无法单独解码, 不缓存
+        return;
+    }
+
+    // 超出上限时整个 GOP 作废: 只留一部分无法从中间续上
+    if (bytes + pkt->size > maxBytes)
+    {
+        packets.clear();
+        bytes = 0;
+        overflowed = true;
+        return;
+    }
+
+    PacketPtr ref(av_packet_alloc());
+    if (!ref || av_packet_ref(ref.get(), pkt) < 0)
+    {
+        packets.clear();
+        bytes = 0;
+        overflowed = true;
+        return;
+    }
+    bytes += pkt->size;
+    packets.push_back(std::move(ref));
+}
+
+bool GopCache::snapshot(std::vector<PacketPtr> &out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    out.clear();
+    for (const auto &pkt : packets)
+    {
+        PacketPtr ref(av_packet_alloc());
+        if (!ref || av_packet_ref(ref.get(), pkt.get()) < 0)
+        {
+            out.clear();
+            break;
+        }
+        out.push_back(std::move(ref));
+    }
+    if (out.empty())
+    {
+        misses++;
+        return false;
+    }
+    hits++;
+    return true;
+}
+
+void GopCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    packets.clear();
+    bytes = 0;
+    overflowed = false;
+}
+
+GopCacheStats GopCache::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    GopCacheStats s;
+    s.packets = packets.size();
+    s.bytes = bytes;
+    s.hits = hits;
+    s.misses = misses;
+    return s;
+}
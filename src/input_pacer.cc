@@ -0,0 +1,35 @@
+// input_pacer.cc
+#include "input_pacer.hh"
+
+#include <thread>
+
+void InputPacer::reset(AVRational tb)
+{
+    timeBase = tb;
+    startTs = AV_NOPTS_VALUE;
+}
+
+void InputPacer::wait(int64_t ts)
+{
+    if (ts == AV_NOPTS_VALUE || timeBase.num <= 0)
+        return;
+
+    auto now = std::chrono::steady_clock::now();
+    if (startTs == AV_NOPTS_VALUE)
+    {
+        startTs = ts;
+        startTime = now;
+        return;
+    }
+
+    auto due = startTime + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               std::chrono::duration<double>((ts - startTs) * av_q2d(timeBase)));
+    if (ts < startTs || due - now > std::chrono::seconds(10))
+    {
+        startTs = ts;
+        startTime = now;
+        return;
+    }
+    if (due > now)
+        std::this_thread::sleep_until(due);
+}
@@ -0,0 +1,33 @@
+// io_deadline.cc
+#include "io_deadline.hh"
+
+#include <chrono>
+
+std::atomic<bool> IoDeadline::shutdownFlag{false};
+
+static int64_t steadyNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void IoDeadline::arm(int timeoutMs)
+{
+    expired = false;
+    deadlineNs = timeoutMs > 0 ? steadyNowNs() + static_cast<int64_t>(timeoutMs) * 1000000 : 0;
+}
+
+int IoDeadline::interrupt(void *opaque)
+{
+    IoDeadline *self = static_cast<IoDeadline *>(opaque);
+    if (shutdownFlag.load(std::memory_order_relaxed) || self->cancelled.load(std::memory_order_relaxed))
+        return 1;
+    int64_t deadline = self->deadlineNs.load(std::memory_order_relaxed);
+    if (deadline != 0 && steadyNowNs() >= deadline)
+    {
+        self->expired = true;
+        return 1;
+    }
+    return 0;
+}
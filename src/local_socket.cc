@@ -0,0 +1,46 @@
+// local_socket.cc
+#include "local_socket.hh"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <iostream>
+
+int LocalSocket::listenUnix(const std::string &path, const std::string &label)
+{
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << label << "套接字路径过长: " << path << std::endl;
+        return -1;
+    }
+    std::strcpy(addr.sun_path, path.c_str());
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    ::unlink(path.c_str()); // 清理上次异常退出留下的套接字文件
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(fd, 8) < 0)
+    {
+        std::cerr << label << "套接字监听失败: " << path << std::endl;
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void LocalSocket::writeAll(int fd, const std::string &data)
+{
+    size_t offset = 0;
+    while (offset < data.size())
+    {
+        ssize_t n = ::send(fd, data.data() + offset, data.size() - offset, MSG_NOSIGNAL);
+        if (n <= 0)
+            return;
+        offset += static_cast<size_t>(n);
+    }
+}
@@ -2,9 +2,21 @@
 #include <csignal>
 #include <string>
 #include <chrono>
+#include <memory>
 #include <thread>
+#include <utility>
+#include <vector>
 #include "ffmpeg_capture.hh"
 #include "ffmpeg_pusher.hh"
+#include "stream_pipeline.hh"
+#include "channel_config.hh"
+#include "control_server.hh"
+#include "frame_processor.hh"
+#include "stream_channel.hh"
+#include "metrics.hh"
+#include "io_deadline.hh"
+#include "metrics_exporter.hh"
+#include "worker_pool.hh"
 
 bool running = true;
 
@@ -13,15 +25,124 @@ void signalHandler(int signum)
 {
     std::cerr << "捕获到信号 " << signum << "，正在关闭连接..." << std::endl;
     running = false;
+    // 中断所有阻塞中的网络 I/O, 退出不必等到超时
+    IoDeadline::shutdown();
 
     // std::exit(signum);
 }
 
+// 多路模式: 一个进程按配置文件运行多路拉流/推流, 解码和编码共用一个工作线程池
+int runChannels(const std::string &configPath)
+{
+    ProcessConfig config;
+    if (!loadProcessConfig(configPath, config))
+        return -1;
+
+    MetricsRegistry metricsRegistry;
+    MetricsExporter metricsExporter(metricsRegistry, config.metrics);
+    if (config.metrics.enabled())
+        metricsExporter.start();
+
+    WorkerPool pool(config.workers > 0 ? config.workers : 0);
+    std::cout << "多路模式: 通道数=" << config.channels.size()
+              << ", 工作线程数=" << pool.threadCount() << std::endl;
+
+    std::vector<std::unique_ptr<StreamChannel>> channels;
+    for (const auto &channelConfig : config.channels)
+    {
+        std::unique_ptr<StreamChannel> channel(new StreamChannel(channelConfig, pool));
+        channel->setMetrics(metricsRegistry.add(channelConfig.name).get());
+        if (channel->start())
+            channels.push_back(std::move(channel));
+    }
+    if (channels.empty())
+    {
+        std::cerr << "没有可运行的通道" << std::endl;
+        return -1;
+    }
+
+    // 控制接口: 按流名请求关键帧
+    ControlServer control(config.controlSocket);
+    if (!config.controlSocket.empty())
+    {
+        for (auto &channel : channels)
+        {
+            StreamChannel *ch = channel.get();
+            control.addStream(ch->getName(), [ch]
+                              { ch->requestKeyframe(); },
+                              [ch](const std::string &prot, const std::string &url)
+                              { return ch->attachOutput(prot, url); });
+        }
+        control.start();
+    }
+
+    // 主循环, 定期输出各路的CPU占用
+    auto lastReport = std::chrono::steady_clock::now();
+    while (running)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastReport >= std::chrono::seconds(30))
+        {
+            lastReport = now;
+            for (const auto &stats : pool.stats())
+            {
+                std::cout << "[" << stats.name << "] 任务=" << stats.tasks << ", CPU=" << stats.cpuSeconds
+                          << "s, 暂缓=" << stats.throttled << ", 待处理=" << stats.pending << std::endl;
+            }
+        }
+    }
+
+    std::cout << "正在释放资源..." << std::endl;
+    control.stop();
+    for (auto &channel : channels)
+        channel->stop();
+    pool.stop();
+    metricsExporter.stop();
+
+    std::cout << "视频流客户端已退出" << std::endl;
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
+    bool configMode = argc == 3 && std::string(argv[1]) == "--config";
+
+    // 单路模式: 开头的 --key=value 为通道或进程选项, 与配置文件中的键相同
+    ProcessConfig process;
+    ChannelConfig options;
+    options.encoderThreads = -1; // 单路模式沿用FFmpeg默认的编解码线程数
+    options.capture.decoderThreads = -1;
+    int argi = 1;
+    for (; !configMode && argi < argc; argi++)
+    {
+        std::string arg = argv[argi];
+        size_t eq = arg.find('=');
+        if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos)
+            break;
+        bool ok = false;
+        try
+        {
+            std::string key = arg.substr(2, eq - 2);
+            std::string value = arg.substr(eq + 1);
+            ok = applyChannelOption(options, key, value) || applyProcessOption(process, key, value);
+        }
+        catch (const std::exception &)
+        {
+        }
+        if (!ok)
+        {
+            std::cerr << "无效的选项: " << arg << std::endl;
+            return -1;
+        }
+    }
+
+    if (argc - argi < 3 && !configMode)
     {
-        std::cerr << "用法: " << argv[0] << " <RTSP_URL> <CHOICE: rtsp/rtmp> <RTSP_URL/RTMP_URL>" << std::endl;
+        std::cerr << "用法: " << argv[0] << " [--key=value ...] <RTSP_URL> <CHOICE: rtsp/rtmp/file> <RTSP_URL/RTMP_URL/FILE>"
+                  << " [<CHOICE> <URL> ...] [MODE: auto/copy/transcode]" << std::endl;
+        std::cerr << "      " << argv[0] << " --config <CONFIG_FILE>" << std::endl;
         return -1;
     }
 
@@ -29,15 +150,29 @@ int main(int argc, char *argv[])
     std::signal(SIGINT, signalHandler);
     std::signal(SIGTERM, signalHandler);
 
-    std::string rtspUrl = argv[1];
-    std::string streamType = argv[2];
-    std::string streamUrl = argv[3];
-    int frameRate = 25;
+    if (configMode)
+        return runChannels(argv[2]);
+
+    std::string rtspUrl = argv[argi++];
+    // 之后的参数为若干组 <协议> <地址>, 数量为奇数时最后一个为处理模式
+    std::vector<std::pair<std::string, std::string>> outputs;
+    for (; argi + 1 < argc; argi += 2)
+        outputs.emplace_back(argv[argi], argv[argi + 1]);
+    std::string mode = argi < argc ? argv[argi] : options.mode;
 
     std::cout << "正在初始化视频流客户端..." << std::endl;
 
+    MetricsRegistry metricsRegistry;
+    MetricsExporter metricsExporter(metricsRegistry, process.metrics);
+    std::shared_ptr<StreamMetrics> metrics = metricsRegistry.add("main");
+    if (process.metrics.enabled())
+        metricsExporter.start();
+
     // 初始化FFmpeg拉流模块
-    FFmpegCapture capturer(rtspUrl);
+    FFmpegCapture capturer(rtspUrl, options.capture);
+    capturer.setMetrics(metrics.get());
+    capturer.setReconnectOptions(options.reconnect);
+    capturer.setIoTimeouts(options.io);
     if (!capturer.open())
     {
         std::cerr << "拉流模块初始化失败" << std::endl;
@@ -46,64 +181,90 @@ int main(int argc, char *argv[])
 
     int width = capturer.getWidth();
     int height = capturer.getHeight();
+    int frameRate = resolveFrameRate(options, capturer.getFrameRate());
     std::cout << "视频尺寸: " << width << "x" << height << ", 帧率: " << frameRate << std::endl;
 
-    // 初始化FFmpeg推流模块（使用RTMP协议）
-    FFmpegPusher pusher(streamUrl, width, height, frameRate, streamType);
-    if (!pusher.init())
+    // 输入编码可直接封装进输出协议时, 走直通模式(不解码不编码); 发布到共享内存、处理帧和分级输出需要解码, auto 模式改为转码
+    if ((!options.capture.shmName.empty() || !options.processors.empty() || !options.renditions.empty()) &&
+        mode == "auto")
+        mode = "transcode";
+    bool passthrough = FFmpegPusher::selectPassthrough(mode, capturer.getCodecParameters()->codec_id, outputs);
+
+    // 处理链决定编码尺寸: 处理器要求缩小时只在进入处理链时缩放一次, 之后按该尺寸编码
+    ProcessingChain chain(options.processThreads);
+    if (!passthrough && !options.processors.empty())
+    {
+        for (const auto &spec : options.processors)
+        {
+            if (!chain.add(spec))
+                return -1;
+        }
+        if (!chain.plan(capturer.getPixelFormat(), width, height, capturer.getTimeBase()))
+        {
+            std::cerr << "处理链初始化失败" << std::endl;
+            return -1;
+        }
+        width = chain.outputWidth();
+        height = chain.outputHeight();
+        chain.setMetrics(metrics.get());
+    }
+
+    // 初始化FFmpeg推流模块, 只编码一次, 结果分发给所有输出
+    FFmpegPusher pusher(outputs[0].second, width, height, frameRate, outputs[0].first);
+    for (size_t i = 1; i < outputs.size(); i++)
+        pusher.addOutput(outputs[i].second, outputs[i].first);
+    pusher.setEncoderThreads(options.encoderThreads);
+    pusher.setInputTimeBase(capturer.getTimeBase());
+    pusher.setEncoderProfile(options.encoder);
+    pusher.setAdaptiveBitrate(options.adaptiveBitrate);
+    pusher.setReconnectOptions(options.reconnect);
+    pusher.setIoTimeouts(options.io);
+    pusher.setOutputQueueLimits(options.outputQueue);
+    pusher.setRecordOptions(options.record);
+    pusher.setGopCacheBytes(options.gopCacheBytes);
+    pusher.setKeyframeMinInterval(options.keyframeMinIntervalMs);
+    pusher.setMetrics(metrics.get());
+    for (const auto &rendition : resolveRenditions(options))
+        pusher.addRendition(rendition);
+    bool pusherReady = passthrough
+                           ? pusher.initPassthrough(capturer.getCodecParameters(), capturer.getTimeBase())
+                           : pusher.init();
+    if (!pusherReady)
     {
         std::cerr << "推流模块初始化失败" << std::endl;
         capturer.close();
         return -1;
     }
 
-    cv::Mat captureFrame;
+    // 拉流/解码、编码、写出分别在独立线程中运行
+    PipelineOptions pipelineOptions;
+    pipelineOptions.pace = options.pace;
+    pipelineOptions.latencyBudgetMs = options.latencyBudgetMs;
+    StreamPipeline pipeline(capturer, pusher, passthrough, pipelineOptions);
+    pipeline.setMetrics(metrics.get());
+    pipeline.setProcessingChain(&chain);
 
-    // 主循环
-    int64_t frameCount = 0;
-    auto startTime = std::chrono::high_resolution_clock::now();
+    ControlServer control(process.controlSocket);
+    if (!process.controlSocket.empty())
+    {
+        control.addStream("main", [&pusher]
+                          { pusher.requestKeyframe(); },
+                          [&pusher](const std::string &prot, const std::string &url)
+                          { return pusher.attachOutput(url, prot); });
+        control.start();
+    }
 
-    std::cout << "开始视频流处理..." << std::endl;
+    std::cout << "开始视频流处理" << (passthrough ? "(直通模式)" : "(转码模式)") << "..." << std::endl;
     std::cout << "按Ctrl+C退出..." << std::endl;
 
     try
     {
-        while (running)
-        {
-            // 读取帧
-            if (!capturer.readFrame(captureFrame))
-            {
-                std::cerr << "读取帧失败，尝试重新连接..." << std::endl;
-                std::this_thread::sleep_for(std::chrono::seconds(2));
-
-                capturer.close();
-                if (!capturer.open())
-                {
-                    std::cerr << "重新连接失败" << std::endl;
-                    running = false;
-                }
-                continue;
-            }
-
-            // 推流
-            if (!pusher.pushFrame(captureFrame))
-            {
-                // std::cerr << "推流失败" << std::endl;
-                // running = false;
-                // break;
-                continue;
-            }
+        pipeline.start();
 
-            // 控制帧率
-            frameCount++;
-            auto now = std::chrono::high_resolution_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - startTime).count();
-            int expectedTime = (1000 / frameRate) * frameCount;
-
-            if (elapsed < expectedTime)
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(expectedTime - elapsed));
-            }
+        // 主循环
+        while (running && pipeline.isRunning())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
         }
     }
     catch (const std::exception &e)
@@ -117,8 +278,16 @@ int main(int argc, char *argv[])
 
     // 清理资源
     std::cout << "正在释放资源..." << std::endl;
+    control.stop();
+    pipeline.stop();
+    for (const auto &stats : chain.stats())
+    {
+        std::cout << "[处理] " << stats.name << ": 帧=" << stats.frames << ", 丢弃=" << stats.dropped << ", 平均="
+                  << (stats.frames ? stats.seconds * 1000 / stats.frames : 0) << "ms" << std::endl;
+    }
     capturer.close();
     pusher.close();
+    metricsExporter.stop();
 
     std::cout << "视频流客户端已退出" << std::endl;
     return 0;
@@ -0,0 +1,327 @@
+// metrics.cc
+#include "metrics.hh"
+
+#include <cstdio>
+#include <iomanip>
+#include <sstream>
+
+const double LatencyHistogram::Bounds[LatencyHistogram::BucketCount] = {
+    0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01,
+    0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5};
+
+// 流名称来自配置文件, 写入 JSON 字符串前转义引号、反斜杠和控制字符
+static std::string jsonEscape(const std::string &text)
+{
+    std::string out;
+    for (unsigned char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += static_cast<char>(c);
+        }
+        else if (c < 0x20)
+        {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        }
+        else
+        {
+            out += static_cast<char>(c);
+        }
+    }
+    return out;
+}
+
+// Prometheus 标签值只需转义反斜杠、引号和换行
+static std::string labelEscape(const std::string &text)
+{
+    std::string out;
+    for (char c : text)
+    {
+        if (c == '\\' || c == '"')
+            out += '\\';
+        if (c == '\n')
+            out += "\\n";
+        else
+            out += c;
+    }
+    return out;
+}
+
+const char *stageName(Stage stage)
+{
+    switch (stage)
+    {
+    case Stage::Read:
+        return "read";
+    case Stage::DecodeSend:
+        return "decode_send";
+    case Stage::DecodeReceive:
+        return "decode_receive";
+    case Stage::CaptureScale:
+        return "capture_scale";
+    case Stage::ShmPublish:
+        return "shm_publish";
+    case Stage::Process:
+        return "process";
+    case Stage::PushScale:
+        return "push_scale";
+    case Stage::RenditionScale:
+        return "rendition_scale";
+    case Stage::EncodeSend:
+        return "encode_send";
+    case Stage::EncodeReceive:
+        return "encode_receive";
+    case Stage::Write:
+        return "write";
+    case Stage::Count:
+        break;
+    }
+    return "unknown";
+}
+
+void LatencyHistogram::record(int64_t ns)
+{
+    if (ns < 0)
+        ns = 0;
+    double seconds = ns / 1e9;
+    size_t bucket = 0;
+    while (bucket < BucketCount && seconds > Bounds[bucket])
+        bucket++;
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    sumNs.fetch_add(static_cast<uint64_t>(ns), std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::snapshot() const
+{
+    Snapshot snap;
+    for (size_t i = 0; i <= BucketCount; i++)
+        snap.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+    snap.count = count.load(std::memory_order_relaxed);
+    snap.sumSeconds = sumNs.load(std::memory_order_relaxed) / 1e9;
+    return snap;
+}
+
+void StreamMetrics::addGauge(const std::string &metric, std::function<double()> read)
+{
+    std::lock_guard<std::mutex> lock(gaugeMutex);
+    gauges.emplace_back(metric, std::move(read));
+}
+
+std::vector<std::pair<std::string, double>> StreamMetrics::readGauges() const
+{
+    std::lock_guard<std::mutex> lock(gaugeMutex);
+    std::vector<std::pair<std::string, double>> values;
+    for (const auto &gauge : gauges)
+        values.emplace_back(gauge.first, gauge.second());
+    return values;
+}
+
+void StreamMetrics::clearGauges()
+{
+    std::lock_guard<std::mutex> lock(gaugeMutex);
+    gauges.clear();
+}
+
+void StreamMetrics::beginStartup()
+{
+    startupBeginNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         std::chrono::steady_clock::now().time_since_epoch())
+                         .count();
+    awaitingFirstOutput = true;
+}
+
+double StreamMetrics::markFirstOutput()
+{
+    if (!awaitingFirstOutput.load(std::memory_order_relaxed) || !awaitingFirstOutput.exchange(false))
+        return -1;
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now().time_since_epoch())
+                      .count();
+    timeToFirstFrameNs = now - startupBeginNs;
+    return timeToFirstFrameNs / 1e9;
+}
+
+std::shared_ptr<StreamMetrics> MetricsRegistry::add(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &metrics = streams[name];
+    metrics = std::make_shared<StreamMetrics>(name);
+    return metrics;
+}
+
+void MetricsRegistry::remove(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    streams.erase(name);
+    promSamples.erase(name);
+    jsonSamples.erase(name);
+}
+
+MetricsRegistry::Rates MetricsRegistry::computeRates(const StreamMetrics &m,
+                                                     std::map<std::string, StageSample> &samples)
+{
+    StageSample current;
+    current.time = std::chrono::steady_clock::now();
+    current.framesOut = m.framesOut;
+    current.bytesWritten = m.bytesWritten;
+    for (size_t s = 0; s < m.stages.size(); s++)
+        current.busySeconds[s] = m.stages[s].snapshot().sumSeconds;
+
+    Rates rates;
+    auto last = samples.find(m.name);
+    bool hasPrevious = last != samples.end();
+    StageSample previous = hasPrevious ? last->second : StageSample();
+    samples[m.name] = current;
+    double interval = std::chrono::duration<double>(current.time - previous.time).count();
+    if (!hasPrevious || interval <= 0)
+        return rates; // 第一次导出只记录基准
+
+    rates.fps = (current.framesOut - previous.framesOut) / interval;
+    rates.bitrate = (current.bytesWritten - previous.bytesWritten) * 8 / interval;
+
+    // 忙碌比例最高的阶段限制了吞吐; 读包等待的是数据源的节奏, 不参与判断
+    double limitingBusy = 0;
+    for (size_t s = 0; s < m.stages.size(); s++)
+    {
+        rates.busy[s] = (current.busySeconds[s] - previous.busySeconds[s]) / interval;
+        if (static_cast<Stage>(s) != Stage::Read && rates.busy[s] > limitingBusy)
+        {
+            rates.limiting = static_cast<Stage>(s);
+            limitingBusy = rates.busy[s];
+        }
+    }
+    return rates;
+}
+
+std::string MetricsRegistry::renderPrometheus()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+
+    out << "# HELP video_streamer_stage_seconds Time spent in each pipeline stage\n"
+        << "# TYPE video_streamer_stage_seconds histogram\n";
+    for (const auto &item : streams)
+    {
+        const StreamMetrics &m = *item.second;
+        for (size_t s = 0; s < m.stages.size(); s++)
+        {
+            LatencyHistogram::Snapshot snap = m.stages[s].snapshot();
+            std::string labels = "stream=\"" + labelEscape(m.name) + "\",stage=\"" + stageName(static_cast<Stage>(s)) + "\"";
+            uint64_t cumulative = 0;
+            for (size_t b = 0; b < LatencyHistogram::BucketCount; b++)
+            {
+                cumulative += snap.buckets[b];
+                out << "video_streamer_stage_seconds_bucket{" << labels << ",le=\""
+                    << LatencyHistogram::Bounds[b] << "\"} " << cumulative << "\n";
+            }
+            out << "video_streamer_stage_seconds_bucket{" << labels << ",le=\"+Inf\"} " << snap.count << "\n"
+                << "video_streamer_stage_seconds_sum{" << labels << "} " << snap.sumSeconds << "\n"
+                << "video_streamer_stage_seconds_count{" << labels << "} " << snap.count << "\n";
+        }
+    }
+
+    auto counter = [&out, this](const char *metric, const char *help,
+                                const std::atomic<uint64_t> StreamMetrics::*field)
+    {
+        out << "# HELP " << metric << " " << help << "\n# TYPE " << metric << " counter\n";
+        for (const auto &item : streams)
+            out << metric << "{stream=\"" << labelEscape(item.first) << "\"} " << ((*item.second).*field).load() << "\n";
+    };
+    counter("video_streamer_frames_decoded_total", "Decoded frames", &StreamMetrics::framesDecoded);
+    counter("video_streamer_frames_out_total", "Frames sent to outputs", &StreamMetrics::framesOut);
+    counter("video_streamer_bytes_written_total", "Bytes written to all outputs", &StreamMetrics::bytesWritten);
+    counter("video_streamer_reconnects_total", "Input reconnect attempts", &StreamMetrics::reconnects);
+    counter("video_streamer_output_reconnects_total", "Output reconnect attempts", &StreamMetrics::outputReconnects);
+    counter("video_streamer_forced_keyframes_total", "Keyframes forced on request", &StreamMetrics::forcedKeyframes);
+
+    std::map<std::string, Rates> rates;
+    for (const auto &item : streams)
+        rates[item.first] = computeRates(*item.second, promSamples);
+    out << "# HELP video_streamer_stage_busy_ratio Fraction of wall time spent in each stage since the last scrape\n"
+        << "# TYPE video_streamer_stage_busy_ratio gauge\n";
+    for (const auto &item : rates)
+    {
+        for (size_t s = 0; s < item.second.busy.size(); s++)
+            out << "video_streamer_stage_busy_ratio{stream=\"" << labelEscape(item.first) << "\",stage=\""
+                << stageName(static_cast<Stage>(s)) << "\"} " << item.second.busy[s] << "\n";
+    }
+    out << "# HELP video_streamer_limiting_stage Stage with the highest busy ratio\n"
+        << "# TYPE video_streamer_limiting_stage gauge\n";
+    for (const auto &item : rates)
+    {
+        if (item.second.limiting != Stage::Count)
+            out << "video_streamer_limiting_stage{stream=\"" << labelEscape(item.first) << "\",stage=\""
+                << stageName(item.second.limiting) << "\"} 1\n";
+    }
+    out << "# HELP video_streamer_time_to_first_frame_seconds Time from opening the input to the first frame written\n"
+        << "# TYPE video_streamer_time_to_first_frame_seconds gauge\n";
+    for (const auto &item : streams)
+    {
+        int64_t ns = item.second->timeToFirstFrameNs;
+        if (ns >= 0)
+            out << "video_streamer_time_to_first_frame_seconds{stream=\"" << labelEscape(item.first) << "\"} " << ns / 1e9 << "\n";
+    }
+    out << "# TYPE video_streamer_fps gauge\n";
+    for (const auto &item : rates)
+        out << "video_streamer_fps{stream=\"" << labelEscape(item.first) << "\"} " << item.second.fps << "\n";
+    out << "# TYPE video_streamer_bitrate_bps gauge\n";
+    for (const auto &item : rates)
+        out << "video_streamer_bitrate_bps{stream=\"" << labelEscape(item.first) << "\"} " << item.second.bitrate << "\n";
+
+    // 回调读取的数值按名称分组输出
+    std::map<std::string, std::vector<std::pair<std::string, double>>> gauges;
+    for (const auto &item : streams)
+    {
+        for (const auto &gauge : item.second->readGauges())
+            gauges[gauge.first].emplace_back(item.first, gauge.second);
+    }
+    for (const auto &gauge : gauges)
+    {
+        out << "# TYPE video_streamer_" << gauge.first << " gauge\n";
+        for (const auto &value : gauge.second)
+            out << "video_streamer_" << gauge.first << "{stream=\"" << labelEscape(value.first) << "\"} " << value.second << "\n";
+    }
+    return out.str();
+}
+
+std::string MetricsRegistry::renderJson()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\"time\":" << std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count()
+        << ",\"streams\":[";
+
+    bool firstStream = true;
+    for (const auto &item : streams)
+    {
+        const StreamMetrics &m = *item.second;
+        Rates rates = computeRates(m, jsonSamples);
+
+        out << (firstStream ? "" : ",") << "{\"stream\":\"" << jsonEscape(m.name) << "\""
+            << ",\"fps\":" << rates.fps << ",\"bitrate\":" << rates.bitrate;
+        firstStream = false;
+
+        out << ",\"busy\":{";
+        for (size_t s = 0; s < rates.busy.size(); s++)
+            out << (s ? "," : "") << "\"" << stageName(static_cast<Stage>(s)) << "\":" << rates.busy[s];
+        out << "}";
+        if (rates.limiting != Stage::Count)
+            out << ",\"limiting_stage\":\"" << stageName(rates.limiting) << "\"";
+
+        out << ",\"frames_decoded\":" << m.framesDecoded << ",\"frames_out\":" << m.framesOut
+            << ",\"bytes_written\":" << m.bytesWritten << ",\"reconnects\":" << m.reconnects
+            << ",\"output_reconnects\":" << m.outputReconnects << ",\"forced_keyframes\":" << m.forcedKeyframes;
+        if (m.timeToFirstFrameNs >= 0)
+            out << ",\"time_to_first_frame\":" << m.timeToFirstFrameNs / 1e9;
+        for (const auto &gauge : m.readGauges())
+            out << ",\"" << gauge.first << "\":" << gauge.second;
+        out << "}";
+    }
+    out << "]}";
+    return out.str();
+}
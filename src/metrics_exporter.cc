@@ -0,0 +1,185 @@
+// metrics_exporter.cc
+#include "metrics_exporter.hh"
+#include "local_socket.hh"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+MetricsExporter::MetricsExporter(MetricsRegistry &reg, const MetricsOptions &opts)
+    : registry(reg), options(opts)
+{
+}
+
+MetricsExporter::~MetricsExporter()
+{
+    stop();
+}
+
+bool MetricsExporter::listenHttp()
+{
+    httpFd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (httpFd < 0)
+        return false;
+    int reuse = 1;
+    setsockopt(httpFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // 只监听本机地址, 不对外暴露
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<uint16_t>(options.httpPort));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(httpFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || ::listen(httpFd, 8) < 0)
+    {
+        std::cerr << "指标端口监听失败: " << options.httpPort << std::endl;
+        ::close(httpFd);
+        httpFd = -1;
+        return false;
+    }
+    std::cout << "指标: http://127.0.0.1:" << options.httpPort << "/metrics" << std::endl;
+    return true;
+}
+
+bool MetricsExporter::listenUnix()
+{
+    unixFd = LocalSocket::listenUnix(options.unixSocket, "指标");
+    if (unixFd < 0)
+        return false;
+    std::cout << "指标: unix:" << options.unixSocket << std::endl;
+    return true;
+}
+
+bool MetricsExporter::start()
+{
+    if (!options.enabled())
+        return false;
+
+    stopping = false;
+    bool ok = true;
+    if (options.httpPort > 0)
+        ok = listenHttp() && ok;
+    if (!options.unixSocket.empty())
+        ok = listenUnix() && ok;
+    if (httpFd >= 0 || unixFd >= 0)
+        serverThread = std::thread(&MetricsExporter::serveLoop, this);
+    if (!options.jsonPath.empty())
+        jsonThread = std::thread(&MetricsExporter::jsonLoop, this);
+    return ok;
+}
+
+void MetricsExporter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        wakeup.notify_all();
+    }
+    if (serverThread.joinable())
+        serverThread.join();
+    if (jsonThread.joinable())
+        jsonThread.join();
+
+    if (httpFd >= 0)
+    {
+        ::close(httpFd);
+        httpFd = -1;
+    }
+    if (unixFd >= 0)
+    {
+        ::close(unixFd);
+        unixFd = -1;
+        ::unlink(options.unixSocket.c_str());
+    }
+}
+
+void MetricsExporter::serveLoop()
+{
+    while (!stopping)
+    {
+        pollfd fds[2];
+        int count = 0;
+        if (httpFd >= 0)
+            fds[count++] = {httpFd, POLLIN, 0};
+        if (unixFd >= 0)
+            fds[count++] = {unixFd, POLLIN, 0};
+
+        // 定时醒来检查是否需要退出
+        if (::poll(fds, count, 200) <= 0)
+            continue;
+
+        for (int i = 0; i < count; i++)
+        {
+            if (!(fds[i].revents & POLLIN))
+                continue;
+            int client = ::accept(fds[i].fd, nullptr, nullptr);
+            if (client < 0)
+                continue;
+
+            timeval timeout = {1, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            if (fds[i].fd == httpFd)
+                serveHttp(client);
+            else
+                LocalSocket::writeAll(client, registry.renderPrometheus());
+            ::close(client);
+        }
+    }
+}
+
+void MetricsExporter::serveHttp(int client)
+{
+    // 只需要请求行, 读到第一个换行即可
+    std::string request;
+    char buf[1024];
+    while (request.find('\n') == std::string::npos && request.size() < 8192)
+    {
+        ssize_t n = ::recv(client, buf, sizeof(buf), 0);
+        if (n <= 0)
+            break;
+        request.append(buf, static_cast<size_t>(n));
+    }
+
+    if (request.compare(0, 13, "GET /metrics ") != 0 && request.compare(0, 6, "GET / ") != 0)
+    {
+        LocalSocket::writeAll(client, "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+
+    std::string body = registry.renderPrometheus();
+    LocalSocket::writeAll(client, "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                         std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+}
+
+void MetricsExporter::jsonLoop()
+{
+    std::ofstream file;
+    if (options.jsonPath != "-")
+    {
+        file.open(options.jsonPath, std::ios::app);
+        if (!file)
+        {
+            std::cerr << "无法打开指标文件: " << options.jsonPath << std::endl;
+            return;
+        }
+    }
+    std::ostream &out = options.jsonPath == "-" ? std::cout : file;
+
+    int interval = options.jsonIntervalSeconds > 0 ? options.jsonIntervalSeconds : 10;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wakeup.wait_for(lock, std::chrono::seconds(interval), [this]
+                            { return stopping.load(); }))
+    {
+        lock.unlock();
+        out << registry.renderJson() << std::endl;
+        lock.lock();
+    }
+}
@@ -0,0 +1,38 @@
+// reconnect_backoff.cc
+#include "reconnect_backoff.hh"
+
+#include <algorithm>
+#include <thread>
+
+ReconnectBackoff::ReconnectBackoff(const ReconnectOptions &opts)
+    : options(opts), rng(std::random_device()())
+{
+}
+
+std::chrono::milliseconds ReconnectBackoff::nextDelay()
+{
+    int64_t delay = std::max(1, options.initialDelayMs);
+    int64_t maxDelay = std::max<int64_t>(delay, options.maxDelayMs);
+    for (int i = 0; i < attempt && delay < maxDelay; i++)
+        delay *= 2;
+    delay = std::min(delay, maxDelay);
+    attempt++;
+
+    // 抖动后仍不超过上限
+    std::uniform_real_distribution<double> jitter(0.75, 1.25);
+    return std::chrono::milliseconds(std::min(maxDelay, static_cast<int64_t>(delay * jitter(rng))));
+}
+
+bool ReconnectBackoff::wait(const std::atomic<bool> &cancel)
+{
+    // 分段睡眠, 停止时不必等满整个退避时间
+    auto due = std::chrono::steady_clock::now() + nextDelay();
+    while (!cancel)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= due)
+            return true;
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(due - now, std::chrono::milliseconds(50)));
+    }
+    return false;
+}
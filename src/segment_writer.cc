@@ -0,0 +1,284 @@
+// segment_writer.cc
+#include "segment_writer.hh"
+
+extern "C"
+{
+#include <libavutil/mem.h>
+}
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// 写回调: 缓冲区攒满(或封装器主动刷新)时一次写盘, 处理部分写入和信号中断
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+static int writeToFile(void *opaque, const uint8_t *buf, int size)
+#else
+static int writeToFile(void *opaque, uint8_t *buf, int size)
+#endif
+{
+    int fd = *static_cast<int *>(opaque);
+    int written = 0;
+    while (written < size)
+    {
+        ssize_t n = ::write(fd, buf + written, size - written);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return AVERROR(errno);
+        }
+        written += static_cast<int>(n);
+    }
+    return written;
+}
+
+static bool endsWith(const std::string &s, const std::string &suffix)
+{
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static void syncDir(const std::string &dir)
+{
+    // 改名写入目录项后同步目录, 掉电后不会丢失改名
+    int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd >= 0)
+    {
+        ::fsync(dirFd);
+        ::close(dirFd);
+    }
+}
+
+SegmentWriter::SegmentWriter(const std::string &pathPrefix, const RecordOptions &opts)
+    : options(opts)
+{
+    size_t slash = pathPrefix.find_last_of('/');
+    dir = slash == std::string::npos ? "." : (slash == 0 ? "/" : pathPrefix.substr(0, slash));
+    prefix = slash == std::string::npos ? pathPrefix : pathPrefix.substr(slash + 1);
+    if (options.segmentSeconds <= 0)
+        options.segmentSeconds = 60;
+    if (options.bufferKb <= 0)
+        options.bufferKb = 1024;
+}
+
+SegmentWriter::~SegmentWriter()
+{
+    // 未正常结束的切片保留 .part 后缀, 下次启动时恢复
+    if (fd >= 0)
+        ::close(fd);
+}
+
+const char *SegmentWriter::formatName() const
+{
+    return options.format == "hls" ? "mpegts" : "mp4";
+}
+
+const char *SegmentWriter::extension() const
+{
+    return options.format == "hls" ? ".ts" : ".mp4";
+}
+
+void SegmentWriter::setMuxerOptions(AVDictionary **opts) const
+{
+    // 空 moov 加按关键帧分片, 不需要回写文件头, 写到一半的文件也能播放
+    if (options.format != "hls")
+        av_dict_set(opts, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+}
+
+void SegmentWriter::recover()
+{
+    recovered = true;
+    DIR *d = ::opendir(dir.c_str());
+    if (!d)
+        return;
+
+    std::string head = prefix + "_";
+    std::string ext = extension();
+    std::vector<std::string> names;
+    while (struct dirent *entry = ::readdir(d))
+    {
+        std::string name = entry->d_name;
+        if (name.compare(0, head.size(), head) != 0)
+            continue;
+        if (endsWith(name, ext + ".part"))
+        {
+            std::string complete = name.substr(0, name.size() - 5);
+            if (::rename((dir + "/" + name).c_str(), (dir + "/" + complete).c_str()) == 0)
+            {
+                std::cout << "已恢复未完成的录制切片: " << dir << "/" << complete << std::endl;
+                names.push_back(complete);
+            }
+        }
+        else if (endsWith(name, ext))
+        {
+            names.push_back(name);
+        }
+    }
+    ::closedir(d);
+
+    // 文件名带时间, 按名字排序即按时间排序; 之前的切片时长未知, 按切片时长计
+    std::sort(names.begin(), names.end());
+    if (options.format == "hls")
+    {
+        for (const auto &name : names)
+            playlist.push_back({name, static_cast<double>(options.segmentSeconds)});
+    }
+}
+
+AVIOContext *SegmentWriter::begin()
+{
+    if (!recovered)
+    {
+        recover();
+        prune();
+        writePlaylist();
+    }
+    ::mkdir(dir.c_str(), 0755);
+
+    char stamp[32];
+    std::time_t now = std::time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", &local);
+
+    // 同一秒内切换多次时加序号
+    std::string base = dir + "/" + prefix + "_" + stamp;
+    finalPath = base + extension();
+    for (int i = 1; ::access(finalPath.c_str(), F_OK) == 0; i++)
+        finalPath = base + "_" + std::to_string(i) + extension();
+    partPath = finalPath + ".part";
+
+    fd = ::open(partPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "无法创建录制切片: " << partPath << std::endl;
+        partPath.clear();
+        return nullptr;
+    }
+
+    int bufferSize = options.bufferKb * 1024;
+    unsigned char *buffer = static_cast<unsigned char *>(av_malloc(bufferSize));
+    AVIOContext *pb = buffer ? avio_alloc_context(buffer, bufferSize, 1, &fd, nullptr, writeToFile, nullptr) : nullptr;
+    if (!pb)
+    {
+        std::cerr << "无法分配录制写缓冲" << std::endl;
+        av_free(buffer);
+        ::close(fd);
+        fd = -1;
+        ::unlink(partPath.c_str());
+        partPath.clear();
+        return nullptr;
+    }
+    return pb;
+}
+
+void SegmentWriter::finish(AVIOContext **pb, double seconds)
+{
+    if (pb && *pb)
+    {
+        avio_flush(*pb);
+        av_freep(&(*pb)->buffer);
+        avio_context_free(pb);
+    }
+    if (fd >= 0)
+    {
+        ::fsync(fd);
+        ::close(fd);
+        fd = -1;
+    }
+    if (partPath.empty())
+        return;
+
+    if (seconds <= 0)
+    {
+        ::unlink(partPath.c_str());
+    }
+    else if (::rename(partPath.c_str(), finalPath.c_str()) == 0)
+    {
+        syncDir(dir);
+        std::cout << "录制切片已完成: " << finalPath << " (" << std::fixed << std::setprecision(1) << seconds
+                  << " 秒)" << std::endl;
+        if (options.format == "hls")
+            playlist.push_back({finalPath.substr(dir.size() + 1), seconds});
+    }
+    else
+    {
+        std::cerr << "录制切片改名失败: " << partPath << std::endl;
+    }
+    partPath.clear();
+
+    prune();
+    writePlaylist();
+}
+
+void SegmentWriter::prune()
+{
+    if (options.retentionHours <= 0)
+        return;
+
+    DIR *d = ::opendir(dir.c_str());
+    if (!d)
+        return;
+    std::time_t cutoff = std::time(nullptr) - static_cast<std::time_t>(options.retentionHours) * 3600;
+    std::string head = prefix + "_";
+    std::string ext = extension();
+    while (struct dirent *entry = ::readdir(d))
+    {
+        std::string name = entry->d_name;
+        if (name.compare(0, head.size(), head) != 0 || !endsWith(name, ext))
+            continue;
+        std::string path = dir + "/" + name;
+        struct stat st;
+        if (::stat(path.c_str(), &st) == 0 && st.st_mtime < cutoff && ::unlink(path.c_str()) == 0)
+            std::cout << "已删除过期的录制切片: " << path << std::endl;
+    }
+    ::closedir(d);
+
+    // 播放列表按时间排列, 删除的切片都在开头
+    while (!playlist.empty() && ::access((dir + "/" + playlist.front().name).c_str(), F_OK) != 0)
+    {
+        playlist.pop_front();
+        mediaSequence++;
+    }
+}
+
+void SegmentWriter::writePlaylist()
+{
+    if (options.format != "hls")
+        return;
+
+    double target = options.segmentSeconds;
+    for (const auto &segment : playlist)
+        target = std::max(target, segment.seconds);
+
+    // 先写临时文件再改名, 播放器不会读到半个列表
+    std::string path = dir + "/" + prefix + ".m3u8";
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out)
+            return;
+        out << "#EXTM3U\n"
+            << "#EXT-X-VERSION:3\n"
+            << "#EXT-X-TARGETDURATION:" << static_cast<int>(std::ceil(target)) << "\n"
+            << "#EXT-X-MEDIA-SEQUENCE:" << mediaSequence << "\n"
+            << std::fixed << std::setprecision(3);
+        for (const auto &segment : playlist)
+            out << "#EXTINF:" << segment.seconds << ",\n"
+                << segment.name << "\n";
+        if (!out)
+            return;
+    }
+    ::rename(tmp.c_str(), path.c_str());
+}
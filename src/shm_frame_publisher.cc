@@ -0,0 +1,151 @@
+// shm_frame_publisher.cc
+#include "shm_frame_publisher.hh"
+
+extern "C"
+{
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <iostream>
+
+ShmFramePublisher::ShmFramePublisher(const std::string &shmName, int slots)
+    : name(shmName.empty() || shmName[0] == '/' ? shmName : "/" + shmName),
+      slotCount(slots > 1 ? static_cast<uint32_t>(slots) : 2)
+{
+}
+
+ShmFramePublisher::~ShmFramePublisher()
+{
+    destroy();
+}
+
+bool ShmFramePublisher::create(uint32_t slotBytes)
+{
+    destroy();
+
+    // 总是新建一个段: 已映射旧段的读者不会因为段被截短而出错, 发现不再更新后重新 open
+    ::shm_unlink(name.c_str());
+    fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "无法创建共享内存: " << name << std::endl;
+        return false;
+    }
+    size_t total = ShmFrameHeader::totalBytes(slotCount, slotBytes);
+    if (::ftruncate(fd, static_cast<off_t>(total)) != 0)
+    {
+        std::cerr << "无法设置共享内存大小: " << name << ", " << total << " 字节" << std::endl;
+        destroy();
+        return false;
+    }
+    void *addr = ::mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        std::cerr << "无法映射共享内存: " << name << std::endl;
+        destroy();
+        return false;
+    }
+    mappedBytes = total;
+
+    // ftruncate 后内容全为 0, 序号和 latest 从 0 开始; 布局写完后再写 magic
+    header = static_cast<ShmFrameHeader *>(addr);
+    header->version = ShmFrameHeader::Version;
+    header->slotCount = slotCount;
+    header->slotBytes = slotBytes;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = ShmFrameHeader::Magic;
+    frameNumber = 0;
+
+    std::cout << "共享内存帧环已创建: " << name << ", 槽数=" << slotCount << ", 每槽 " << slotBytes << " 字节"
+              << std::endl;
+    return true;
+}
+
+void ShmFramePublisher::destroy()
+{
+    if (header)
+    {
+        ::munmap(header, mappedBytes);
+        header = nullptr;
+        mappedBytes = 0;
+    }
+    if (fd >= 0)
+    {
+        ::close(fd);
+        fd = -1;
+        ::shm_unlink(name.c_str());
+    }
+}
+
+bool ShmFramePublisher::publish(const AVFrame *frame, AVRational timeBase)
+{
+    if (!frame || frame->width <= 0 || frame->height <= 0)
+        return false;
+
+    AVPixelFormat format = static_cast<AVPixelFormat>(frame->format);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    int size = desc && !(desc->flags & AV_PIX_FMT_FLAG_HWACCEL)
+                   ? av_image_get_buffer_size(format, frame->width, frame->height, 1)
+                   : -1;
+    if (size <= 0)
+    {
+        if (!warned)
+            std::cerr << "共享内存帧环不支持该像素格式: " << (desc ? desc->name : "未知") << std::endl;
+        warned = true;
+        return false;
+    }
+
+    if (!header || static_cast<uint32_t>(size) > header->slotBytes)
+    {
+        if (!create(static_cast<uint32_t>(ShmFrameHeader::align(size))))
+            return false;
+    }
+
+    uint64_t number = frameNumber + 1;
+    uint32_t index = static_cast<uint32_t>((number - 1) % slotCount);
+    ShmFrameSlot *slot = header->slot(index);
+    uint8_t *base = header->slotData(index);
+
+    // 序号变为奇数, 读者看到后放弃这个槽
+    uint64_t seq = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // 各平面紧凑排列
+    uint8_t *dst[4] = {nullptr, nullptr, nullptr, nullptr};
+    int dstLinesize[4] = {0, 0, 0, 0};
+    av_image_fill_arrays(dst, dstLinesize, base, format, frame->width, frame->height, 1);
+    const uint8_t *src[4] = {frame->data[0], frame->data[1], frame->data[2], frame->data[3]};
+    int srcLinesize[4] = {frame->linesize[0], frame->linesize[1], frame->linesize[2], frame->linesize[3]};
+    av_image_copy(dst, dstLinesize, src, srcLinesize, format, frame->width, frame->height);
+
+    slot->frameNumber = number;
+    slot->pts = frame->pts;
+    slot->timeBaseNum = timeBase.num;
+    slot->timeBaseDen = timeBase.den;
+    slot->width = frame->width;
+    slot->height = frame->height;
+    slot->format = frame->format;
+    slot->planes = av_pix_fmt_count_planes(format);
+    for (int i = 0; i < 4; i++)
+    {
+        slot->linesize[i] = dstLinesize[i];
+        slot->offset[i] = dst[i] ? static_cast<uint32_t>(dst[i] - base) : 0;
+    }
+    slot->dataBytes = static_cast<uint32_t>(size);
+#ifdef AV_FRAME_FLAG_KEY
+    slot->keyFrame = (frame->flags & AV_FRAME_FLAG_KEY) ? 1 : 0;
+#else
+    slot->keyFrame = frame->key_frame ? 1 : 0;
+#endif
+
+    slot->seq.store(seq + 2, std::memory_order_release);
+    header->latest.store(number, std::memory_order_release);
+    frameNumber = number;
+    return true;
+}
@@ -0,0 +1,107 @@
+// shm_frame_ring.cc
+#include "shm_frame_ring.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+ShmFrameReader::~ShmFrameReader()
+{
+    close();
+}
+
+bool ShmFrameReader::open(const std::string &shmName)
+{
+    close();
+    name = shmName.empty() || shmName[0] == '/' ? shmName : "/" + shmName;
+
+    fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ShmFrameHeader))
+    {
+        close();
+        return false;
+    }
+    mappedBytes = static_cast<size_t>(st.st_size);
+    void *addr = ::mmap(nullptr, mappedBytes, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    header = static_cast<ShmFrameHeader *>(addr);
+
+    // 发布方初始化完布局后才写 magic
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (header->magic != ShmFrameHeader::Magic || header->version != ShmFrameHeader::Version ||
+        header->slotCount == 0 ||
+        ShmFrameHeader::totalBytes(header->slotCount, header->slotBytes) > mappedBytes)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ShmFrameReader::close()
+{
+    if (header)
+        ::munmap(header, mappedBytes);
+    header = nullptr;
+    mappedBytes = 0;
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+uint64_t ShmFrameReader::latestNumber() const
+{
+    return header ? header->latest.load(std::memory_order_acquire) : 0;
+}
+
+bool ShmFrameReader::latest(ShmFrameView &view, uint64_t after) const
+{
+    uint64_t number = latestNumber();
+    if (number == 0 || number <= after)
+        return false;
+
+    uint32_t index = static_cast<uint32_t>((number - 1) % header->slotCount);
+    const ShmFrameSlot *slot = header->slot(index);
+    uint64_t seq = slot->seq.load(std::memory_order_acquire);
+    if (seq & 1)
+        return false;
+
+    view.frameNumber = slot->frameNumber;
+    view.pts = slot->pts;
+    view.timeBaseNum = slot->timeBaseNum;
+    view.timeBaseDen = slot->timeBaseDen;
+    view.width = slot->width;
+    view.height = slot->height;
+    view.format = slot->format;
+    view.planes = slot->planes;
+    view.keyFrame = slot->keyFrame != 0;
+    const uint8_t *base = header->slotData(index);
+    for (int i = 0; i < 4; i++)
+    {
+        bool used = i < view.planes && slot->offset[i] < header->slotBytes;
+        view.data[i] = used ? base + slot->offset[i] : nullptr;
+        view.linesize[i] = used ? slot->linesize[i] : 0;
+    }
+    view.slot = index;
+    view.seq = seq;
+
+    // 元数据读取期间被覆盖时, 本次视图作废
+    return valid(view) && view.frameNumber == number;
+}
+
+bool ShmFrameReader::valid(const ShmFrameView &view) const
+{
+    if (!header || view.slot >= header->slotCount)
+        return false;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header->slot(view.slot)->seq.load(std::memory_order_relaxed) == view.seq;
+}
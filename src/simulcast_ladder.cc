@@ -0,0 +1,180 @@
+// simulcast_ladder.cc
+#include "simulcast_ladder.hh"
+#include "ffmpeg_pusher.hh"
+
+#include <algorithm>
+#include <iostream>
+
+SimulcastLadder::Level::Level(const RenditionConfig &c)
+    : config(c), label(std::to_string(c.width) + "x" + std::to_string(c.height)),
+      // 原始帧互不参考, 队列满时只丢弃新到的普通帧; 关键帧到来时清空积压, 关键帧本身不丢, 对齐不受影响
+      queue(4, OverflowPolicy::DropNonKey, [](const LadderFrame &f)
+            { return f.key; }),
+      // 逐级缩小用区域插值, 缩小时比双线性清晰
+      scaler(SWS_AREA)
+{
+    queue.setDisposable([](const LadderFrame &)
+                        { return true; });
+}
+
+SimulcastLadder::~SimulcastLadder()
+{
+    close();
+}
+
+void SimulcastLadder::addRendition(const RenditionConfig &config)
+{
+    // 编码器(YUV420P)要求偶数尺寸
+    RenditionConfig c = config;
+    c.width &= ~1;
+    c.height &= ~1;
+    for (auto &level : levels)
+    {
+        if (level->config.width == c.width && level->config.height == c.height)
+        {
+            level->config.outputs.insert(level->config.outputs.end(), c.outputs.begin(), c.outputs.end());
+            return;
+        }
+    }
+    levels.emplace_back(new Level(c));
+}
+
+void SimulcastLadder::setKeyframeSchedule(int gop, int minIntervalMs)
+{
+    gopFrames = std::max(1, gop);
+    keyframeMinIntervalMs = std::max(0, minIntervalMs);
+}
+
+bool SimulcastLadder::start(const PusherFactory &create)
+{
+    // 级联缩放: 每一级从上一级(更大的一级)缩小
+    std::stable_sort(levels.begin(), levels.end(), [](const std::unique_ptr<Level> &a, const std::unique_ptr<Level> &b)
+                     { return static_cast<int64_t>(a->config.width) * a->config.height >
+                              static_cast<int64_t>(b->config.width) * b->config.height; });
+
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        Level *level = levels[i].get();
+        if (level->config.width <= 0 || level->config.height <= 0 || level->config.outputs.empty())
+        {
+            std::cerr << "分级输出配置无效: " << level->label << std::endl;
+            return false;
+        }
+        level->pusher = create(level->config);
+        // 下级的关键帧请求(输出重连、GOP 缓存未命中)交给分级统一安排, 否则该级会与其他级错开
+        level->pusher->setKeyframeHandler([this]
+                                          { requestKeyframe(); });
+        if (!level->pusher->init())
+        {
+            std::cerr << "分级输出初始化失败: " << level->label << std::endl;
+            return false;
+        }
+        level->next = i + 1 < levels.size() ? levels[i + 1].get() : nullptr;
+    }
+
+    for (auto &level : levels)
+    {
+        Level *l = level.get();
+        l->queue.reset();
+        l->thread = std::thread(&SimulcastLadder::levelLoop, this, l);
+        if (metrics)
+        {
+            metrics->addGauge("rendition_" + l->label + "_frames", [l]
+                              { return static_cast<double>(l->frames); });
+            metrics->addGauge("rendition_" + l->label + "_dropped_frames", [l]
+                              { return static_cast<double>(l->queue.dropped()); });
+            metrics->addGauge("rendition_" + l->label + "_output_queue_bytes", [l]
+                              { return static_cast<double>(l->pusher->getOutputStats().queuedBytes); });
+        }
+        std::cout << "分级输出: " << l->label << ", 码率=" << l->config.profile.bitRate
+                  << ", 输出数=" << l->config.outputs.size() << std::endl;
+    }
+    return true;
+}
+
+bool SimulcastLadder::schedule(const AVFrame *frame, bool forceKey, bool *requested)
+{
+    // 固定 GOP 按送入的帧数计算, 请求的关键帧受最小间隔限制; 各级看到的是同一个决定
+    auto now = std::chrono::steady_clock::now();
+    bool byRequest = forceKey;
+    bool key = forceKey || sinceKeyframe < 0 || sinceKeyframe + 1 >= gopFrames;
+    if (!key && keyframeRequested &&
+        now - lastKeyframeTime >= std::chrono::milliseconds(keyframeMinIntervalMs))
+        key = byRequest = true;
+    if (requested)
+        *requested = byRequest;
+    if (key)
+    {
+        sinceKeyframe = 0;
+        lastKeyframeTime = now;
+        keyframeRequested = false;
+    }
+    else
+    {
+        sinceKeyframe++;
+    }
+
+    if (!levels.empty() && frame)
+    {
+        // 只增加引用, 缩放在第一级的线程中进行, 不占用上级的编码线程
+        LadderFrame item;
+        item.frame.reset(av_frame_clone(frame));
+        item.key = key;
+        if (item.frame)
+            levels.front()->queue.push(std::move(item));
+    }
+    return key;
+}
+
+void SimulcastLadder::levelLoop(Level *level)
+{
+    std::vector<PacketPtr> packets;
+    LadderFrame item;
+    while (level->queue.pop(item))
+    {
+        FramePtr scaled(av_frame_alloc());
+        bool ok;
+        {
+            StageTimer timer(metrics, Stage::RenditionScale);
+            ok = scaled && level->scaler.convert(item.frame.get(), scaled.get(), AV_PIX_FMT_YUV420P,
+                                                 level->config.width, level->config.height);
+        }
+        item.frame.reset();
+        if (!ok)
+        {
+            std::cerr << "分级输出缩放失败: " << level->label << std::endl;
+            continue;
+        }
+
+        // 下一级从本级缩小后的帧继续缩小, 像素量逐级减少
+        if (level->next)
+        {
+            LadderFrame down;
+            down.frame.reset(av_frame_clone(scaled.get()));
+            down.key = item.key;
+            if (down.frame)
+                level->next->queue.push(std::move(down));
+        }
+
+        if (level->pusher->encodeFrame(scaled.get(), item.key, packets) && !packets.empty())
+            level->pusher->writePackets(packets);
+        packets.clear();
+        level->frames++;
+    }
+    // 本级取完后下一级才结束, 已送入的帧逐级全部编码
+    if (level->next)
+        level->next->queue.close();
+}
+
+void SimulcastLadder::close()
+{
+    if (!levels.empty())
+        levels.front()->queue.close();
+    for (auto &level : levels)
+    {
+        if (level->thread.joinable())
+            level->thread.join();
+        if (level->pusher)
+            level->pusher->close();
+    }
+}
@@ -0,0 +1,261 @@
+// stream_channel.cc
+#include "stream_channel.hh"
+
+#include <chrono>
+
+static bool isKeyPacket(const PacketPtr &pkt)
+{
+    return pkt && (pkt->flags & AV_PKT_FLAG_KEY);
+}
+
+StreamChannel::StreamChannel(const ChannelConfig &cfg, WorkerPool &workerPool)
+    : config(cfg), pool(workerPool), capturer(cfg.input, cfg.capture),
+      packetQueue(256, OverflowPolicy::DropNonKey, isKeyPacket)
+{
+}
+
+StreamChannel::~StreamChannel()
+{
+    stop();
+}
+
+bool StreamChannel::start()
+{
+    if (running)
+        return false;
+
+    capturer.setMetrics(metrics);
+    capturer.setReconnectOptions(config.reconnect);
+    capturer.setIoTimeouts(config.io);
+    if (!capturer.open())
+    {
+        std::cerr << "[" << config.name << "] 拉流模块初始化失败" << std::endl;
+        return false;
+    }
+
+    // 发布到共享内存、处理帧和分级输出需要解码后的帧, auto 模式不走直通
+    bool needFrames = !config.capture.shmName.empty() || !config.processors.empty() || !config.renditions.empty();
+    std::string mode = needFrames && config.mode == "auto" ? "transcode" : config.mode;
+    passthrough = FFmpegPusher::selectPassthrough(mode, capturer.getCodecParameters()->codec_id, config.outputs);
+
+    int width = capturer.getWidth(), height = capturer.getHeight();
+    chain.reset(new ProcessingChain(0));
+    if (!passthrough && !config.processors.empty())
+    {
+        for (const auto &spec : config.processors)
+        {
+            if (!chain->add(spec))
+            {
+                capturer.close();
+                return false;
+            }
+        }
+        if (!chain->plan(capturer.getPixelFormat(), width, height, capturer.getTimeBase()))
+        {
+            std::cerr << "[" << config.name << "] 处理链初始化失败" << std::endl;
+            capturer.close();
+            return false;
+        }
+        width = chain->outputWidth();
+        height = chain->outputHeight();
+        chain->setMetrics(metrics);
+    }
+
+    pusher.reset(new FFmpegPusher(config.outputs[0].second, width, height,
+                                  resolveFrameRate(config, capturer.getFrameRate()), config.outputs[0].first));
+    for (size_t i = 1; i < config.outputs.size(); i++)
+        pusher->addOutput(config.outputs[i].second, config.outputs[i].first);
+    pusher->setEncoderThreads(config.encoderThreads);
+    pusher->setInputTimeBase(capturer.getTimeBase());
+    pusher->setEncoderProfile(config.encoder);
+    pusher->setAdaptiveBitrate(config.adaptiveBitrate);
+    pusher->setReconnectOptions(config.reconnect);
+    pusher->setIoTimeouts(config.io);
+    pusher->setOutputQueueLimits(config.outputQueue);
+    pusher->setRecordOptions(config.record);
+    pusher->setGopCacheBytes(config.gopCacheBytes);
+    pusher->setKeyframeMinInterval(config.keyframeMinIntervalMs);
+    pusher->setMetrics(metrics);
+    for (const auto &rendition : resolveRenditions(config))
+        pusher->addRendition(rendition);
+
+    bool pusherReady = passthrough
+                           ? pusher->initPassthrough(capturer.getCodecParameters(), capturer.getTimeBase())
+                           : pusher->init();
+    if (!pusherReady)
+    {
+        std::cerr << "[" << config.name << "] 推流模块初始化失败" << std::endl;
+        capturer.close();
+        return false;
+    }
+
+    decodedFrame = av_frame_alloc();
+    if (!decodedFrame)
+    {
+        std::cerr << "[" << config.name << "] 无法分配帧" << std::endl;
+        pusher->close();
+        capturer.close();
+        return false;
+    }
+
+    pacing = config.pace && !capturer.isLive();
+    pacer.reset(capturer.getTimeBase());
+
+    if (metrics)
+    {
+        metrics->addGauge("packet_queue_depth", [this]
+                          { return static_cast<double>(packetQueue.size()); });
+        metrics->addGauge("output_queue_bytes", [this]
+                          { return static_cast<double>(pusher->getOutputStats().queuedBytes); });
+        metrics->addGauge("encoder_max_bitrate", [this]
+                          { return static_cast<double>(pusher->getRateLimit()); });
+        metrics->addGauge("encoder_pending_frames", [this]
+                          { return static_cast<double>(pusher->getEncoderPending()); });
+        metrics->addGauge("gop_cache_bytes", [this]
+                          { return static_cast<double>(pusher->getGopCacheStats().bytes); });
+        metrics->addGauge("gop_cache_packets", [this]
+                          { return static_cast<double>(pusher->getGopCacheStats().packets); });
+        metrics->addGauge("gop_cache_hit_ratio", [this]
+                          { return pusher->getGopCacheStats().hitRatio(); });
+        metrics->addGauge("dropped_queue_packets", [this]
+                          { return static_cast<double>(packetQueue.dropped()); });
+        metrics->addGauge("dropped_output_packets", [this]
+                          { return static_cast<double>(pusher->getDroppedPackets()); });
+    }
+
+    poolChannel = pool.addChannel(config.name, config.cpuBudget);
+    packetQueue.reset();
+    stopping = false;
+    running = true;
+    readerThread = std::thread(&StreamChannel::readLoop, this);
+
+    std::cout << "[" << config.name << "] 已启动"
+              << (passthrough ? "(直通模式)" : "(转码模式, 编码器=" + pusher->getEncoderName() + ")") << std::endl;
+    return true;
+}
+
+void StreamChannel::stop()
+{
+    if (metrics)
+        metrics->clearGauges();
+    stopping = true;
+    packetQueue.close();
+    // 读包线程可能阻塞在网络读取中, 中断后立即退出
+    capturer.cancelIo();
+    if (readerThread.joinable())
+        readerThread.join();
+
+    // 等待本路正在执行的任务结束, 丢弃未执行的任务
+    if (poolChannel >= 0)
+    {
+        pool.removeChannel(poolChannel);
+        poolChannel = -1;
+    }
+
+    if (pusher)
+        pusher->close();
+    capturer.close();
+
+    if (decodedFrame)
+        av_frame_free(&decodedFrame);
+    running = false;
+}
+
+bool StreamChannel::reconnect()
+{
+    std::cerr << "[" << config.name << "] 读取失败，尝试重新连接..." << std::endl;
+
+    // 旧连接的包送进新的解码器没有意义, 直接丢弃
+    PacketPtr stale;
+    while (packetQueue.tryPop(stale))
+        stale.reset();
+
+    // 解码锁只在关闭和重新打开时持有, 退避等待期间不占用工作线程; 输出继续发送补帧
+    // 补帧与工作线程的编码写出都在解码锁下进行, 不会交错; 锁被占用(正在重新打开)时跳过这一帧
+    // 直通时拉流线程阻塞在重连中, 补帧包是唯一的写出者
+    pusher->startFiller([this](FramePtr frame)
+                        {
+                            std::unique_lock<std::mutex> lock(decodeMutex, std::try_to_lock);
+                            if (!lock.owns_lock())
+                                return;
+                            if (pusher->encodeFrame(frame.get(), encodedPackets) && !encodedPackets.empty())
+                                pusher->writePackets(encodedPackets);
+                            encodedPackets.clear(); },
+                        [this](PacketPtr pkt)
+                        { pusher->pushPacket(pkt.get()); });
+    bool ok = capturer.reconnect(stopping, &decodeMutex);
+    pusher->stopFiller();
+    if (!ok)
+    {
+        std::cerr << "[" << config.name << "] 重新连接失败" << std::endl;
+        return false;
+    }
+    pacer.reset(capturer.getTimeBase());
+    return true;
+}
+
+void StreamChannel::readLoop()
+{
+    while (!stopping)
+    {
+        PacketPtr pkt(av_packet_alloc());
+        if (!pkt || !capturer.readPacket(pkt.get()))
+        {
+            if (stopping || !reconnect())
+                break;
+            continue;
+        }
+        if (pacing)
+            pacer.wait(pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts);
+
+        // 直通模式没有计算任务, 直接交给输出
+        if (passthrough)
+        {
+            pusher->pushPacket(pkt.get());
+            continue;
+        }
+
+        // 队列满时丢弃到下一个关键帧, 保证解码器输入可解
+        if (!packetQueue.push(std::move(pkt)))
+            break;
+        pool.post(poolChannel, [this]
+                  { process(); });
+    }
+    running = false;
+}
+
+void StreamChannel::process()
+{
+    std::lock_guard<std::mutex> lock(decodeMutex);
+
+    PacketPtr pkt;
+    if (!packetQueue.tryPop(pkt))
+        return; // 包已被丢弃
+
+    if (!capturer.sendPacket(pkt.get()))
+        return;
+
+    bool gotFrame = false;
+    while (capturer.receiveFrame(decodedFrame, gotFrame) && gotFrame)
+    {
+        const AVFrame *frame = decodedFrame;
+        VideoFrame processed;
+        if (!chain->empty())
+        {
+            // 处理器丢弃的帧不编码
+            processed = VideoFrame(FramePtr(av_frame_clone(decodedFrame)));
+            if (!chain->processInline(processed))
+            {
+                av_frame_unref(decodedFrame);
+                continue;
+            }
+            frame = processed.current();
+        }
+
+        // 一帧取出的所有包一起分发
+        if (pusher->encodeFrame(frame, encodedPackets) && !encodedPackets.empty())
+            pusher->writePackets(encodedPackets);
+        encodedPackets.clear();
+        av_frame_unref(decodedFrame);
+    }
+}
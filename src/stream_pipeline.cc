@@ -0,0 +1,371 @@
+// stream_pipeline.cc
+#include "stream_pipeline.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+static bool isKeyBatch(const PacketBatch &batch)
+{
+    return std::any_of(batch.begin(), batch.end(), [](const PacketPtr &pkt)
+                       { return pkt && (pkt->flags & AV_PKT_FLAG_KEY); });
+}
+
+static PacketBatch singleBatch(PacketPtr pkt)
+{
+    PacketBatch batch;
+    batch.push_back(std::move(pkt));
+    return batch;
+}
+
+StreamPipeline::StreamPipeline(FFmpegCapture &cap, FFmpegPusher &push, bool copyMode,
+                               const PipelineOptions &opts)
+    : capturer(cap), pusher(push), passthrough(copyMode), options(opts),
+      frameQueue(opts.frameQueueSize, opts.frameOverflow),
+      packetQueue(opts.packetQueueSize, opts.packetOverflow, isKeyBatch)
+{
+}
+
+StreamPipeline::~StreamPipeline()
+{
+    stop();
+}
+
+bool StreamPipeline::start()
+{
+    if (running)
+        return false;
+
+    frameQueue.reset();
+    packetQueue.reset();
+    pacing = options.pace && !capturer.isLive();
+    if (options.pace && !pacing)
+        std::cerr << "实时输入不按时间戳节奏读取, 忽略 pace 选项" << std::endl;
+    pacer.reset(capturer.getTimeBase());
+    staleFrames = 0;
+    lagValid = false;
+    overloadSince = healthySince = std::chrono::steady_clock::now();
+    lastPacketDrops = 0;
+    stopping = false;
+    running = true;
+
+    muxThread = std::thread(&StreamPipeline::muxLoop, this);
+    if (!passthrough)
+    {
+        if (chain && chain->parallel())
+        {
+            chain->start();
+            processThread = std::thread(&StreamPipeline::processLoop, this);
+        }
+        encodeThread = std::thread(&StreamPipeline::encodeLoop, this);
+    }
+    captureThread = std::thread(&StreamPipeline::captureLoop, this);
+    return true;
+}
+
+void StreamPipeline::stop()
+{
+    stopping = true;
+    // 包队列由生产者(编码线程, 直通时为拉流线程)在退出时关闭, 已编码的包全部写出后写出线程才结束
+    frameQueue.close();
+    if (chain)
+        chain->close();
+    // 拉流线程可能阻塞在网络读取中, 中断后立即退出
+    capturer.cancelIo();
+
+    // 回调引用本对象, 停止后不再导出
+    if (metrics)
+        metrics->clearGauges();
+
+    bool started = captureThread.joinable();
+    if (captureThread.joinable())
+        captureThread.join();
+    if (processThread.joinable())
+        processThread.join();
+    if (encodeThread.joinable())
+        encodeThread.join();
+    if (muxThread.joinable())
+        muxThread.join();
+
+    if (started)
+    {
+        FramePoolStats captureStats = capturer.getFramePoolStats();
+        FramePoolStats pushStats = pusher.getFramePoolStats();
+        DropStats drops = getDropStats();
+        std::cout << "流水线已停止: 过期帧=" << drops.staleFrames << ", 帧队列溢出=" << drops.queueFrames
+                  << ", 解码器跳帧=" << drops.decoderSkipped << ", 包队列溢出=" << drops.queuePackets
+                  << ", 输出队列溢出=" << drops.outputPackets << std::endl;
+        std::cout << "帧池统计: 拉流(分配=" << captureStats.allocations << ", 复用=" << captureStats.reuses
+                  << ", 峰值=" << captureStats.highWater << "), 推流(分配=" << pushStats.allocations
+                  << ", 复用=" << pushStats.reuses << ", 峰值=" << pushStats.highWater << ")" << std::endl;
+        if (!passthrough)
+        {
+            DecodeStats decodeStats = capturer.getDecodeStats();
+            std::cout << "解码统计: 包=" << decodeStats.packets << ", 帧=" << decodeStats.frames
+                      << ", 耗时=" << decodeStats.decodeSeconds << "s, 最大积压=" << decodeStats.maxDepth
+                      << std::endl;
+        }
+    }
+    running = false;
+}
+
+void StreamPipeline::setMetrics(StreamMetrics *m)
+{
+    metrics = m;
+    if (!metrics)
+        return;
+
+    metrics->addGauge("frame_queue_depth", [this]
+                      { return static_cast<double>(frameQueue.size()); });
+    metrics->addGauge("packet_queue_depth", [this]
+                      { return static_cast<double>(packetQueue.size()); });
+    metrics->addGauge("output_queue_bytes", [this]
+                      { return static_cast<double>(pusher.getOutputStats().queuedBytes); });
+    metrics->addGauge("encoder_max_bitrate", [this]
+                      { return static_cast<double>(pusher.getRateLimit()); });
+    metrics->addGauge("encoder_pending_frames", [this]
+                      { return static_cast<double>(pusher.getEncoderPending()); });
+    metrics->addGauge("gop_cache_bytes", [this]
+                      { return static_cast<double>(pusher.getGopCacheStats().bytes); });
+    metrics->addGauge("gop_cache_packets", [this]
+                      { return static_cast<double>(pusher.getGopCacheStats().packets); });
+    metrics->addGauge("gop_cache_hit_ratio", [this]
+                      { return pusher.getGopCacheStats().hitRatio(); });
+    metrics->addGauge("dropped_stale_frames", [this]
+                      { return static_cast<double>(staleFrames); });
+    metrics->addGauge("dropped_queue_frames", [this]
+                      { return static_cast<double>(frameQueue.dropped()); });
+    metrics->addGauge("dropped_decoder_frames", [this]
+                      { return static_cast<double>(capturer.getDecodeStats().skipped); });
+    metrics->addGauge("dropped_queue_packets", [this]
+                      { return static_cast<double>(packetQueue.dropped()); });
+    metrics->addGauge("dropped_output_packets", [this]
+                      { return static_cast<double>(pusher.getDroppedPackets()); });
+}
+
+DropStats StreamPipeline::getDropStats() const
+{
+    DropStats stats;
+    stats.staleFrames = staleFrames;
+    stats.queueFrames = frameQueue.dropped();
+    stats.decoderSkipped = capturer.getDecodeStats().skipped;
+    stats.queuePackets = packetQueue.dropped();
+    stats.outputPackets = pusher.getDroppedPackets();
+    return stats;
+}
+
+void StreamPipeline::adjustDecoderSkip(const AVFrame *frame)
+{
+    AVRational timeBase = capturer.getTimeBase();
+    if (frame->pts == AV_NOPTS_VALUE || timeBase.num <= 0)
+        return;
+
+    // 实时流按源时间戳的速度到达, 解码输出相对墙钟越来越晚说明解码跟不上
+    auto now = std::chrono::steady_clock::now();
+    double offset = std::chrono::duration<double>(now.time_since_epoch()).count() - frame->pts * av_q2d(timeBase);
+    double lag = offset - lagBaseline;
+    if (!lagValid || lag < 0 || lag > 10)
+    {
+        // 首帧、追上进度或时间戳跳变时重新取基准
+        lagBaseline = offset;
+        lagValid = true;
+        lag = 0;
+    }
+
+    double budget = options.latencyBudgetMs / 1000.0;
+    AVDiscard skip = capturer.getSkipFrame();
+    if (lag > budget)
+    {
+        healthySince = now;
+        // 持续过载 1 秒升一级: 先只解参考帧, 仍跟不上再只解关键帧
+        if (now - overloadSince >= std::chrono::seconds(1) && skip != AVDISCARD_NONKEY)
+        {
+            AVDiscard next = skip == AVDISCARD_DEFAULT ? AVDISCARD_NONREF : AVDISCARD_NONKEY;
+            std::cerr << "解码落后 " << static_cast<int>(lag * 1000) << "ms, skip_frame="
+                      << (next == AVDISCARD_NONREF ? "nonref" : "nonkey") << std::endl;
+            capturer.setSkipFrame(next);
+            overloadSince = now;
+        }
+    }
+    else
+    {
+        overloadSince = now;
+        // 落后时间回到预算一半以内并保持 2 秒后降一级
+        if (skip != AVDISCARD_DEFAULT && lag < budget / 2 && now - healthySince >= std::chrono::seconds(2))
+        {
+            AVDiscard next = skip == AVDISCARD_NONKEY ? AVDISCARD_NONREF : AVDISCARD_DEFAULT;
+            std::cout << "解码已追上, skip_frame=" << (next == AVDISCARD_NONREF ? "nonref" : "default") << std::endl;
+            capturer.setSkipFrame(next);
+            healthySince = now;
+        }
+        else if (lag >= budget / 2)
+        {
+            healthySince = now;
+        }
+    }
+}
+
+void StreamPipeline::checkPacketDrops()
+{
+    // 编码后的包被丢弃时, 输出要等到下一个关键帧才能恢复; 请求一个关键帧缩短恢复时间
+    // 解码帧的丢弃不影响码流可解, 不请求关键帧, 以免过载时再增加码率
+    uint64_t drops = packetQueue.dropped() + pusher.getDroppedPackets();
+    if (drops == lastPacketDrops)
+        return;
+    lastPacketDrops = drops;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastKeyframeRequest < std::chrono::seconds(1))
+        return;
+    lastKeyframeRequest = now;
+    std::cerr << "输出丢包, 请求关键帧" << std::endl;
+    pusher.requestKeyframe();
+}
+
+bool StreamPipeline::reconnect()
+{
+    std::cerr << "读取失败，尝试重新连接..." << std::endl;
+    // 重连在拉流线程中进行, 期间输出继续发送补帧, 下游会话不断开
+    // 补帧与真实的帧走同一个队列, 由编码线程和写出线程按顺序处理
+    pusher.startFiller([this](FramePtr frame)
+                       {
+                           VideoFrame filler(std::move(frame));
+                           filler.markRepeated();
+                           frameQueue.push(std::move(filler)); },
+                       [this](PacketPtr pkt)
+                       { packetQueue.push(singleBatch(std::move(pkt))); });
+    bool ok = capturer.reconnect(stopping);
+    pusher.stopFiller();
+    if (!ok)
+    {
+        std::cerr << "重新连接失败" << std::endl;
+        return false;
+    }
+    pacer.reset(capturer.getTimeBase());
+    lagValid = false;
+    overloadSince = healthySince = std::chrono::steady_clock::now();
+    capturer.setSkipFrame(AVDISCARD_DEFAULT);
+    return true;
+}
+
+void StreamPipeline::captureLoop()
+{
+    while (!stopping)
+    {
+        if (passthrough)
+        {
+            PacketPtr pkt(av_packet_alloc());
+            if (!pkt || !capturer.readPacket(pkt.get()))
+            {
+                if (stopping || !reconnect())
+                    break;
+                continue;
+            }
+            if (pacing)
+                pacer.wait(pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts);
+            if (!packetQueue.push(singleBatch(std::move(pkt))))
+                break;
+        }
+        else
+        {
+            // 解码器原生格式的帧直接交给编码器, 队列中只传递引用, 不转换不拷贝像素
+            FramePtr captureFrame(av_frame_alloc());
+            if (!captureFrame || !capturer.readNativeFrame(captureFrame.get()))
+            {
+                if (stopping || !reconnect())
+                    break;
+                continue;
+            }
+            if (pacing)
+                pacer.wait(captureFrame->pts);
+            if (options.latencyBudgetMs > 0 && capturer.isLive())
+                adjustDecoderSkip(captureFrame.get());
+            if (!frameQueue.push(VideoFrame(std::move(captureFrame))))
+                break;
+        }
+    }
+
+    // 通知下游不会再有新数据
+    frameQueue.close();
+    if (passthrough)
+        packetQueue.close();
+    running = false;
+}
+
+bool StreamPipeline::nextFrame(VideoFrame &frame)
+{
+    // 最新帧优先: 已有更新的帧在排队时, 超出预算的旧帧不做处理和编码, 直接丢弃
+    auto budget = std::chrono::milliseconds(options.latencyBudgetMs);
+    while (frameQueue.pop(frame))
+    {
+        if (options.latencyBudgetMs > 0 && frame.age() > budget && frameQueue.size() > 0)
+        {
+            staleFrames++;
+            frame = VideoFrame();
+            continue;
+        }
+        return true;
+    }
+    return false;
+}
+
+void StreamPipeline::processLoop()
+{
+    // 按解码顺序送入处理链, 在途帧数达到上限时在这里等待, 帧队列照常按溢出策略丢帧
+    VideoFrame frame;
+    while (nextFrame(frame))
+    {
+        if (!chain->submit(std::move(frame)))
+            break;
+        frame = VideoFrame();
+    }
+    chain->close();
+}
+
+void StreamPipeline::encodeLoop()
+{
+    // 帧按到达的速度编码, 时间戳取自源帧, 不再按固定帧率等待
+    bool parallel = chain && chain->parallel();
+    VideoFrame inFrame;
+    std::vector<PacketPtr> encodedPackets;
+    while (parallel ? chain->next(inFrame) : nextFrame(inFrame))
+    {
+        // 没有工作线程时在编码线程中处理, 处理器丢弃的帧不编码
+        if (chain && !parallel && !chain->processInline(inFrame))
+        {
+            inFrame = VideoFrame();
+            continue;
+        }
+
+        // 一帧可能对应多个包(B 帧重排序), 作为一个整体交给写出线程
+        bool queueOpen = true;
+        if (pusher.encodeFrame(inFrame.current(), encodedPackets) && !encodedPackets.empty())
+            queueOpen = packetQueue.push(std::move(encodedPackets));
+        encodedPackets.clear();
+        inFrame = VideoFrame(); // 释放帧引用
+        if (!queueOpen)
+            break;
+    }
+
+    if (parallel)
+        chain->close();
+    packetQueue.close();
+}
+
+void StreamPipeline::muxLoop()
+{
+    PacketBatch batch;
+    while (packetQueue.pop(batch))
+    {
+        if (passthrough)
+        {
+            for (auto &pkt : batch)
+                pusher.pushPacket(pkt.get());
+            batch.clear();
+            continue;
+        }
+        pusher.writePackets(batch);
+        batch.clear();
+        checkPacketDrops();
+    }
+}
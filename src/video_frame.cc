@@ -0,0 +1,90 @@
+// video_frame.cc
+#include "video_frame.hh"
+
+extern "C"
+{
+#include <libavutil/pixdesc.h>
+}
+#include <iostream>
+
+FrameConverter::FrameConverter(int flags) : swsFlags(flags)
+{
+}
+
+FrameConverter::~FrameConverter()
+{
+    if (swsContext)
+    {
+        sws_freeContext(swsContext);
+        swsContext = nullptr;
+    }
+}
+
+bool FrameConverter::prepare(const AVFrame *src, AVPixelFormat format, int width, int height)
+{
+    if (!src || !src->data[0] || src->width <= 0 || src->height <= 0)
+        return false;
+
+    // 输入格式或尺寸变化时才重建上下文
+    swsContext = sws_getCachedContext(swsContext,
+                                      src->width, src->height, static_cast<AVPixelFormat>(src->format),
+                                      width, height, format,
+                                      swsFlags, nullptr, nullptr, nullptr);
+    if (!swsContext)
+    {
+        std::cerr << "无法初始化SWS上下文: "
+                  << av_get_pix_fmt_name(static_cast<AVPixelFormat>(src->format)) << " -> "
+                  << av_get_pix_fmt_name(format) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool FrameConverter::convert(const AVFrame *src, AVFrame *dst, AVPixelFormat format, int width, int height)
+{
+    if (!dst || !prepare(src, format, width, height))
+        return false;
+
+    if (!framePool.acquire(dst, format, width, height))
+    {
+        std::cerr << "无法从帧池获取缓冲区" << std::endl;
+        return false;
+    }
+    av_frame_copy_props(dst, src);
+
+    sws_scale(swsContext, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+    return true;
+}
+
+bool FrameConverter::convert(const AVFrame *src, uint8_t *const dstData[], const int dstLinesize[],
+                             AVPixelFormat format, int width, int height)
+{
+    if (!prepare(src, format, width, height))
+        return false;
+
+    sws_scale(swsContext, src->data, src->linesize, 0, src->height, dstData, dstLinesize);
+    return true;
+}
+
+cv::Mat &VideoFrame::rgb(FrameConverter &converter)
+{
+    if (!rgbFrame && nativeFrame)
+    {
+        if (nativeFrame->format == AV_PIX_FMT_RGB24)
+        {
+            rgbMat = FramePool::toMat(nativeFrame.get());
+            rgbFrame.reset(av_frame_clone(nativeFrame.get()));
+        }
+        else
+        {
+            FramePtr converted(av_frame_alloc());
+            if (converted && converter.convert(nativeFrame.get(), converted.get(), AV_PIX_FMT_RGB24,
+                                               nativeFrame->width, nativeFrame->height))
+            {
+                rgbFrame = std::move(converted);
+                rgbMat = FramePool::toMat(rgbFrame.get());
+            }
+        }
+    }
+    return rgbMat;
+}
@@ -0,0 +1,205 @@
+// worker_pool.cc
+#include "worker_pool.hh"
+
+#include <ctime>
+#include <iostream>
+
+static double threadCpuSeconds()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+WorkerPool::WorkerPool(size_t threads, std::chrono::milliseconds window)
+    : windowLength(window), windowStart(std::chrono::steady_clock::now())
+{
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+    for (size_t i = 0; i < threads; i++)
+        workers.emplace_back(&WorkerPool::workerLoop, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+int WorkerPool::addChannel(const std::string &name, double cpuBudget)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    int id = nextChannelId++;
+    Channel &ch = channels[id];
+    ch.name = name;
+    ch.cpuBudget = cpuBudget;
+    ch.stats.name = name;
+    return id;
+}
+
+void WorkerPool::removeChannel(int channel)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    auto it = channels.find(channel);
+    if (it == channels.end())
+        return;
+
+    Channel &ch = it->second;
+    ch.removed = true;
+    ch.tasks.clear();
+    for (auto r = ready.begin(); r != ready.end(); ++r)
+    {
+        if (*r == channel)
+        {
+            ready.erase(r);
+            break;
+        }
+    }
+    idle.wait(lock, [&ch]
+              { return !ch.running; });
+    channels.erase(it);
+}
+
+bool WorkerPool::post(int channel, std::function<void()> task)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = channels.find(channel);
+    if (stopping || it == channels.end() || it->second.removed)
+        return false;
+
+    Channel &ch = it->second;
+    ch.tasks.push_back(std::move(task));
+    if (!ch.running && !ch.queued)
+    {
+        ch.queued = true;
+        ready.push_back(channel);
+        wakeup.notify_one();
+    }
+    return true;
+}
+
+void WorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping)
+            return;
+        stopping = true;
+        wakeup.notify_all();
+    }
+    for (auto &worker : workers)
+    {
+        if (worker.joinable())
+            worker.join();
+    }
+}
+
+std::vector<WorkerPool::ChannelStats> WorkerPool::stats() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<ChannelStats> result;
+    for (const auto &item : channels)
+    {
+        ChannelStats s = item.second.stats;
+        s.pending = item.second.tasks.size();
+        result.push_back(s);
+    }
+    return result;
+}
+
+bool WorkerPool::overBudget(const Channel &ch) const
+{
+    if (ch.cpuBudget <= 0)
+        return false;
+    double windowSeconds = std::chrono::duration<double>(windowLength).count();
+    return ch.windowCpu >= ch.cpuBudget * windowSeconds;
+}
+
+void WorkerPool::rollWindow(std::chrono::steady_clock::time_point now)
+{
+    if (now - windowStart < windowLength)
+        return;
+
+    // 新窗口开始, 重置各路的CPU用量
+    windowStart = now;
+    for (auto &item : channels)
+        item.second.windowCpu = 0;
+    wakeup.notify_all();
+}
+
+void WorkerPool::workerLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping)
+    {
+        rollWindow(std::chrono::steady_clock::now());
+
+        // 按就绪顺序找第一个未超预算的路, 执行完后排到队尾, 实现轮转
+        int picked = -1;
+        bool anyThrottled = false;
+        for (auto it = ready.begin(); it != ready.end(); ++it)
+        {
+            Channel &ch = channels[*it];
+            if (overBudget(ch))
+            {
+                anyThrottled = true;
+                continue;
+            }
+            picked = *it;
+            ready.erase(it);
+            break;
+        }
+
+        if (picked < 0)
+        {
+            if (anyThrottled)
+            {
+                for (int id : ready)
+                {
+                    if (overBudget(channels[id]))
+                        channels[id].stats.throttled++;
+                }
+                wakeup.wait_until(lock, windowStart + windowLength);
+            }
+            else
+            {
+                wakeup.wait(lock);
+            }
+            continue;
+        }
+
+        Channel &ch = channels[picked];
+        ch.queued = false;
+        ch.running = true;
+        std::function<void()> task = std::move(ch.tasks.front());
+        ch.tasks.pop_front();
+        lock.unlock();
+
+        double cpuStart = threadCpuSeconds();
+        try
+        {
+            task();
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "任务异常 (" << ch.name << "): " << e.what() << std::endl;
+        }
+        double cpu = threadCpuSeconds() - cpuStart;
+
+        lock.lock();
+        ch.running = false;
+        ch.windowCpu += cpu;
+        ch.stats.cpuSeconds += cpu;
+        ch.stats.tasks++;
+        if (ch.removed)
+        {
+            idle.notify_all();
+            continue;
+        }
+        if (!ch.tasks.empty())
+        {
+            ch.queued = true;
+            ready.push_back(picked);
+            wakeup.notify_one();
+        }
+    }
+}